@@ -0,0 +1,105 @@
+# Builds the LittleFS site image content from `site/` into `data/site/`:
+# every asset is gzipped as `<name>.gz` and listed in `data/site/manifest`,
+# one line per asset: <path>\t<gzip size>\t<etag>\t<max-age>\t<mime type>
+# Gateway config files in `config/` (e.g. devices.json) are copied to `data/`
+# as they are; `*.example` files there are only documentation.
+#
+# Runs as a PlatformIO pre script (see platformio.ini) or standalone.
+
+import gzip
+import hashlib
+import mimetypes
+import os
+import re
+import shutil
+
+MIME_TYPES = {
+    ".htm": "text/html",
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".json": "application/json",
+    ".png": "image/png",
+    ".jpg": "image/jpeg",
+    ".jpeg": "image/jpeg",
+    ".gif": "image/gif",
+    ".svg": "image/svg+xml",
+    ".ico": "image/x-icon",
+}
+
+# Only an asset whose name carries a content hash (`app.3f2a9c1d.js`) may be
+# cached: a new build gives it a new name. Everything else is revalidated
+# with the etag on every load, or a stale css/js would outlive an update.
+REVALIDATE_MAX_AGE = 0
+FINGERPRINTED_MAX_AGE = 30 * 24 * 3600
+FINGERPRINT = re.compile(r"\.[0-9a-f]{8,}\.[^./]+$")
+
+
+def mime_type(name):
+    ext = os.path.splitext(name)[1].lower()
+    return MIME_TYPES.get(ext) or mimetypes.guess_type(name)[0] or "text/plain"
+
+
+def max_age(name):
+    return FINGERPRINTED_MAX_AGE if FINGERPRINT.search(name) else REVALIDATE_MAX_AGE
+
+
+def build_site(project_dir):
+    src_dir = os.path.join(project_dir, "site")
+    out_dir = os.path.join(project_dir, "data", "site")
+
+    shutil.rmtree(out_dir, ignore_errors=True)
+    os.makedirs(out_dir)
+
+    manifest = []
+    for root, _, files in os.walk(src_dir):
+        for name in sorted(files):
+            src = os.path.join(root, name)
+            path = os.path.relpath(src, src_dir).replace(os.sep, "/")
+
+            with open(src, "rb") as f:
+                content = f.read()
+            # mtime=0 keeps the output, and so the etag, reproducible
+            packed = gzip.compress(content, compresslevel=9, mtime=0)
+
+            dst = os.path.join(out_dir, path + ".gz")
+            os.makedirs(os.path.dirname(dst), exist_ok=True)
+            with open(dst, "wb") as f:
+                f.write(packed)
+
+            etag = hashlib.sha1(packed).hexdigest()[:16]
+            manifest.append("%s\t%d\t%s\t%d\t%s\n" % (path, len(packed), etag, max_age(name), mime_type(name)))
+
+            print("site: %s %d -> %d bytes" % (path, len(content), len(packed)))
+
+    manifest.sort()
+    with open(os.path.join(out_dir, "manifest"), "w") as f:
+        f.writelines(manifest)
+
+
+def copy_config(project_dir):
+    src_dir = os.path.join(project_dir, "config")
+    out_dir = os.path.join(project_dir, "data")
+    if not os.path.isdir(src_dir):
+        return
+
+    for name in sorted(os.listdir(src_dir)):
+        src = os.path.join(src_dir, name)
+        if not os.path.isfile(src) or name.endswith(".example"):
+            continue
+
+        shutil.copyfile(src, os.path.join(out_dir, name))
+        print("config: %s" % name)
+
+
+def build(project_dir):
+    build_site(project_dir)
+    copy_config(project_dir)
+
+
+try:
+    Import("env")  # noqa: F821
+    build(env["PROJECT_DIR"])  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        build(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
@@ -0,0 +1,148 @@
+# Converts captured raw IR timings (as printed by IRrecvDumpV2 and the like)
+# into a compact pulse-distance IrCode (see src/ircode.h), and checks that
+# expanding the code gives back every raw timing within the tolerance.
+#
+#   python3 scripts/ir_convert.py <name> <file with the raw array> [--hz 38000] [--tolerance 0.25] [--json]
+#
+# Prints the PROGMEM definition to paste into a device, or with --json a
+# device profile for config/devices.json (see src/profiles.h); exits with 1
+# if the capture isn't pulse-distance encoded or doesn't round-trip.
+
+import argparse
+import json
+import re
+import sys
+
+
+def parse_raw(text):
+    # only the initializer, so `rawData[83]` or a trailing comment don't count
+    body = text[text.index("{") + 1:text.rindex("}")] if "{" in text else text
+    body = re.sub(r"//.*", "", body)
+    return [int(v) for v in re.findall(r"\d+", body)]
+
+
+def mean(values):
+    return int(round(sum(values) / float(len(values))))
+
+
+def encode(raw):
+    if len(raw) < 4:
+        raise ValueError("too short for a header and one bit")
+
+    header_mark, header_space = raw[0], raw[1]
+    body = raw[2:]
+    trailer_mark = 0
+    if len(body) % 2:
+        trailer_mark = body[-1]
+        body = body[:-1]
+
+    marks = body[0::2]
+    spaces = body[1::2]
+
+    # split spaces at the middle of their range into zeros and ones
+    threshold = (min(spaces) + max(spaces)) / 2.0
+    zeros = [s for s in spaces if s < threshold]
+    ones = [s for s in spaces if s >= threshold]
+    if not zeros or not ones:
+        raise ValueError("all bits have the same space, not pulse-distance encoded")
+
+    bits = [1 if s >= threshold else 0 for s in spaces]
+
+    return {
+        "header_mark": header_mark,
+        "header_space": header_space,
+        "bit_mark": mean(marks),
+        "zero_space": mean(zeros),
+        "one_space": mean(ones),
+        "trailer_mark": trailer_mark,
+        "bits": bits,
+    }
+
+
+def expand(code):
+    timings = [code["header_mark"], code["header_space"]]
+    for bit in code["bits"]:
+        timings.append(code["bit_mark"])
+        timings.append(code["one_space"] if bit else code["zero_space"])
+    if code["trailer_mark"]:
+        timings.append(code["trailer_mark"])
+    return timings
+
+
+def check(raw, code, tolerance):
+    expanded = expand(code)
+    if len(expanded) != len(raw):
+        return ["length %d, expected %d" % (len(expanded), len(raw))]
+
+    errors = []
+    for i, (want, got) in enumerate(zip(raw, expanded)):
+        if abs(got - want) > want * tolerance:
+            errors.append("timing %d: %d, expected %d" % (i, got, want))
+    return errors
+
+
+def pack_bits(bits):
+    # LSB first, as the transmitter sends them
+    data = bytearray((len(bits) + 7) // 8)
+    for i, bit in enumerate(bits):
+        if bit:
+            data[i // 8] |= 1 << (i % 8)
+    return data
+
+
+def emit(name, code, hz):
+    data = pack_bits(code["bits"])
+    return (
+        "static const uint8_t %sBits[] PROGMEM = {%s};\n"
+        "static const IrCode %s PROGMEM = {\n"
+        "    %d, %d, %d, %d, %d, %d, %d, %d, %sBits\n"
+        "};\n" % (
+            name, ", ".join("0x%02X" % b for b in data), name,
+            hz, code["header_mark"], code["header_space"],
+            code["bit_mark"], code["zero_space"], code["one_space"],
+            code["trailer_mark"], len(code["bits"]), name))
+
+
+def emit_json(name, code, hz):
+    profile = {
+        "hz": hz,
+        "timing": [code["header_mark"], code["header_space"], code["bit_mark"],
+                   code["zero_space"], code["one_space"], code["trailer_mark"]],
+        "bits": len(code["bits"]),
+        "commands": {name: "".join("%02X" % b for b in pack_bits(code["bits"]))},
+    }
+    return json.dumps(profile) + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("name")
+    parser.add_argument("file")
+    parser.add_argument("--hz", type=int, default=38000)
+    parser.add_argument("--tolerance", type=float, default=0.25)
+    parser.add_argument("--json", action="store_true")
+    args = parser.parse_args()
+
+    with open(args.file) as f:
+        raw = parse_raw(f.read())
+
+    try:
+        code = encode(raw)
+    except ValueError as e:
+        print("%s: %s" % (args.file, e), file=sys.stderr)
+        return 1
+
+    errors = check(raw, code, args.tolerance)
+    if errors:
+        for e in errors:
+            print("%s: %s" % (args.file, e), file=sys.stderr)
+        return 1
+
+    sys.stdout.write((emit_json if args.json else emit)(args.name, code, args.hz))
+    print("// %d timings (%d bytes) -> %d bits" % (len(raw), len(raw) * 2, len(code["bits"])),
+          file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -1,12 +1,30 @@
 #pragma once
 
 #include <Arduino.h>
-#include <Ticker.h>
 #include <ESP8266WiFi.h>
 #include <ArduinoOTA.h>
+#include <functional>
+#include <vector>
 
 #include "DebugLog.h"
+#include "button.h"
 #include "devices.h"
+#include "ledseq.h"
+#include "metrics.h"
+#include "rtcmem.h"
+#include "scheduler.h"
+
+// How long a direct connect to the cached AP may take before falling back
+// to a full scan with DHCP.
+#ifndef BOOT_FAST_CONNECT_TIMEOUT_MS
+    #define BOOT_FAST_CONNECT_TIMEOUT_MS (4000)
+#endif
+
+// How long SmartConfig waits for credentials before going back to the
+// previous network.
+#ifndef BOOT_SMARTCONFIG_TIMEOUT_MS
+    #define BOOT_SMARTCONFIG_TIMEOUT_MS (120000)
+#endif
 
 class ESP8266Boot {
 public:
@@ -19,11 +37,18 @@ public:
         SMART_CONFIG
     } State;
 
+    typedef std::function<void(State state)> StateListener;
+    typedef std::function<void(Gesture gesture)> GestureListener;
+
     ESP8266Boot() :
         _led_pin(PIN_NONE), _led_on_val(HIGH),
         _btn_pin(PIN_NONE), _btn_down_val(LOW), _btn_pin_mode(INPUT_PULLUP),
         _hostname(""), _ota_password(""),
-        _state(INIT), _led(this) {
+        _state(INIT),
+        _btn_gestures(_btn_gesture_callback, this),
+        _wifi_record(RTC_SLOT_WIFI), _fast_connecting(false), _fast_connect_at(0),
+        _cached_config(false), _dhcp_task(TASK_NONE), _dhcp_renewing(false),
+        _sc_phase(SC_IDLE), _sc_started_at(0) {
 
     };
 
@@ -54,6 +79,8 @@ public:
 
     void loop() {
         this->_btn_loop();
+        this->_smartconfig_loop();
+        this->_wifi_loop();
         ArduinoOTA.handle();
     };
 
@@ -61,8 +88,19 @@ public:
         return _state;
     };
 
-    Led *getLed() {
-        return &_led;
+    void onStateChange(StateListener listener) {
+        _state_listeners.push_back(listener);
+    };
+
+    // Button gestures; long presses already start SmartConfig and very long
+    // ones restart, the others are free for the application.
+    void onGesture(GestureListener listener) {
+        _gesture_listeners.push_back(listener);
+    };
+
+    // The LED layer for a device to show its state on.
+    Led *getLed(LedLayer layer = LED_LAYER_DEVICE) {
+        return _leds.getLed(layer);
     };
 private:
     uint8_t _led_pin;
@@ -77,58 +115,99 @@ private:
 
     State _state;
 
-    class BootLed : public Led {
-    public:
-        BootLed(ESP8266Boot *boot) : _boot(boot), _pattern(0) {
-        };
-
-        virtual void on() override {
-            _pattern = 0xFFFFFFFF;
-            if (_boot->getState() == READY) {
-                _boot->_update_led_pattern(_pattern);
-            }
-        };
-
-        virtual void off() override {
-            _pattern = 0x00000000;
-            if (_boot->getState() == READY) {
-                _boot->_update_led_pattern(_pattern);
-            }
-        };
-
-        uint32_t getPattern() {
-            return _pattern;
-        }
-
-    private:
-        ESP8266Boot *_boot;
-        uint32_t _pattern;
-    };
-
-    BootLed _led;
 private:
     void setupPins() {
         if (_led_pin != PIN_NONE) {
-            pinMode(_led_pin, OUTPUT);
-            digitalWrite(_led_pin, !_led_on_val);
-
-            _led_start();
+            _leds.begin(_led_pin, _led_on_val);
         }
 
         if (_btn_pin != PIN_NONE) {
             pinMode(_btn_pin, _btn_pin_mode);
-            _btn_hold_since = millis();
 
-            _btn_ticker.attach_ms(50, _btn_ticker_callback, this);
+            attachInterruptArg(digitalPinToInterrupt(_btn_pin), _btn_isr, this, CHANGE);
         }
     };
 
-    void _connectWiFi() {
+    // AP and IP config of the last good connection, kept in RTC memory so a
+    // reset can join the same AP directly and skip the scan and DHCP. The
+    // cached config only gets the station up: once it is, DHCP takes over
+    // in the background (see `_handBackToDhcp()`), so the lease is renewed
+    // and a new one replaces the record.
+    struct WiFiRecord {
+        uint8_t bssid[6];
+        uint8_t channel;
+        uint8_t reserved;
+        uint32_t ip;
+        uint32_t gw;
+        uint32_t mask;
+        uint32_t dns;
+    };
+
+    void _connectWiFi(bool fast = true) {
         _led_connecting();
-        _state = WIFI_CONNECTING;
-        WiFi.begin();
+        _setState(WIFI_CONNECTING);
+
+        WiFiRecord record;
+        auto ssid = WiFi.SSID();
+        _fast_connecting = fast && ssid.length() && _wifi_record.load(record);
+        _cached_config = _fast_connecting;
+
+        // Only the current config changes; the one in flash stays as it is.
+        WiFi.persistent(false);
+        if (_fast_connecting) {
+            DEBUG_LOG("[BOOT] Fast connect, channel ");
+            DEBUG_LOG_LN(record.channel);
+
+            WiFi.config(IPAddress(record.ip), IPAddress(record.gw), IPAddress(record.mask), IPAddress(record.dns));
+            WiFi.begin(ssid, WiFi.psk(), record.channel, record.bssid);
+            _fast_connect_at = millis();
+        } else {
+            WiFi.config(0u, 0u, 0u); // DHCP
+            if (ssid.length()) {
+                WiFi.begin(ssid, WiFi.psk()); // clears a BSSID/channel left from a fast connect
+            } else {
+                WiFi.begin();
+            }
+        }
+        WiFi.persistent(true);
     }
 
+    void _wifi_loop() {
+        if (_fast_connecting && _state == WIFI_CONNECTING &&
+            millis() - _fast_connect_at > BOOT_FAST_CONNECT_TIMEOUT_MS) {
+            DEBUG_LOG_LN("[BOOT] Fast connect timed out, scanning...");
+
+            _wifi_record.invalidate();
+            _connectWiFi(false);
+        }
+    };
+
+    // Starts DHCP on the live connection. The address stays until a lease
+    // is bound, which comes as another got-IP event; connections only drop
+    // if the lease differs from the cached config.
+    void _handBackToDhcp() {
+        DEBUG_LOG_LN("[BOOT] Fast connected, handing back to DHCP...");
+
+        _cached_config = false;
+        _dhcp_renewing = true;
+        WiFi.persistent(false);
+        WiFi.config(0u, 0u, 0u);
+        WiFi.persistent(true);
+    };
+
+    void _saveWiFiRecord(const WiFiEventStationModeGotIP &event) {
+        WiFiRecord record;
+        memset(&record, 0, sizeof(record));
+        memcpy(record.bssid, WiFi.BSSID(), sizeof(record.bssid));
+        record.channel = WiFi.channel();
+        record.ip = event.ip;
+        record.gw = event.gw;
+        record.mask = event.mask;
+        record.dns = WiFi.dnsIP();
+
+        _wifi_record.save(record);
+    };
+
     void setupWiFi() {
         DEBUG_LOG_LN();
 
@@ -142,12 +221,36 @@ private:
         DEBUG_LOG(WiFi.macAddress());
         DEBUG_LOG_LN("]...");
 
-        _wifi_connected_handler = WiFi.onStationModeGotIP([this](const WiFiEventStationModeGotIP &) {
+        _wifi_connected_handler = WiFi.onStationModeGotIP([this](const WiFiEventStationModeGotIP &event) {
+            if (_dhcp_renewing) {
+                DEBUG_LOG("[BOOT] DHCP lease: ");
+                DEBUG_LOG_LN(event.ip);
+
+                _dhcp_renewing = false;
+                _saveWiFiRecord(event);
+                return;
+            }
+
             DEBUG_LOG_LN("[BOOT] State -> READY");
 
-            _state = READY;
+            if (_cached_config) {
+                // from loop(), not from the SDK event
+                Scheduler::cancel(_dhcp_task);
+                _dhcp_task = Scheduler::after("dhcpHandBack", 0, [](void *arg) {
+                    auto self = static_cast<ESP8266Boot *>(arg);
+                    self->_dhcp_task = TASK_NONE;
+                    self->_handBackToDhcp();
+                }, this);
+            } else {
+                _saveWiFiRecord(event);
+            }
+            Metrics::setWiFiConnect(_fast_connecting ? "fast" : "scan");
+            Metrics::mark(BOOT_WIFI_READY);
+            _fast_connecting = false;
+
+            _setState(READY);
 
-            _led_stop();
+            _leds.clear(LED_LAYER_CONNECTIVITY);
 
             DEBUG_LOG_LN("[BOOT] WiFi connected.");
             DEBUG_LOG("[BOOT]  SSID: ");
@@ -161,10 +264,16 @@ private:
         _wifi_disconnected_handler = WiFi.onStationModeDisconnected([this](const WiFiEventStationModeDisconnected &) {
             DEBUG_LOG_LN("[BOOT] WiFi disconnected.");
 
+            // if the hand-back didn't run, the station reconnects on the
+            // cached config and the next got-IP schedules it again
+            Scheduler::cancel(_dhcp_task);
+            _dhcp_task = TASK_NONE;
+            _dhcp_renewing = false;
+
             if (_state != READY) return;
 
             DEBUG_LOG_LN("[BOOT] State -> WIFI_CONNECTING");
-            _state = WIFI_CONNECTING;
+            _setState(WIFI_CONNECTING);
 
             _led_connecting();
         });
@@ -188,101 +297,142 @@ private:
     };
 
     void _led_connecting() {
-        _update_led_pattern(0xFF00FF00); // slow flashing
+        static const LedStep steps[] = {{255, 800}, {0, 800}}; // slow flashing
+        _leds.set(LED_LAYER_CONNECTIVITY, LedPattern{steps, 2});
     };
 
     void _led_smartconfig() {
-        _update_led_pattern(0x05050505); // double flashing
+        static const LedStep steps[] = {{255, 100}, {0, 100}, {255, 100}, {0, 500}}; // double flashing
+        _leds.set(LED_LAYER_PROVISIONING, LedPattern{steps, 4});
     };
 
     void _led_reboot() {
-        _update_led_pattern(0xFFFF0000); // very slow flashing
+        static const LedStep steps[] = {{255, 1600}, {0, 1600}}; // very slow flashing
+        _leds.set(LED_LAYER_ALERT, LedPattern{steps, 2});
     };
 
-    void _led_start() {
-        if (!_led_ticker.active()) {
-            _update_led_pattern(_led.getPattern());
-            _led_ticker.attach_ms(100, _led_ticker_callback, this);
-        }
+    static void IRAM_ATTR _btn_isr(void *arg) {
+        auto self = static_cast<ESP8266Boot *>(arg);
+        self->_btn_edges.push(millis(), digitalRead(self->_btn_pin) == self->_btn_down_val);
     };
 
-    void _led_stop() {
-        _update_led_pattern(_led.getPattern());
-    };
+    // Costs a queue check per loop while the button is idle.
+    void _btn_loop() {
+        if (_btn_pin == PIN_NONE) return;
+
+        ButtonEdge edge;
+        while (_btn_edges.pop(edge)) {
+            _btn_gestures.edge(edge.down, edge.at);
+        }
 
-    static void _led_ticker_callback(ESP8266Boot *self) {
-        if (self->_led_pin != PIN_NONE) {
-            self->_led_pattern_current = (self->_led_pattern_current >> 31) | (self->_led_pattern_current << 1);
-            digitalWrite(self->_led_pin, self->_led_pattern_current & 0x01 ? self->_led_on_val : !self->_led_on_val);
+        if (_btn_gestures.busy()) {
+            _btn_gestures.poll(millis());
         }
     };
 
-    static void _btn_ticker_callback(ESP8266Boot *self) {
-        if (self->_btn_pin != PIN_NONE) {
-            auto val = digitalRead(self->_btn_pin);
-            auto now = millis();
-
-            auto duration = now - self->_btn_hold_since;
-            if (duration > 10000) { // Reset
-                self->_led_reboot();
-                if (val != self->_btn_down_val) {
-                    DEBUG_LOG_LN("[BOOT] Reset...");
-                    ESP.restart();
-                }
-            } else if (duration > 5000) { // smart config
-                self->_led_smartconfig();
-                if (val != self->_btn_down_val) {
-                    // button up
-                    self->_state = SMART_CONFIG;
-                }
-            }
-            if (val != self->_btn_down_val) {
-                self->_btn_hold_since = millis();
-            }
+    static void _btn_gesture_callback(Gesture gesture, void *arg) {
+        auto self = static_cast<ESP8266Boot *>(arg);
+
+        switch (gesture) {
+        case GESTURE_LONG_HOLD:
+            self->_led_smartconfig();
+            break;
+        case GESTURE_VERY_LONG_HOLD:
+            self->_led_reboot();
+            break;
+        case GESTURE_LONG_PRESS:
+            self->_setState(SMART_CONFIG);
+            break;
+        case GESTURE_VERY_LONG_PRESS:
+            DEBUG_LOG_LN("[BOOT] Reset...");
+            ESP.restart();
+            break;
+        default:
+            break;
+        }
+
+        for (auto it = self->_gesture_listeners.begin(); it != self->_gesture_listeners.end(); ++it) {
+            (*it)(gesture);
         }
     };
 
-    void _btn_loop() {
-        if (_btn_pin != PIN_NONE) {
-            if (_state == SMART_CONFIG) {
-                DEBUG_LOG_LN("[BOOT] Starting SmartConfig...");
+    // Stepped from loop(): starts SmartConfig once the button asked for it,
+    // then polls for credentials until BOOT_SMARTCONFIG_TIMEOUT_MS passes.
+    void _smartconfig_loop() {
+        switch (_sc_phase) {
+        case SC_IDLE:
+            if (_state != SMART_CONFIG) return;
 
-                WiFi.stopSmartConfig();
+            DEBUG_LOG_LN("[BOOT] Starting SmartConfig...");
+
+            _fast_connecting = false;
+            WiFi.stopSmartConfig();
+            WiFi.mode(WIFI_STA);
+            WiFi.beginSmartConfig();
 
-                WiFi.mode(WIFI_STA);
-                WiFi.beginSmartConfig();
-                while (1) {
-                    if (WiFi.smartConfigDone()) {
-                        DEBUG_LOG_LN("[BOOT] Done");
-                        DEBUG_LOG   ("  SSID:"); DEBUG_LOG_LN(WiFi.SSID());
+            _led_smartconfig();
+            _sc_started_at = millis();
+            _sc_phase = SC_WAITING;
+            break;
 
-                        WiFi.setAutoConnect(true);
+        case SC_WAITING:
+            if (WiFi.smartConfigDone()) {
+                DEBUG_LOG_LN("[BOOT] Done");
+                DEBUG_LOG   ("  SSID:"); DEBUG_LOG_LN(WiFi.SSID());
 
-                        _connectWiFi();
+                _sc_phase = SC_IDLE;
+                _leds.clear(LED_LAYER_PROVISIONING);
 
-                        break;
-                    }
+                WiFi.setAutoConnect(true);
 
-                    delay(100);
-                }
+                _wifi_record.invalidate();
+                _connectWiFi(false);
+            } else if (millis() - _sc_started_at > BOOT_SMARTCONFIG_TIMEOUT_MS) {
+                DEBUG_LOG_LN("[BOOT] SmartConfig timed out, back to the previous network.");
+
+                _sc_phase = SC_IDLE;
+                _leds.clear(LED_LAYER_PROVISIONING);
+
+                WiFi.stopSmartConfig();
+                _connectWiFi();
             }
+            break;
         }
     };
 
-    void _update_led_pattern(uint32_t pattern) {
-        if (_led_pattern != pattern) {
-            _led_pattern_current = _led_pattern = pattern;
+    void _setState(State state) {
+        if (_state == state) return;
+        _state = state;
+
+        for (auto it = _state_listeners.begin(); it != _state_listeners.end(); ++it) {
+            (*it)(state);
         }
     };
 
 private:
-    uint32_t _led_pattern;
-    uint32_t _led_pattern_current;
-    Ticker _led_ticker;
+    LedSequencer _leds;
+
+    ButtonEdgeQueue _btn_edges;
+    GestureRecognizer _btn_gestures;
+
+    RtcRecord<WiFiRecord> _wifi_record;
+    bool _fast_connecting;
+    unsigned long _fast_connect_at;
+    bool _cached_config; // the station runs on the record's static config
+    TaskId _dhcp_task;
+    bool _dhcp_renewing; // DHCP started on a fast connection, lease not bound yet
 
-    unsigned long _btn_hold_since;
-    Ticker _btn_ticker;
+    typedef enum {
+        SC_IDLE = 0,
+        SC_WAITING
+    } SmartConfigPhase;
+
+    SmartConfigPhase _sc_phase;
+    unsigned long _sc_started_at;
 
     WiFiEventHandler _wifi_connected_handler;
     WiFiEventHandler _wifi_disconnected_handler;
+
+    std::vector<StateListener> _state_listeners;
+    std::vector<GestureListener> _gesture_listeners;
 };
@@ -3,26 +3,67 @@
 #include <Arduino.h>
 #include <AsyncMqttClient.h>
 #include <ESP8266WiFi.h>
-#include <Ticker.h>
-#include <map>
-#include <list>
 #include <functional>
+#include <vector>
+#include <lwip/dns.h>
 #include "DebugLog.h"
+#include "heapprof.h"
+#include "metrics.h"
+#include "scheduler.h"
+#include "outbox.h"
+#include "reconnect.h"
+#include "router.h"
+#include "strview.h"
+
+#ifndef BEMFA_MAX_PAYLOAD
+    #define BEMFA_MAX_PAYLOAD (256)
+#endif
+
+#ifndef BEMFA_DNS_TTL_MS
+    #define BEMFA_DNS_TTL_MS (3600000UL)
+#endif
+
+#ifndef BEMFA_DNS_TIMEOUT_MS
+    #define BEMFA_DNS_TIMEOUT_MS (5000)
+#endif
+
+// a cached broker address is re-resolved after this many failed attempts
+#ifndef BEMFA_DNS_RETRY_ATTEMPTS
+    #define BEMFA_DNS_RETRY_ATTEMPTS (3)
+#endif
 
 class BemfaMqtt {
 public:
-    typedef std::function<void(const String& topic, const String& msg, AsyncMqttClient &mqttClient)> MessageListener;
+    typedef std::function<void(const StrView& topic, const StrView& msg, AsyncMqttClient &mqttClient)> MessageListener;
+    typedef std::function<void(bool connected)> ConnectionListener;
+    typedef std::function<void(const StrView& topic, const StrView& msg)> StateListener;
 
     BemfaMqtt(const String& host, int port, const String& client_id)
-        : _host(host), _port(port), _client_id(client_id) {
+        : _host(host), _port(port), _client_id(client_id), _outbox(_mqtt_client), _frag_len(0),
+          _policy(250, 2000, 120000), _reconnect_task(TASK_NONE),
+          _broker_ip_valid(false), _broker_resolved_at(0),
+          _dns_pending(false), _dns_started_at(0), _dns_timeout_task(TASK_NONE),
+          _connect_started_at(0), _connack_at(0), _subs_pending(0), _subs_held(false) {
+        memset(&_timing, 0, sizeof(_timing));
     };
 
+    // Listeners must be registered before `begin()`, which freezes the routing table.
     void onMessage(const String& topic, MessageListener listener) {
-        _mlsm[topic].push_back(listener);
+        _router.add(topic.c_str(), listener);
+    };
+
+    void onConnectionChange(ConnectionListener listener) {
+        _connection_listeners.push_back(listener);
+    };
+
+    // Called for every device state published with `publishState()`.
+    void onStateChange(StateListener listener) {
+        _state_listeners.push_back(listener);
     };
 
     void begin() {
-        _mqtt_client.setServer(_host.c_str(), _port);
+        _router.freeze();
+
         _mqtt_client.setClientId(_client_id.c_str());
 
         // Mqtt connection events
@@ -31,29 +72,38 @@ public:
             DEBUG_LOG("[MQTT] Session present: ");
             DEBUG_LOG_LN(sessionPresent);
 
-            for (auto it = _mlsm.begin(); it != _mlsm.end(); ++it) {
-#ifdef ENABLE_DEBUG_LOG
-                uint16_t packetIdSub =
-#endif // ENABLE_DEBUG_LOG
-                    _mqtt_client.subscribe(it->first.c_str(), 1);
+            _connack_at = millis();
+            _timing.connack = _connack_at - _connect_started_at;
+            _subs_pending = _router.size();
+            _policy.reset();
 
-                DEBUG_LOG("[MQTT] Subscribing <");
-                DEBUG_LOG(it->first);
-                DEBUG_LOG("> at QoS 2, packetId: ");
-                DEBUG_LOG_LN(packetIdSub);
+            // Replay states published while disconnected, and those restored
+            // at boot, all of them before subscribing: the broker handles
+            // our packets in order, so the retained value it then delivers
+            // is already ours. If the client can't take them all at once,
+            // loop() subscribes once the rest is sent.
+            _outbox.flush(OUTBOX_SIZE);
+            _subs_held = !_outbox.drained();
+            if (!_subs_held) {
+                _subscribe();
             }
+
+            _notifyConnection(true);
         });
 
         _mqtt_client.onDisconnect([this](AsyncMqttClientDisconnectReason reason) {
             DEBUG_LOG_LN("[MQTT] Disconnected from MQTT.");
 
-            if (WiFi.isConnected()) {
-                DEBUG_LOG_LN("[MQTT] Reconnect after 2 seconds...");
-                _reconnect_ticker.once(2, [this]() {
-                    DEBUG_LOG_LN("[MQTT] Reconnecting...");
+            _outbox.onDisconnect();
+
+            _notifyConnection(false);
+
+            if (_policy.getAttempt() == 0) {
+                _timing.attempts = 0; // was connected, start counting anew
+            }
 
-                    _connect();
-                });
+            if (WiFi.isConnected()) {
+                _scheduleReconnect(_policy.nextDelay());
             }
         });
 
@@ -62,6 +112,11 @@ public:
             DEBUG_LOG_LN("[MQTT] Subscribe acknowledged:");
             DEBUG_LOG   ("         packetId: "); DEBUG_LOG_LN(packetId);
             DEBUG_LOG   ("              qos: "); DEBUG_LOG_LN(qos);
+
+            if (_subs_pending && --_subs_pending == 0) {
+                _timing.suback = millis() - _connack_at;
+                Metrics::mark(BOOT_MQTT_SUBSCRIBED);
+            }
         });
 
         _mqtt_client.onUnsubscribe([this](uint16_t packetId) {
@@ -73,14 +128,11 @@ public:
         _mqtt_client.onPublish([this](uint16_t packetId) {
             DEBUG_LOG_LN("[MQTT] Publish acknowledged:");
             DEBUG_LOG   ("         packetId: "); DEBUG_LOG_LN(packetId);
+
+            _outbox.onAck(packetId);
         });
 
         _mqtt_client.onMessage([this](char* topic, char* payload, AsyncMqttClientMessageProperties properties, size_t len, size_t index, size_t total) {
-            auto msg = String("");
-            for (size_t i = 0; i < len; i ++) {
-                msg += payload[i];
-            }
-
             DEBUG_LOG_LN("[MQTT] Message received:");
             DEBUG_LOG   ("          topic: "); DEBUG_LOG_LN(topic);
             DEBUG_LOG   ("            qos: "); DEBUG_LOG_LN(properties.qos);
@@ -89,13 +141,35 @@ public:
             DEBUG_LOG   ("            len: "); DEBUG_LOG_LN(len);
             DEBUG_LOG   ("          index: "); DEBUG_LOG_LN(index);
             DEBUG_LOG   ("          total: "); DEBUG_LOG_LN(total);
-            DEBUG_LOG   ("        payload: "); DEBUG_LOG_LN(msg);
 
-            if (_mlsm.count(topic) == 1) {
-                auto lst = _mlsm.at(topic);
-                for (auto it = lst.begin(); it != lst.end(); ++it) {
-                    (*it)(topic, msg, _mqtt_client);
-                }
+            if (index == 0 && len == total) {
+                // common case: whole payload in one piece, no copy
+                _dispatch(StrView(topic), StrView(payload, len));
+                return;
+            }
+
+            // fragmented payload, reassemble
+            if (total > sizeof(_frag_buf)) {
+                DEBUG_LOG_LN("[MQTT] Payload too large, dropped.");
+                return;
+            }
+
+            if (index == 0) {
+                _frag_len = 0;
+            }
+
+            if (index != _frag_len || index + len > total) {
+                DEBUG_LOG_LN("[MQTT] Unexpected fragment, dropped.");
+                _frag_len = 0;
+                return;
+            }
+
+            memcpy(_frag_buf + index, payload, len);
+            _frag_len += len;
+
+            if (_frag_len == total) {
+                _frag_len = 0;
+                _dispatch(StrView(topic), StrView(_frag_buf, total));
             }
         });
 
@@ -103,30 +177,199 @@ public:
         _got_ip_handler = WiFi.onStationModeGotIP([this](const WiFiEventStationModeGotIP &) {
             DEBUG_LOG_LN("[MQTT] Connected to WiFi.");
 
-            _connect();
+            _policy.reset();
+            _scheduleReconnect(0); // connect from loop(), not from the SDK event
         });
 
         _disconnected_handler = WiFi.onStationModeDisconnected([this](const WiFiEventStationModeDisconnected &) {
             DEBUG_LOG_LN("[MQTT] Disconnected from WiFi.");
 
-            _reconnect_ticker.detach(); // ensure we don't reconnect to MQTT while reconnecting to Wi-Fi
+            Scheduler::cancel(_reconnect_task); // ensure we don't reconnect to MQTT while reconnecting to Wi-Fi
+            _abandonLookup();
         });
     };
 
     void loop() {
+        _outbox.flush();
+
+        if (_subs_held && _mqtt_client.connected() && _outbox.drained()) {
+            _subs_held = false;
+            _subscribe();
+        }
+    };
+
+    // Runs the listeners of `topic` as if `msg` was received from the broker.
+    bool dispatch(const StrView &topic, const StrView &msg) {
+        DEBUG_LOG("[MQTT] Local message: "); DEBUG_LOG_LN(topic);
+
+        return _dispatch(topic, msg);
+    };
+
+    // Publishes the new state of a device as the retained value of its topic,
+    // through the outbox: it is kept until acknowledged, replayed after a
+    // reconnect, and superseded by a newer state of the same topic.
+    void publishState(const StrView &topic, const StrView &msg) {
+        _outbox.put(topic, msg);
+        _outbox.flush();
+
+        for (auto it = _state_listeners.begin(); it != _state_listeners.end(); ++it) {
+            (*it)(topic, msg);
+        }
     };
 
     AsyncMqttClient &getMqttClient() {
         return _mqtt_client;
     };
+
+    const MqttOutbox &getOutbox() const {
+        return _outbox;
+    };
+
+    const ConnectTiming &getConnectTiming() const {
+        return _timing;
+    };
 private:
+    bool _dispatch(const StrView &topic, const StrView &msg) {
+        MetricScope scope(METRIC_MQTT_DISPATCH);
+        HeapTagScope heapTag(HEAP_TAG_MQTT);
+
+        DEBUG_LOG   ("        payload: "); DEBUG_LOG_LN(msg);
+
+        auto route = _router.find(topic.data(), topic.length());
+        if (!route) return false;
+
+        auto topicView = _router.topic(*route);
+        auto listeners = _router.listeners(*route);
+        for (uint16_t i = 0; i < route->count; i++) {
+            listeners[i](topicView, msg, _mqtt_client);
+        }
+        return true;
+    };
+
+    void _notifyConnection(bool connected) {
+        for (auto it = _connection_listeners.begin(); it != _connection_listeners.end(); ++it) {
+            (*it)(connected);
+        }
+    };
+
+    void _scheduleReconnect(uint32_t delay) {
+        DEBUG_LOG("[MQTT] Reconnect after "); DEBUG_LOG(delay); DEBUG_LOG_LN("ms...");
+
+        Scheduler::cancel(_reconnect_task);
+        _reconnect_task = Scheduler::after("mqttReconnect", delay, [](void *arg) {
+            static_cast<BemfaMqtt *>(arg)->_connect();
+        }, this);
+    };
+
+    // Connects to the cached broker address within its TTL. Otherwise asks
+    // lwIP, which answers at once from its own cache or later through
+    // `_dnsFound()`; loop() never waits for DNS. A failed or timed out lookup
+    // falls back to a stale address when there is one.
     void _connect() {
+        _timing.attempts++;
+
+        bool fresh = _broker_ip_valid && millis() - _broker_resolved_at < BEMFA_DNS_TTL_MS;
+        if (fresh && _policy.getAttempt() < BEMFA_DNS_RETRY_ATTEMPTS) {
+            _timing.dns = 0;
+            _timing.dns_cached = true;
+            _connectTo(_broker_ip);
+            return;
+        }
+
+        if (_dns_pending) return; // the lookup in flight connects
+
+        _dns_started_at = millis();
+
+        ip_addr_t addr;
+        auto err = dns_gethostbyname(_host.c_str(), &addr, _dnsFound, this);
+        if (err == ERR_OK) {
+            _onResolved(&addr);
+        } else if (err == ERR_INPROGRESS) {
+            _dns_pending = true;
+            _dns_timeout_task = Scheduler::after("mqttDns", BEMFA_DNS_TIMEOUT_MS, [](void *arg) {
+                auto self = static_cast<BemfaMqtt *>(arg);
+                self->_dns_timeout_task = TASK_NONE;
+                self->_dns_pending = false;
+                self->_onResolved(nullptr);
+            }, this);
+        } else {
+            _onResolved(nullptr);
+        }
+    };
+
+    // lwIP's answer, null on failure. One that comes after the timeout, or
+    // after WiFi dropped, only refreshes the cache.
+    static void _dnsFound(const char *, const ip_addr_t *addr, void *arg) {
+        auto self = static_cast<BemfaMqtt *>(arg);
+        if (!self->_dns_pending) {
+            if (addr) self->_cacheBroker(IPAddress(addr));
+            return;
+        }
+
+        self->_dns_pending = false;
+        Scheduler::cancel(self->_dns_timeout_task);
+        self->_dns_timeout_task = TASK_NONE;
+        self->_onResolved(addr);
+    };
+
+    void _onResolved(const ip_addr_t *addr) {
+        _timing.dns = millis() - _dns_started_at;
+        _timing.dns_cached = false;
+
+        if (addr) {
+            _cacheBroker(IPAddress(addr));
+        } else {
+            DEBUG_LOG_LN("[MQTT] DNS lookup failed.");
+        }
+
+        if (!WiFi.isConnected()) return;
+
+        if (_broker_ip_valid) {
+            _timing.dns_cached = !addr; // the stale address
+            _connectTo(_broker_ip);
+        } else {
+            _scheduleReconnect(_policy.nextDelay());
+        }
+    };
+
+    void _subscribe() {
+        for (size_t i = 0; i < _router.size(); i++) {
+            auto topic = _router.topic(_router.route(i));
+#ifdef ENABLE_DEBUG_LOG
+            uint16_t packetIdSub =
+#endif // ENABLE_DEBUG_LOG
+                _mqtt_client.subscribe(topic.data(), 1);
+
+            DEBUG_LOG("[MQTT] Subscribing <");
+            DEBUG_LOG(topic);
+            DEBUG_LOG("> at QoS 2, packetId: ");
+            DEBUG_LOG_LN(packetIdSub);
+        }
+    };
+
+    void _cacheBroker(const IPAddress &ip) {
+        _broker_ip = ip;
+        _broker_ip_valid = true;
+        _broker_resolved_at = millis();
+    };
+
+    void _abandonLookup() {
+        _dns_pending = false;
+        Scheduler::cancel(_dns_timeout_task);
+        _dns_timeout_task = TASK_NONE;
+    };
+
+    void _connectTo(const IPAddress &ip) {
         DEBUG_LOG("[MQTT] Connecting to MQTT server: ");
         DEBUG_LOG(_host);
-        DEBUG_LOG(":");
+        DEBUG_LOG(" (");
+        DEBUG_LOG(ip);
+        DEBUG_LOG("):");
         DEBUG_LOG(_port);
         DEBUG_LOG_LN();
 
+        _mqtt_client.setServer(ip, _port);
+        _connect_started_at = millis();
         _mqtt_client.connect();
     };
 
@@ -135,14 +378,32 @@ private:
     int _port;
     String _client_id;
 
-    typedef std::list<MessageListener> MessageListenerList;
-    typedef std::map<String, MessageListenerList> MessageListenersMap;
-
-    MessageListenersMap _mlsm;
+    TopicRouter<MessageListener> _router;
+    std::vector<ConnectionListener> _connection_listeners;
+    std::vector<StateListener> _state_listeners;
     AsyncMqttClient _mqtt_client;
+    MqttOutbox _outbox;
+
+    char _frag_buf[BEMFA_MAX_PAYLOAD];
+    size_t _frag_len;
 
     WiFiEventHandler _got_ip_handler;
     WiFiEventHandler _disconnected_handler;
 
-    Ticker _reconnect_ticker;
+    ReconnectPolicy _policy;
+    TaskId _reconnect_task;
+
+    IPAddress _broker_ip;
+    bool _broker_ip_valid;
+    unsigned long _broker_resolved_at;
+
+    bool _dns_pending;
+    unsigned long _dns_started_at;
+    TaskId _dns_timeout_task;
+
+    ConnectTiming _timing;
+    unsigned long _connect_started_at;
+    unsigned long _connack_at;
+    size_t _subs_pending;
+    bool _subs_held; // until the outbox is drained
 };
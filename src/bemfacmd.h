@@ -0,0 +1,108 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "strview.h"
+
+#ifndef BEMFA_CMD_MAX_ARGS
+    #define BEMFA_CMD_MAX_ARGS (4)
+#endif
+
+// Argument positions by device type, after the command name.
+#define BEMFA_LIGHT_BRIGHTNESS (0) // 1-100
+#define BEMFA_LIGHT_COLOUR (1)     // decimal 0xRRGGBB, or colour temperature in K
+#define BEMFA_AC_MODE (0)
+#define BEMFA_AC_TEMPERATURE (1)
+#define BEMFA_FAN_SPEED (0)
+#define BEMFA_FAN_SWING (1)
+
+// One Bemfa message, `name[#arg]...`, e.g. "on", "off", "on#80" or
+// "on#80#16711680". Parsed in one pass without copying: `name` points
+// into the payload, so it is only valid as long as the message. Arguments
+// are decimal integers, with a leading '-' if negative; an empty one like
+// in "on##2700" is absent, not 0.
+//
+// Anything else is rejected as a whole: an empty name, a name with other
+// characters than letters, digits, '_' or '-', other non-digits in an
+// argument, more than BEMFA_CMD_MAX_ARGS arguments or a value beyond 32 bits.
+struct BemfaCommand {
+    typedef enum {
+        OTHER = 0,
+        ON,
+        OFF
+    } Verb;
+
+    Verb verb;
+    StrView name;
+    uint8_t argc; // including absent ones
+    uint8_t present; // bit per argument
+    int32_t args[BEMFA_CMD_MAX_ARGS];
+
+    bool has(uint8_t i) const {
+        return i < argc && (present & (1 << i));
+    };
+
+    int32_t arg(uint8_t i, int32_t fallback) const {
+        return has(i) ? args[i] : fallback;
+    };
+
+    bool parse(const StrView &payload) {
+        auto p = payload.data();
+        auto end = p + payload.length();
+
+        verb = OTHER;
+        argc = 0;
+        present = 0;
+
+        auto start = p;
+        while (p < end && *p != '#') {
+            char c = *p;
+            if (!isalnum((unsigned char)c) && c != '_' && c != '-') return _fail();
+            p++;
+        }
+        if (p == start) return _fail();
+        name = StrView(start, p - start);
+
+        if (name == "on") {
+            verb = ON;
+        } else if (name == "off") {
+            verb = OFF;
+        }
+
+        while (p < end) {
+            p++; // '#'
+            if (argc >= BEMFA_CMD_MAX_ARGS) return _fail();
+
+            bool negative = p < end && *p == '-';
+            if (negative) p++;
+
+            int64_t value = 0;
+            auto digits = p;
+            while (p < end && *p != '#') {
+                if (*p < '0' || *p > '9') return _fail();
+                value = value * 10 + (*p - '0');
+                if (value > INT32_MAX) return _fail();
+                p++;
+            }
+
+            if (p > digits) {
+                args[argc] = negative ? -value : value;
+                present |= 1 << argc;
+            } else if (negative) {
+                return _fail(); // a lone '-'
+            }
+            argc++;
+        }
+
+        return true;
+    };
+
+private:
+    bool _fail() {
+        verb = OTHER;
+        name = StrView();
+        argc = 0;
+        present = 0;
+        return false;
+    };
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Print into a fixed buffer; output beyond its size is dropped and flagged.
+class BufPrint : public Print {
+public:
+    BufPrint(char *buf, size_t size) : _buf(buf), _size(size), _len(0), _overflow(false) {
+    };
+
+    virtual size_t write(uint8_t c) override {
+        if (_len >= _size) {
+            _overflow = true;
+            return 0;
+        }
+        _buf[_len++] = c;
+        return 1;
+    };
+
+    virtual size_t write(const uint8_t *data, size_t len) override {
+        auto n = _size - _len < len ? _size - _len : len;
+        if (n < len) _overflow = true;
+        memcpy(_buf + _len, data, n);
+        _len += n;
+        return n;
+    };
+
+    size_t length() const {
+        return _len;
+    };
+
+    bool overflow() const {
+        return _overflow;
+    };
+
+private:
+    char *_buf;
+    size_t _size;
+    size_t _len;
+    bool _overflow;
+};
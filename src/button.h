@@ -0,0 +1,176 @@
+#pragma once
+
+#include <Arduino.h>
+
+#ifndef BUTTON_EDGE_QUEUE_LEN
+    #define BUTTON_EDGE_QUEUE_LEN (16)
+#endif
+
+typedef enum {
+    GESTURE_CLICK = 0,
+    GESTURE_DOUBLE_CLICK,
+    GESTURE_LONG_HOLD,       // still down, held past the long press time
+    GESTURE_VERY_LONG_HOLD,
+    GESTURE_LONG_PRESS,      // released after a long hold
+    GESTURE_VERY_LONG_PRESS
+} Gesture;
+
+struct ButtonEdge {
+    uint32_t at; // millis
+    bool down;
+};
+
+// Raw edges from the pin interrupt to loop(); single producer, single
+// consumer, so neither side needs to mask interrupts. Edges arriving while
+// it is full are lost; the recognizer resyncs on the next one.
+class ButtonEdgeQueue {
+public:
+    ButtonEdgeQueue() : _head(0), _tail(0), _overflows(0) {
+    };
+
+    bool IRAM_ATTR push(uint32_t at, bool down) {
+        uint8_t next = (_head + 1) % BUTTON_EDGE_QUEUE_LEN;
+        if (next == _tail) {
+            _overflows++;
+            return false;
+        }
+
+        _edges[_head].at = at;
+        _edges[_head].down = down;
+        _head = next;
+        return true;
+    };
+
+    bool pop(ButtonEdge &edge) {
+        if (_tail == _head) return false;
+
+        edge.at = _edges[_tail].at;
+        edge.down = _edges[_tail].down;
+        _tail = (_tail + 1) % BUTTON_EDGE_QUEUE_LEN;
+        return true;
+    };
+
+    bool empty() const {
+        return _tail == _head;
+    };
+
+    uint32_t getOverflows() const {
+        return _overflows;
+    };
+
+private:
+    volatile ButtonEdge _edges[BUTTON_EDGE_QUEUE_LEN];
+    volatile uint8_t _head;
+    volatile uint8_t _tail;
+    volatile uint32_t _overflows;
+};
+
+// Turns raw edges into gestures. A level counts once it has been stable for
+// `debounce_ms`; a click is reported after `double_ms` without a second one.
+// Only needs poll() while busy(), i.e. not while the button is idle. Edges
+// carry their own time, so a loop() that stalls and hands over several at
+// once still gets the same gestures, only later.
+class GestureRecognizer {
+public:
+    typedef void (*GestureCallback)(Gesture gesture, void *arg);
+
+    GestureRecognizer(GestureCallback callback, void *arg,
+                      uint16_t debounce_ms = 30, uint16_t double_ms = 350,
+                      uint32_t long_ms = 5000, uint32_t very_long_ms = 10000)
+        : _callback(callback), _arg(arg),
+          _debounce_ms(debounce_ms), _double_ms(double_ms),
+          _long_ms(long_ms), _very_long_ms(very_long_ms),
+          _raw(false), _raw_at(0), _down(false), _down_at(0),
+          _held(0), _clicks(0), _released_at(0) {
+    };
+
+    void edge(bool down, uint32_t at) {
+        if (down == _raw) return;
+
+        _settle(at); // the level before may have been stable, unpolled
+        _raw = down;
+        _raw_at = at;
+    };
+
+    void poll(uint32_t now) {
+        _settle(now);
+
+        if (_down) {
+            // up to a release that is still being debounced
+            auto held = (_raw ? now : _raw_at) - _down_at;
+            if (held >= _very_long_ms && _held < 2) {
+                _held = 2;
+                _callback(GESTURE_VERY_LONG_HOLD, _arg);
+            } else if (held >= _long_ms && _held < 1) {
+                _held = 1;
+                _callback(GESTURE_LONG_HOLD, _arg);
+            }
+        } else if (_clicks && now - _released_at >= _double_ms) {
+            _clicks = 0;
+            _callback(GESTURE_CLICK, _arg);
+        }
+    };
+
+    bool busy() const {
+        return _raw != _down || _down || _clicks;
+    };
+
+    bool isDown() const {
+        return _down;
+    };
+
+private:
+    GestureCallback _callback;
+    void *_arg;
+
+    uint16_t _debounce_ms;
+    uint16_t _double_ms;
+    uint32_t _long_ms;
+    uint32_t _very_long_ms;
+
+    bool _raw;
+    uint32_t _raw_at;
+    bool _down;
+    uint32_t _down_at;
+    uint8_t _held; // 1: long hold reported, 2: very long hold reported
+    uint8_t _clicks;
+    uint32_t _released_at;
+
+    void _settle(uint32_t now) {
+        if (_raw == _down || now - _raw_at < _debounce_ms) return;
+
+        _down = _raw;
+        if (_down) {
+            _pressed(_raw_at);
+        } else {
+            _released(_raw_at);
+        }
+    };
+
+    void _pressed(uint32_t at) {
+        // a click whose double-click time ran out unpolled
+        if (_clicks && at - _released_at >= _double_ms) {
+            _clicks = 0;
+            _callback(GESTURE_CLICK, _arg);
+        }
+
+        _down_at = at;
+        _held = 0;
+    };
+
+    void _released(uint32_t at) {
+        auto held = at - _down_at;
+        if (held >= _very_long_ms) {
+            _clicks = 0;
+            _callback(GESTURE_VERY_LONG_PRESS, _arg);
+        } else if (held >= _long_ms) {
+            _clicks = 0;
+            _callback(GESTURE_LONG_PRESS, _arg);
+        } else if (++_clicks == 2) {
+            _clicks = 0;
+            _callback(GESTURE_DOUBLE_CLICK, _arg);
+        } else {
+            _released_at = at;
+        }
+    };
+};
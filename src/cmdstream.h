@@ -0,0 +1,347 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "strview.h"
+
+#ifndef CMD_STREAM_MAX_DEPTH
+    #define CMD_STREAM_MAX_DEPTH (8)
+#endif
+
+// Incremental parser for batches of device commands, fed with body chunks
+// as they arrive. Every JSON object with string fields "topic" and "msg" is
+// one command, e.g. `{"commands":[{"topic":"...x002","msg":"on"}, ...]}`,
+// and is handed to the callback as soon as the object is closed. The whole
+// JSON grammar is checked, except that numbers are only checked for their
+// characters; a body may fail after some commands were handed out, so
+// callers that must not act on a bad body validate it first, with a null
+// callback. Keeps no heap state, so it can live in a request's malloc'ed
+// temp object.
+class CommandStreamParser {
+public:
+    typedef void (*CommandCallback)(const StrView &topic, const StrView &msg, void *arg);
+
+    CommandStreamParser(CommandCallback callback, void *arg)
+        : _callback(callback), _arg(arg),
+          _depth(0), _objects(0), _state(VALUE), _expect(X_VALUE),
+          _word(0), _word_len(0),
+          _target(T_NONE), _len(0), _overflow(false),
+          _topic_len(0), _msg_len(0), _owner(0),
+          _error(false), _commands(0), _rejected(0) {
+        _key[0] = 0;
+    };
+
+    void feed(const uint8_t *data, size_t len) {
+        for (size_t i = 0; i < len && !_error; i++) {
+            _feed(data[i]);
+        }
+    };
+
+    // The body must be one complete JSON value.
+    bool finish() {
+        if (!_error && _state == LITERAL) _endLiteral();
+        if (_state != VALUE || _expect != X_DONE) {
+            _error = true;
+        }
+        return !_error;
+    };
+
+    bool hasError() const {
+        return _error;
+    };
+
+    uint16_t getCommands() const {
+        return _commands;
+    };
+
+    // commands with a topic or message too long for the buffers, or whose
+    // fields were overwritten by a command nested in them
+    uint16_t getRejected() const {
+        return _rejected;
+    };
+
+private:
+    typedef enum {
+        VALUE = 0, // between tokens
+        STRING,
+        ESCAPE,
+        LITERAL    // number, true, false, null
+    } State;
+
+    // the next token allowed by the grammar
+    typedef enum {
+        X_VALUE = 0,    // top level, after ':', after ',' in an array
+        X_VALUE_OR_END, // after '['
+        X_KEY,          // after ',' in an object
+        X_KEY_OR_END,   // after '{'
+        X_COLON,        // after a key
+        X_NEXT,         // after a value in a container: ',' or the closing bracket
+        X_DONE          // after the top-level value
+    } Expect;
+
+    typedef enum {
+        T_NONE = 0,
+        T_KEY,
+        T_TOPIC,
+        T_MSG
+    } Target;
+
+    enum {
+        HAS_TOPIC = 1,
+        HAS_MSG = 2,
+        REJECTED = 4
+    };
+
+    CommandCallback _callback;
+    void *_arg;
+
+    uint8_t _depth;
+    uint8_t _objects; // bit n set: container at depth n is an object
+    State _state;
+    Expect _expect;
+
+    const char *_word; // true, false or null, being matched; null for a number
+    uint8_t _word_len;
+
+    Target _target;
+    uint8_t _len;
+    bool _overflow;
+
+    char _key[8];
+    char _topic[64];
+    uint8_t _topic_len;
+    char _msg[32];
+    uint8_t _msg_len;
+    uint8_t _has[CMD_STREAM_MAX_DEPTH]; // per open object
+    uint8_t _owner; // depth of the object whose fields are in the buffers, 0 if none
+
+    bool _error;
+    uint16_t _commands;
+    uint16_t _rejected;
+
+    void _feed(char c) {
+        switch (_state) {
+        case STRING:
+            if (c == '\\') {
+                _state = ESCAPE;
+            } else if (c == '"') {
+                _endString();
+            } else {
+                _append(c);
+            }
+            return;
+
+        case ESCAPE:
+            _state = STRING;
+            switch (c) {
+            case 'n': _append('\n'); break;
+            case 't': _append('\t'); break;
+            case 'r': _append('\r'); break;
+            case 'u': _error = true; break; // not needed for topics/commands
+            default: _append(c); break;
+            }
+            return;
+
+        case LITERAL:
+            if (_literal(c)) return;
+            _endLiteral();
+            if (_error) return;
+            break;
+
+        case VALUE:
+            break;
+        }
+
+        switch (c) {
+        case ' ': case '\t': case '\r': case '\n':
+            break;
+        case '{':
+        case '[':
+            if (!_expectsValue() || _depth >= CMD_STREAM_MAX_DEPTH) {
+                _error = true;
+                return;
+            }
+            if (c == '{') {
+                _objects |= 1 << _depth;
+                _has[_depth] = 0;
+            } else {
+                _objects &= ~(1 << _depth);
+            }
+            _depth++;
+            _expect = c == '{' ? X_KEY_OR_END : X_VALUE_OR_END;
+            break;
+        case '}':
+        case ']':
+            if (_depth == 0 || _inObject() != (c == '}') ||
+                !(_expect == X_NEXT || _expect == (c == '}' ? X_KEY_OR_END : X_VALUE_OR_END))) {
+                _error = true;
+                return;
+            }
+            if (c == '}') _endObject();
+            _depth--;
+            _endValue();
+            break;
+        case ':':
+            if (_expect != X_COLON) {
+                _error = true;
+                return;
+            }
+            _expect = X_VALUE;
+            break;
+        case ',':
+            if (_expect != X_NEXT) {
+                _error = true;
+                return;
+            }
+            _expect = _inObject() ? X_KEY : X_VALUE;
+            break;
+        case '"':
+            if (!_expectsValue() && _expect != X_KEY && _expect != X_KEY_OR_END) {
+                _error = true;
+                return;
+            }
+            _beginString();
+            break;
+        default:
+            if (!_expectsValue()) {
+                _error = true;
+                return;
+            }
+            _beginLiteral(c);
+            break;
+        }
+    };
+
+    bool _inObject() const {
+        return _depth && (_objects & (1 << (_depth - 1)));
+    };
+
+    bool _expectsValue() const {
+        return _expect == X_VALUE || _expect == X_VALUE_OR_END;
+    };
+
+    void _endValue() {
+        _expect = _depth ? X_NEXT : X_DONE;
+    };
+
+    void _beginLiteral(char c) {
+        switch (c) {
+        case 't': _word = "true"; break;
+        case 'f': _word = "false"; break;
+        case 'n': _word = "null"; break;
+        default:
+            if (c != '-' && !isdigit((unsigned char)c)) {
+                _error = true;
+                return;
+            }
+            _word = 0;
+            break;
+        }
+
+        _state = LITERAL;
+        _word_len = 1;
+    };
+
+    // true if `c` continues the literal
+    bool _literal(char c) {
+        if (_word) {
+            if (!_word[_word_len] || c != _word[_word_len]) return false;
+            _word_len++;
+            return true;
+        }
+        return isdigit((unsigned char)c) || c == '.' || c == 'e' || c == 'E' || c == '-' || c == '+';
+    };
+
+    void _endLiteral() {
+        _state = VALUE;
+        if (_word && _word[_word_len]) {
+            _error = true;
+            return;
+        }
+        _endValue();
+    };
+
+    void _beginString() {
+        _state = STRING;
+        _len = 0;
+        _overflow = false;
+
+        if (!_expectsValue()) {
+            _target = T_KEY;
+        } else if (_inObject() && strcmp(_key, "topic") == 0) {
+            _target = T_TOPIC;
+        } else if (_inObject() && strcmp(_key, "msg") == 0) {
+            _target = T_MSG;
+        } else {
+            _target = T_NONE;
+        }
+    };
+
+    void _append(char c) {
+        char *buf;
+        size_t size;
+        switch (_target) {
+        case T_KEY: buf = _key; size = sizeof(_key); break;
+        case T_TOPIC: buf = _topic; size = sizeof(_topic); break;
+        case T_MSG: buf = _msg; size = sizeof(_msg); break;
+        default: return;
+        }
+
+        if ((size_t)_len + 1 >= size) {
+            _overflow = true;
+            return;
+        }
+        buf[_len++] = c;
+    };
+
+    void _endString() {
+        _state = VALUE;
+
+        switch (_target) {
+        case T_KEY:
+            // unknown or too long keys never match
+            _key[_overflow ? 0 : _len] = 0;
+            _expect = X_COLON;
+            _target = T_NONE;
+            return;
+        case T_TOPIC:
+            _claim();
+            _topic[_len] = 0;
+            _topic_len = _len;
+            _has[_depth - 1] |= _overflow ? REJECTED : HAS_TOPIC;
+            break;
+        case T_MSG:
+            _claim();
+            _msg[_len] = 0;
+            _msg_len = _len;
+            _has[_depth - 1] |= _overflow ? REJECTED : HAS_MSG;
+            break;
+        default:
+            break;
+        }
+
+        _target = T_NONE;
+        _endValue();
+    };
+
+    // The buffers go to the object at the current depth; an enclosing
+    // object that had fields in them can't be a command any more.
+    void _claim() {
+        if (_owner && _owner != _depth) {
+            auto &has = _has[_owner - 1];
+            if (has & (HAS_TOPIC | HAS_MSG)) has = REJECTED;
+        }
+        _owner = _depth;
+    };
+
+    void _endObject() {
+        auto has = _has[_depth - 1];
+        if (has & REJECTED) {
+            _rejected++;
+        } else if ((has & (HAS_TOPIC | HAS_MSG)) == (HAS_TOPIC | HAS_MSG)) {
+            _commands++;
+            if (_callback) _callback(StrView(_topic, _topic_len), StrView(_msg, _msg_len), _arg);
+        }
+        if (_owner == _depth) _owner = 0;
+    };
+};
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <Arduino.h>
+#include <functional>
+
+#include "DebugLog.h"
+#include "heapprof.h"
+
+struct CoalescerCounters {
+    uint32_t received;
+    uint32_t coalesced; // folded into a later command of the same window
+    uint32_t dropped;   // no-op transitions, never reached the driver
+    uint32_t applied;
+    uint32_t throttled; // applies postponed by the frame rate cap
+};
+
+// Base of all coalescers; keeps them in a list so they can be driven and
+// reported without knowing the device types.
+class CoalescerBase {
+public:
+    CoalescerBase(const char *name) : _name(name), _next(_first) {
+        memset(&_counters, 0, sizeof(_counters));
+        _first = this;
+    };
+
+    const char *getName() const {
+        return _name;
+    };
+
+    const CoalescerCounters &getCounters() const {
+        return _counters;
+    };
+
+    CoalescerBase *next() const {
+        return _next;
+    };
+
+    static CoalescerBase *first() {
+        return _first;
+    };
+
+    // Apply pending commands on the next loop, without waiting for their window.
+    static void expediteAll() {
+        for (auto c = _first; c; c = c->_next) {
+            c->expedite();
+        }
+    };
+
+    static void loopAll() {
+        for (auto c = _first; c; c = c->_next) {
+            c->loop();
+        }
+    };
+
+    virtual void expedite() = 0;
+    virtual void loop() = 0;
+
+protected:
+    const char *_name;
+    CoalescerCounters _counters;
+
+private:
+    CoalescerBase *_next;
+
+    inline static CoalescerBase *_first = 0;
+};
+
+// Latest-wins coalescing of device state commands. Commands received within
+// `window_ms` of the first pending one are folded into the last desired state,
+// which is applied from `loop()` only if it differs from the current state.
+// Applies are limited to `max_frames_per_sec` IR frames, `frames_per_apply` each.
+template <typename T>
+class CommandCoalescer : public CoalescerBase {
+public:
+    typedef std::function<void(const T &state)> ApplyCallback;
+
+    CommandCoalescer(const char *name, uint16_t window_ms, uint8_t max_frames_per_sec, uint8_t frames_per_apply)
+        : CoalescerBase(name),
+          _window_ms(window_ms), _max_frames_per_sec(max_frames_per_sec), _frames_per_apply(frames_per_apply),
+          _pending(false), _pending_since(0), _throttled(false),
+          _tokens(max_frames_per_sec), _refilled_at(0) {
+    };
+
+    void begin(const T &initial, ApplyCallback apply) {
+        _state = initial;
+        _apply = apply;
+        _refilled_at = millis();
+    };
+
+    void setWindow(uint16_t window_ms) {
+        _window_ms = window_ms;
+    };
+
+    void submit(const T &desired) {
+        _counters.received++;
+
+        if (_pending) {
+            _counters.coalesced++;
+        } else if (desired == _state) {
+            _counters.dropped++;
+            return;
+        } else {
+            _pending = true;
+            _pending_since = millis();
+            _throttled = false;
+        }
+
+        _desired = desired;
+    };
+
+    virtual void expedite() override {
+        if (_pending) _pending_since = millis() - _window_ms;
+    };
+
+    const T &getState() const {
+        return _state;
+    };
+
+    // the state that will be applied, e.g. to toggle from: the pending one
+    // if a command waits for its window, else the applied one
+    const T &getDesired() const {
+        return _pending ? _desired : _state;
+    };
+
+    virtual void loop() override {
+        if (!_pending) return;
+
+        auto now = millis();
+        if (now - _pending_since < _window_ms) return;
+
+        if (_desired == _state) {
+            _pending = false;
+            _counters.dropped++;
+            return;
+        }
+
+        _refill(now);
+        if (_tokens < _frames_per_apply) {
+            if (!_throttled) {
+                _throttled = true;
+                _counters.throttled++;
+            }
+            _pending_since = now; // retry after another window
+            return;
+        }
+        _tokens -= _frames_per_apply;
+
+        _pending = false;
+        _state = _desired;
+        _counters.applied++;
+
+        DEBUG_LOG("[CMD] Apply <"); DEBUG_LOG(_name); DEBUG_LOG_LN(">");
+
+        HeapTagScope heapTag(HEAP_TAG_IR);
+        if (_apply) _apply(_state);
+    };
+
+private:
+    uint16_t _window_ms;
+    uint8_t _max_frames_per_sec;
+    uint8_t _frames_per_apply;
+
+    T _state;
+    T _desired;
+    bool _pending;
+    unsigned long _pending_since;
+    bool _throttled;
+
+    uint16_t _tokens;
+    unsigned long _refilled_at;
+
+    ApplyCallback _apply;
+
+    void _refill(unsigned long now) {
+        auto elapsed = now - _refilled_at;
+        auto add = elapsed * _max_frames_per_sec / 1000;
+        if (add == 0) return;
+
+        _tokens = _tokens + add > _max_frames_per_sec ? _max_frames_per_sec : _tokens + add;
+        _refilled_at += add * 1000 / _max_frames_per_sec;
+        if (_tokens == _max_frames_per_sec) _refilled_at = now;
+    };
+};
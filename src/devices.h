@@ -1,7 +1,16 @@
 #pragma once
 
+#include <stdint.h>
+
+// One layer of the status LED. A device owns its layer: what it sets stays
+// there while higher layers (e.g. Wi-Fi connecting) take over the output,
+// and shows again once they are done.
 class Led {
 public:
     virtual void on() = 0;
     virtual void off() = 0;
+    // brightness, 0-255
+    virtual void level(uint8_t level) = 0;
+    // shows the layers below again
+    virtual void release() = 0;
 };
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+#include "DebugLog.h"
+
+#ifndef EVENTS_MAX_CLIENTS
+    #define EVENTS_MAX_CLIENTS (3)
+#endif
+
+#ifndef EVENTS_QUEUE_SIZE
+    #define EVENTS_QUEUE_SIZE (512)
+#endif
+
+#ifndef EVENTS_KEEPALIVE_MS
+    #define EVENTS_KEEPALIVE_MS (15000)
+#endif
+
+// Server-Sent Events on `uri`. Every client has a fixed-size send queue;
+// a client that falls so far behind that an event doesn't fit is dropped
+// rather than letting its backlog grow on the heap.
+class EventStream : public AsyncWebHandler {
+public:
+    typedef std::function<void(EventStream &events)> ConnectListener;
+
+    EventStream(const char *uri) : _uri(uri), _dropped(0) {
+    };
+
+    // Called when a client is attached, e.g. to send a state snapshot. Events
+    // carry full values, so the other clients don't mind receiving it too.
+    void onConnect(ConnectListener listener) {
+        _connect_listener = listener;
+    };
+
+    void send(const char *event, const char *data) {
+        for (int i = 0; i < EVENTS_MAX_CLIENTS; i++) {
+            _clients[i].send(event, data, this);
+        }
+    };
+
+    size_t count() const {
+        size_t n = 0;
+        for (int i = 0; i < EVENTS_MAX_CLIENTS; i++) {
+            if (_clients[i].isOpen()) n++;
+        }
+        return n;
+    };
+
+    uint32_t getDropped() const {
+        return _dropped;
+    };
+
+    virtual bool canHandle(AsyncWebServerRequest *request) override {
+        return request->method() == HTTP_GET && request->url() == _uri;
+    };
+
+    virtual void handleRequest(AsyncWebServerRequest *request) override {
+        for (int i = 0; i < EVENTS_MAX_CLIENTS; i++) {
+            if (!_clients[i].isBusy()) {
+                _clients[i].reserve(true);
+                request->send(new Response(this, &_clients[i]));
+                return;
+            }
+        }
+
+        request->send(503, "text/plain", "Too Many Clients");
+    };
+
+    virtual bool isRequestHandlerTrivial() override {
+        return false;
+    };
+
+private:
+    class Client {
+    public:
+        Client() : _client(0), _reserved(false), _head(0), _len(0), _sent_at(0) {
+        };
+
+        bool isOpen() const {
+            return _client != 0;
+        };
+
+        bool isBusy() const {
+            return _client != 0 || _reserved;
+        };
+
+        // held for a request whose stream headers are being sent
+        void reserve(bool reserved) {
+            _reserved = reserved;
+        };
+
+        void attach(AsyncClient *client, EventStream *events) {
+            _client = client;
+            _reserved = false;
+            _head = _len = 0;
+            _sent_at = millis();
+
+            client->setRxTimeout(0);
+            client->onError(NULL, NULL);
+            client->onData(NULL, NULL);
+            client->onAck([](void *arg, AsyncClient *, size_t, uint32_t) {
+                static_cast<Client *>(arg)->_flush();
+            }, this);
+            client->onPoll([](void *arg, AsyncClient *) {
+                static_cast<Client *>(arg)->_poll();
+            }, this);
+            client->onTimeout([](void *, AsyncClient *c, uint32_t) {
+                c->close(true);
+            }, this);
+            client->onDisconnect([](void *arg, AsyncClient *c) {
+                static_cast<Client *>(arg)->_client = 0;
+                delete c;
+                DEBUG_LOG_LN("[EVENTS] Client disconnected.");
+            }, this);
+
+            DEBUG_LOG_LN("[EVENTS] Client connected.");
+
+            if (events->_connect_listener) {
+                events->_connect_listener(*events);
+            }
+        };
+
+        void send(const char *event, const char *data, EventStream *events) {
+            if (!_client) return;
+
+            auto ok = _enqueue("event: ") && _enqueue(event) &&
+                _enqueue("\ndata: ") && _enqueue(data) && _enqueue("\n\n");
+            if (!ok) {
+                DEBUG_LOG_LN("[EVENTS] Client too slow, dropped.");
+                events->_dropped++;
+                _client->close(true);
+                return;
+            }
+
+            _flush();
+        };
+
+    private:
+        AsyncClient *_client;
+        bool _reserved;
+        char _queue[EVENTS_QUEUE_SIZE];
+        size_t _head;
+        size_t _len;
+        unsigned long _sent_at;
+
+        bool _enqueue(const char *s) {
+            auto n = strlen(s);
+            if (n > EVENTS_QUEUE_SIZE - _len) return false;
+
+            for (size_t i = 0; i < n; i++) {
+                _queue[(_head + _len + i) % EVENTS_QUEUE_SIZE] = s[i];
+            }
+            _len += n;
+            return true;
+        };
+
+        void _flush() {
+            if (!_client || !_len) return;
+
+            while (_len && _client->canSend()) {
+                auto space = _client->space();
+                if (!space) break;
+
+                // contiguous part of the ring
+                auto n = _len;
+                if (_head + n > EVENTS_QUEUE_SIZE) n = EVENTS_QUEUE_SIZE - _head;
+                if (n > space) n = space;
+
+                auto added = _client->add(_queue + _head, n);
+                if (!added) break;
+
+                _head = (_head + added) % EVENTS_QUEUE_SIZE;
+                _len -= added;
+            }
+
+            _client->send();
+            _sent_at = millis();
+        };
+
+        void _poll() {
+            if (_len) {
+                _flush();
+            } else if (millis() - _sent_at >= EVENTS_KEEPALIVE_MS) {
+                _enqueue(":\n\n");
+                _flush();
+            }
+        };
+    };
+
+    // Sends the stream headers, then hands the connection over to a client slot.
+    class Response : public AsyncWebServerResponse {
+    public:
+        Response(EventStream *events, Client *client) : _events(events), _client(client), _attached(false) {
+            _code = 200;
+            _contentType = "text/event-stream";
+            _sendContentLength = false;
+            addHeader("Cache-Control", "no-cache");
+            addHeader("Connection", "keep-alive");
+        };
+
+        virtual ~Response() {
+            if (!_attached) _client->reserve(false);
+        };
+
+        virtual void _respond(AsyncWebServerRequest *request) override {
+            auto head = _assembleHead(request->version());
+            request->client()->write(head.c_str(), _headLength);
+            _state = RESPONSE_WAIT_ACK;
+        };
+
+        virtual size_t _ack(AsyncWebServerRequest *request, size_t len, uint32_t time) override {
+            if (len && !_attached) {
+                _attached = true;
+                _client->attach(request->client(), _events);
+                delete request; // the connection now belongs to the client slot
+            }
+            return 0;
+        };
+
+        virtual bool _sourceValid() const override {
+            return true;
+        };
+
+    private:
+        EventStream *_events;
+        Client *_client;
+        bool _attached;
+    };
+
+    String _uri;
+    Client _clients[EVENTS_MAX_CLIENTS];
+    ConnectListener _connect_listener;
+    uint32_t _dropped;
+};
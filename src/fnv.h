@@ -0,0 +1,15 @@
+#pragma once
+
+#include <Arduino.h>
+
+#define FNV1A_INIT (2166136261UL)
+
+// 32-bit FNV-1a; pass the previous result as `h` to hash in pieces.
+inline uint32_t fnv1a(const void *data, size_t len, uint32_t h = FNV1A_INIT) {
+    auto p = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 16777619UL;
+    }
+    return h;
+}
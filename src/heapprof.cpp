@@ -0,0 +1,81 @@
+#include "heapprof.h"
+
+#include <malloc.h>
+
+// Blocks are counted for the tag in scope when they are allocated or freed,
+// at their usable size as the allocator reports it. Nothing is stored with
+// a block, so blocks allocated past the wrapper (by the SDK, or by libc
+// internals) are freed like any other.
+
+extern "C" {
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void *IRAM_ATTR __wrap_malloc(size_t size) {
+    auto ptr = __real_malloc(size);
+    if (ptr) HeapProf::onAlloc(size, malloc_usable_size(ptr));
+    return ptr;
+}
+
+void *IRAM_ATTR __wrap_calloc(size_t count, size_t size) {
+    auto ptr = __real_calloc(count, size);
+    if (ptr) HeapProf::onAlloc(count * size, malloc_usable_size(ptr));
+    return ptr;
+}
+
+void *IRAM_ATTR __wrap_realloc(void *ptr, size_t size) {
+    if (!ptr) return __wrap_malloc(size);
+
+    // counted as a free and an allocation, both only once realloc succeeded
+    auto old = malloc_usable_size(ptr);
+    auto block = __real_realloc(ptr, size);
+    if (!block && size) return 0;
+
+    HeapProf::onFree(old);
+    if (block) HeapProf::onAlloc(size, malloc_usable_size(block));
+    return block;
+}
+
+void IRAM_ATTR __wrap_free(void *ptr) {
+    if (!ptr) return;
+
+    HeapProf::onFree(malloc_usable_size(ptr));
+    __real_free(ptr);
+}
+
+}
+
+#ifndef ARDUINO
+// Host builds link libstdc++ dynamically: its operator new calls malloc from
+// inside the shared library, out of reach of --wrap. Route it through here.
+#include <new>
+
+void *operator new(size_t size) {
+    auto p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+    free(ptr);
+}
+#endif // ARDUINO
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Heap usage by subsystem. Allocations and frees are counted for the tag of
+// the innermost HeapTagScope; the malloc family is wrapped at link time (see
+// heapprof.cpp and the -Wl,--wrap flags in platformio.ini). Blocks carry no
+// bookkeeping, so the heap looks the same with the profiler as without. A
+// block freed in another scope than it was allocated in moves its bytes
+// between the two tags: `live` is a balance per scope, and may go negative
+// for a tag that mostly frees. Memory the SDK allocates without going
+// through malloc is not seen.
+typedef enum {
+    HEAP_TAG_OTHER = 0,
+    HEAP_TAG_MQTT,
+    HEAP_TAG_HTTP,
+    HEAP_TAG_IR,
+    HEAP_TAG_BOOT,
+    HEAP_TAG_COUNT
+} HeapTag;
+
+struct HeapTagStats {
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t bytes; // requested by allocations
+    int32_t live;   // usable bytes allocated minus freed in the tag's scopes
+    int32_t high;   // high-water of `live`
+};
+
+struct HeapSample {
+    uint32_t at; // seconds since boot
+    uint32_t free;
+    uint16_t max_free_block;
+    uint8_t fragmentation;
+};
+
+#ifndef HEAP_SAMPLES
+    #define HEAP_SAMPLES (32)
+#endif
+
+#ifndef HEAP_SAMPLE_INTERVAL_MS
+    #define HEAP_SAMPLE_INTERVAL_MS (10000)
+#endif
+
+class HeapTagScope;
+
+class HeapProf {
+public:
+    // `size` as requested, `usable` as the allocator handed it out
+    static void IRAM_ATTR onAlloc(size_t size, size_t usable) {
+        auto &s = _stats[_tag];
+        s.allocs++;
+        s.bytes += size;
+        s.live += usable;
+        if (s.live > s.high) s.high = s.live;
+    };
+
+    static void IRAM_ATTR onFree(size_t usable) {
+        auto &s = _stats[_tag];
+        s.frees++;
+        s.live -= usable;
+    };
+
+    static const HeapTagStats &get(HeapTag tag) {
+        return _stats[tag];
+    };
+
+    static const char *name(HeapTag tag) {
+        static const char *names[HEAP_TAG_COUNT] = {
+            "other", "mqtt", "http", "ir", "boot"
+        };
+        return names[tag];
+    };
+
+    static void loop() {
+        auto now = millis();
+        if (_sample_count && now - _sampled_at < HEAP_SAMPLE_INTERVAL_MS) return;
+        _sampled_at = now;
+
+        auto &sample = _samples[_sample_next];
+        sample.at = now / 1000;
+        ESP.getHeapStats(&sample.free, &sample.max_free_block, &sample.fragmentation);
+
+        _sample_next = (_sample_next + 1) % HEAP_SAMPLES;
+        if (_sample_count < HEAP_SAMPLES) _sample_count++;
+    };
+
+    // {"tags":{"<tag>":{...},...},"samples":[[at,free,maxFreeBlock,frag],...]}, oldest sample first
+    static void printTo(Print &out) {
+        out.print("{\"tags\":{");
+        for (int t = 0; t < HEAP_TAG_COUNT; t++) {
+            auto &s = _stats[t];
+            if (t) out.print(',');
+            out.print('"'); out.print(name((HeapTag)t));
+            out.print("\":{\"allocs\":"); out.print(s.allocs);
+            out.print(",\"frees\":"); out.print(s.frees);
+            out.print(",\"bytes\":"); out.print(s.bytes);
+            out.print(",\"live\":"); out.print(s.live);
+            out.print(",\"high\":"); out.print(s.high);
+            out.print('}');
+        }
+        out.print("},\"samples\":[");
+        for (size_t i = 0; i < _sample_count; i++) {
+            auto &sample = _samples[(_sample_next + HEAP_SAMPLES - _sample_count + i) % HEAP_SAMPLES];
+            if (i) out.print(',');
+            out.print('['); out.print(sample.at);
+            out.print(','); out.print(sample.free);
+            out.print(','); out.print(sample.max_free_block);
+            out.print(','); out.print(sample.fragmentation);
+            out.print(']');
+        }
+        out.print("]}");
+    };
+
+private:
+    friend class HeapTagScope;
+
+    inline static volatile HeapTag _tag = HEAP_TAG_OTHER;
+    inline static HeapTagStats _stats[HEAP_TAG_COUNT] = {};
+
+    inline static HeapSample _samples[HEAP_SAMPLES] = {};
+    inline static size_t _sample_next = 0;
+    inline static size_t _sample_count = 0;
+    inline static unsigned long _sampled_at = 0;
+};
+
+class HeapTagScope {
+public:
+    HeapTagScope(HeapTag tag) : _prev_tag(HeapProf::_tag) {
+        HeapProf::_tag = tag;
+    };
+
+    ~HeapTagScope() {
+        HeapProf::_tag = _prev_tag;
+    };
+
+private:
+    HeapTag _prev_tag;
+};
@@ -3,119 +3,193 @@
 #include <ESPAsyncWebServer.h>
 #include <FS.h>
 #include <LittleFS.h>
-#include <AsyncJson.h>
 #include <ArduinoJson.h>
 #include <ESP8266mDNS.h>
+#include <new>
 
 #include "DebugLog.h"
+#include "bufprint.h"
+#include "cmdstream.h"
+#include "coalescer.h"
+#include "events.h"
+#include "fnv.h"
+#include "heapprof.h"
+#include "irlearn.h"
+#include "metrics.h"
+#include "scheduler.h"
+#include "site.h"
 
 #include "version.h"
 
 extern BemfaMqtt bemfaMqtt;
 
-static const char *mimetype(const String &filename) {
-    auto fn = filename;
-    fn.toLowerCase();
+#ifndef HTTPD_STATUS_BUF_SIZE
+    #define HTTPD_STATUS_BUF_SIZE (768)
+#endif
 
-    if (fn.endsWith(".htm") || fn.endsWith(".html")) {
-        return "text/html";
-    }
-    if (fn.endsWith(".css")) {
-        return "text/css";
-    }
-    if (fn.endsWith(".js")) {
-        return "application/javascript";
-    }
-    if (fn.endsWith(".json")) {
-        return "application/json";
-    }
-    if (fn.endsWith(".png")) {
-        return "image/png";
-    }
-    if (fn.endsWith(".jpg") || fn.endsWith(".jpeg")) {
-        return "image/jpeg";
-    }
-    if (fn.endsWith(".gif")) {
-        return "image/gif";
-    }
+#ifndef HTTPD_MAX_CONTENT_LENGTH
+    #define HTTPD_MAX_CONTENT_LENGTH (1024)
+#endif
 
-    return "text/plain";
-}
+#ifndef HTTPD_LEARN_TIMEOUT_MS
+    #define HTTPD_LEARN_TIMEOUT_MS (30000)
+#endif
+
+// bounds of a requested learn timeout
+#define HTTPD_LEARN_MIN_TIMEOUT_MS (1000)
+#define HTTPD_LEARN_MAX_TIMEOUT_MS (60000)
 
 class Httpd {
 public:
     Httpd(uint16_t port)
-        : _server(port) {
+        : _server(port), _events("/api/events"), _learner(0), _version_len(0), _status_valid(false), _status_stable_len(0), _status_len(0) {
+    };
+
+    // Sends an event to all clients of `/api/events`; `data` must be one line.
+    void pushEvent(const char *event, const char *data) {
+        _events.send(event, data);
+    };
+
+    // Enables `/api/learn`; boards without an IR receiver don't set it.
+    void setLearner(IrLearner *learner) {
+        _learner = learner;
     };
 
     void begin() {
         // Init FS
         LittleFS.begin();
+        _site.begin(LittleFS, "/site");
+
+        // Cached responses
+        _buildVersion();
+
+        _got_ip_handler = WiFi.onStationModeGotIP([this](const WiFiEventStationModeGotIP &) {
+            _status_valid = false;
+        });
+
+        _disconnected_handler = WiFi.onStationModeDisconnected([this](const WiFiEventStationModeDisconnected &) {
+            _status_valid = false;
+        });
+
+        MDNS.setHostProbeResultCallback([this](const char *, bool) {
+            _status_valid = false;
+        });
+
+        bemfaMqtt.onConnectionChange([this](bool connected) {
+            _status_valid = false;
+            _pushMqtt(connected);
+        });
+
+        // State push
+        bemfaMqtt.onStateChange([this](const StrView &topic, const StrView &msg) {
+            _pushState(topic, msg);
+        });
+
+        _events.onConnect([this](EventStream &) {
+            _pushMqtt(bemfaMqtt.getMqttClient().connected());
+        });
 
         // Init web server
 
+        // route - GET `/api/events`, must precede the static route
+        _server.addHandler(&_events);
+
         // route - /version
-        _server.on("^\\/version$", HTTP_GET, [](AsyncWebServerRequest *request) {
-            auto response = request->beginResponseStream("application/json");
-            DynamicJsonDocument v(256);
+        _server.on("^\\/version$", HTTP_GET, [this](AsyncWebServerRequest *request) {
+            MetricScope scope(METRIC_HTTP_VERSION);
+            HeapTagScope heapTag(HEAP_TAG_HTTP);
+
+            _sendCached(request, _version_json, _version_len);
+        });
 
-            v["firmware"] = FIRMWARE_VERSION;
-            v["sdk"] = ESP.getSdkVersion();
-            v["boot"] = ESP.getBootVersion();
-            v["core"] = ESP.getCoreVersion();
-            v["full"] = ESP.getFullVersion();
+        // route - GET `/api/status`
+        _server.on("^\\/api\\/status$", HTTP_GET, [this](AsyncWebServerRequest *request) {
+            MetricScope scope(METRIC_HTTP_STATUS);
+            HeapTagScope heapTag(HEAP_TAG_HTTP);
 
-            serializeJsonPretty(v, *response);
-            request->send(response);
+            _apiStatusGet(request);
         });
 
-        // route - GET `/api/xxxxxx`
-        _server.on("^\\/api\\/(.*)$", HTTP_GET, [this](AsyncWebServerRequest *request) {
-            auto path = request->pathArg(0);
+        // route - GET `/api/metrics`
+        _server.on("^\\/api\\/metrics$", HTTP_GET, [this](AsyncWebServerRequest *request) {
+            MetricScope scope(METRIC_HTTP_METRICS);
+            HeapTagScope heapTag(HEAP_TAG_HTTP);
 
-            DEBUG_LOG("[HTTP] GET /api/"); DEBUG_LOG_LN(path);
+            _apiMetricsGet(request);
+        });
 
-            if (path == "status") {
-                _apiStatusGet(request);
-            } else {
-                request->send(404, "text/plain", "Not Found");
-            }
+        // route - GET `/api/heap`
+        _server.on("^\\/api\\/heap$", HTTP_GET, [this](AsyncWebServerRequest *request) {
+            MetricScope scope(METRIC_HTTP_HEAP);
+            HeapTagScope heapTag(HEAP_TAG_HTTP);
+
+            _apiHeapGet(request);
         });
 
-        // route - POST/PUT `/api/xxxxxx`
-        auto handler = new AsyncCallbackJsonWebHandler("/api", [](AsyncWebServerRequest *request, JsonVariant &json) {
-            auto path = request->url();
-            DEBUG_LOG("[HTTP] Json request: "); DEBUG_LOG_LN(path);
-            DEBUG_LOG("          method: "); DEBUG_LOG_LN(request->methodToString());
+        // route - GET `/api/learn`, the result so far
+        _server.on("^\\/api\\/learn$", HTTP_GET, [this](AsyncWebServerRequest *request) {
+            MetricScope scope(METRIC_HTTP_LEARN);
+            HeapTagScope heapTag(HEAP_TAG_HTTP);
 
-            auto jsonObj = json.as<JsonObject>();
-            DEBUG_LOG_LN("            keys: ");
-            for (auto it = jsonObj.begin(); it != jsonObj.end(); ++it) {
-                DEBUG_LOG("                  "); DEBUG_LOG_LN(it->key().c_str());
-            }
+            _apiLearnGet(request);
+        });
+
+        // route - POST `/api/learn[?timeout=<ms>]`, listen for a remote command;
+        // the timeout is 1000 to 60000ms, HTTPD_LEARN_TIMEOUT_MS if not given
+        _server.on("^\\/api\\/learn$", HTTP_POST, [this](AsyncWebServerRequest *request) {
+            MetricScope scope(METRIC_HTTP_LEARN);
+            HeapTagScope heapTag(HEAP_TAG_HTTP);
+
+            _apiLearnPost(request);
+        });
+
+        // route - POST/PUT `/api/devices`, local device control
+        _server.on("^\\/api\\/devices$", HTTP_POST | HTTP_PUT, [](AsyncWebServerRequest *request) {
+            MetricScope scope(METRIC_HTTP_DEVICES);
+            HeapTagScope heapTag(HEAP_TAG_HTTP);
 
-            // TODO implement apis
+            _apiDevicesPost(request);
+        }, nullptr, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+            MetricScope scope(METRIC_HTTP_DEVICES);
+            HeapTagScope heapTag(HEAP_TAG_HTTP);
 
-            request->send(200);
+            _apiDevicesBody(request, data, len, index, total);
         });
-        handler->setMethod(HTTP_POST | HTTP_PUT);
-        handler->setMaxContentLength(1024);
-        _server.addHandler(handler);
 
         // route - static contents
-        _server.on("^\\/(.*)$", HTTP_GET, [](AsyncWebServerRequest *request) {
+        _server.on("^\\/(.*)$", HTTP_GET, [this](AsyncWebServerRequest *request) {
+            MetricScope scope(METRIC_HTTP_STATIC);
+            HeapTagScope heapTag(HEAP_TAG_HTTP);
+
             auto path = request->pathArg(0);
             if (path == "") {
                 path = "index.html";
             }
 
             DEBUG_LOG("[HTTP] static: "); DEBUG_LOG_LN(path);
-            auto fpath = "/site/" + path;
-            if (LittleFS.exists(fpath)) {
-                request->send(LittleFS, fpath, mimetype(path), false);
-            } else {
+            auto asset = _site.find(path);
+            if (!asset) {
                 request->send(404, "text/plain", "Not Found");
+                return;
+            }
+
+            AsyncWebServerResponse *response;
+            if (request->hasHeader("If-None-Match") && request->getHeader("If-None-Match")->value() == asset->etag) {
+                response = request->beginResponse(304);
+            } else {
+                auto file = LittleFS.open(asset->file, "r");
+                if (!file) {
+                    request->send(404, "text/plain", "Not Found");
+                    return;
+                }
+
+                // a `.gz` file served under its plain path gets `Content-Encoding: gzip`
+                response = request->beginResponse(file, path, asset->mime);
             }
+
+            response->addHeader("ETag", asset->etag);
+            response->addHeader("Cache-Control", asset->cacheControl);
+            request->send(response);
         });
 
         // route - not found
@@ -127,31 +201,307 @@ public:
     };
 private:
     AsyncWebServer _server;
+    EventStream _events;
+    SiteIndex _site;
+    IrLearner *_learner;
 
-    void _apiStatusGet(AsyncWebServerRequest *request) {
-        auto response = request->beginResponseStream("application/json");
-        DynamicJsonDocument v(384);
+    WiFiEventHandler _got_ip_handler;
+    WiFiEventHandler _disconnected_handler;
+
+    char _version_json[256];
+    size_t _version_len;
+
+    // Status is cached as compact JSON; the part up to the volatile fields
+    // is rebuilt only after WiFi/mDNS/MQTT events.
+    char _status_buf[HTTPD_STATUS_BUF_SIZE];
+    bool _status_valid;
+    size_t _status_stable_len;
+    size_t _status_len;
+
+    void _buildVersion() {
+        DynamicJsonDocument v(256);
+
+        v["firmware"] = FIRMWARE_VERSION;
+        v["sdk"] = ESP.getSdkVersion();
+        v["boot"] = ESP.getBootVersion();
+        v["core"] = ESP.getCoreVersion();
+        v["full"] = ESP.getFullVersion();
+
+        _version_len = serializeJson(v, _version_json, sizeof(_version_json));
+    }
 
-        v["wifi"]["ssid"] = WiFi.SSID();
-        v["wifi"]["isConnected"] = WiFi.isConnected();
-        v["wifi"]["hostname"] = WiFi.getHostname();
-        v["wifi"]["localIp"] = WiFi.localIP().toString();
+    void _refreshStatus() {
+        if (!_status_valid) {
+            DynamicJsonDocument v(384);
 
-        v["mdns"]["isRunning"] = MDNS.isRunning();
+            v["wifi"]["ssid"] = WiFi.SSID();
+            v["wifi"]["isConnected"] = WiFi.isConnected();
+            v["wifi"]["hostname"] = WiFi.getHostname();
+            v["wifi"]["localIp"] = WiFi.localIP().toString();
 
-        v["mqtt"]["isConnected"] = bemfaMqtt.getMqttClient().connected();
-        v["mqtt"]["clientId"] = bemfaMqtt.getMqttClient().getClientId();
+            v["mdns"]["isRunning"] = MDNS.isRunning();
+
+            v["mqtt"]["isConnected"] = bemfaMqtt.getMqttClient().connected();
+            v["mqtt"]["clientId"] = bemfaMqtt.getMqttClient().getClientId();
+
+            // a truncated object doesn't end with its brace
+            size_t len = serializeJson(v, _status_buf, sizeof(_status_buf));
+            if (len < 2 || _status_buf[len - 1] != '}') {
+                _status_len = 0;
+                return;
+            }
+
+            _status_stable_len = len - 1; // reopen the object
+            _status_valid = true;
+        }
+
+        BufPrint out(_status_buf + _status_stable_len, sizeof(_status_buf) - _status_stable_len);
 
         uint32_t free;
         uint16_t maxFreeBlockSize;
         uint8_t fragmentation;
         ESP.getHeapStats(&free, &maxFreeBlockSize, &fragmentation);
 
-        v["heap"]["free"] = free;
-        v["heap"]["maxFreeBlockSize"] = maxFreeBlockSize;
-        v["heap"]["fragmentation"] = fragmentation;
+        out.print(",\"heap\":{\"free\":"); out.print(free);
+        out.print(",\"maxFreeBlockSize\":"); out.print(maxFreeBlockSize);
+        out.print(",\"fragmentation\":"); out.print(fragmentation);
+
+        auto &outbox = bemfaMqtt.getOutbox().getCounters();
+        out.print("},\"outbox\":{\"pending\":"); out.print(bemfaMqtt.getOutbox().pending());
+        out.print(",\"queued\":"); out.print(outbox.queued);
+        out.print(",\"coalesced\":"); out.print(outbox.coalesced);
+        out.print(",\"sent\":"); out.print(outbox.sent);
+        out.print(",\"acked\":"); out.print(outbox.acked);
+        out.print(",\"dropped\":"); out.print(outbox.dropped);
+
+        auto &timing = bemfaMqtt.getConnectTiming();
+        out.print("},\"mqttConnect\":{\"attempts\":"); out.print(timing.attempts);
+        out.print(",\"dns\":"); out.print(timing.dns);
+        out.print(",\"dnsCached\":"); out.print(timing.dns_cached ? "true" : "false");
+        out.print(",\"connack\":"); out.print(timing.connack);
+        out.print(",\"suback\":"); out.print(timing.suback);
+        out.print("},\"commands\":{");
+        for (auto c = CoalescerBase::first(); c; c = c->next()) {
+            auto &counters = c->getCounters();
+            if (c != CoalescerBase::first()) out.print(',');
+            out.print('"'); out.print(c->getName());
+            out.print("\":{\"received\":"); out.print(counters.received);
+            out.print(",\"coalesced\":"); out.print(counters.coalesced);
+            out.print(",\"dropped\":"); out.print(counters.dropped);
+            out.print(",\"applied\":"); out.print(counters.applied);
+            out.print(",\"throttled\":"); out.print(counters.throttled);
+            out.print('}');
+        }
+        out.print("}}");
+
+        _status_len = out.overflow() ? 0 : _status_stable_len + out.length();
+    }
+
+    void _apiStatusGet(AsyncWebServerRequest *request) {
+        _refreshStatus();
 
-        serializeJsonPretty(v, *response);
+        if (_status_len == 0) {
+            request->send(500, "text/plain", "Status Too Large");
+            return;
+        }
+
+        // copied: the buffer is rebuilt by the next request while this one
+        // may still be sending. No ETag, the counters differ on every call.
+        auto response = request->beginResponseStream("application/json");
+        response->write(reinterpret_cast<const uint8_t *>(_status_buf), _status_len);
+        response->addHeader("Cache-Control", "no-store");
         request->send(response);
     }
+
+    void _pushMqtt(bool connected) {
+        _events.send("mqtt", connected ? "{\"isConnected\":true}" : "{\"isConnected\":false}");
+    }
+
+    void _pushState(const StrView &topic, const StrView &msg) {
+        char data[128];
+        BufPrint out(data, sizeof(data) - 1);
+
+        out.print("{\"topic\":");
+        _printJsonString(out, topic);
+        out.print(",\"msg\":");
+        _printJsonString(out, msg);
+        out.print('}');
+
+        if (out.overflow()) return;
+        data[out.length()] = 0;
+
+        _events.send("state", data);
+    }
+
+    static void _printJsonString(Print &out, const StrView &s) {
+        out.print('"');
+        for (size_t i = 0; i < s.length(); i++) {
+            auto c = s.data()[i];
+            if (c == '"' || c == '\\') {
+                out.print('\\');
+            } else if ((uint8_t)c < 0x20) {
+                continue;
+            }
+            out.print(c);
+        }
+        out.print('"');
+    }
+
+    // Responds 304 if the client has the same body, else sends the buffer as is.
+    // The response reads `body` lazily, so it must not change afterwards.
+    static void _sendCached(AsyncWebServerRequest *request, const char *body, size_t len) {
+        char etag[12];
+        snprintf(etag, sizeof(etag), "\"%08x\"", (unsigned)fnv1a(body, len));
+
+        AsyncWebServerResponse *response;
+        if (request->hasHeader("If-None-Match") && request->getHeader("If-None-Match")->value() == etag) {
+            response = request->beginResponse(304);
+        } else {
+            response = request->beginResponse_P(200, "application/json", reinterpret_cast<const uint8_t *>(body), len);
+        }
+
+        response->addHeader("ETag", etag);
+        response->addHeader("Cache-Control", "no-cache");
+        request->send(response);
+    }
+
+    void _apiMetricsGet(AsyncWebServerRequest *request) {
+        auto response = request->beginResponseStream("application/json");
+
+        response->printf("{\"uptime\":%lu,\"boot\":", millis());
+        Metrics::printBootTo(*response);
+        response->print(",\"latency\":");
+        Metrics::printTo(*response);
+        response->print(",\"tasks\":");
+        Scheduler::printTo(*response);
+        response->print('}');
+
+        request->send(response);
+    }
+
+    void _apiHeapGet(AsyncWebServerRequest *request) {
+        auto response = request->beginResponseStream("application/json");
+        HeapProf::printTo(*response);
+        request->send(response);
+    }
+
+    void _apiLearnGet(AsyncWebServerRequest *request) {
+        if (!_learner) {
+            request->send(404, "text/plain", "Not Found");
+            return;
+        }
+
+        auto response = request->beginResponseStream("application/json");
+        _learner->printTo(*response);
+        request->send(response);
+    }
+
+    void _apiLearnPost(AsyncWebServerRequest *request) {
+        if (!_learner) {
+            request->send(404, "text/plain", "Not Found");
+            return;
+        }
+
+        uint32_t timeout = HTTPD_LEARN_TIMEOUT_MS;
+        if (request->hasParam("timeout")) {
+            timeout = _learnTimeout(request->getParam("timeout")->value());
+            if (!timeout) {
+                request->send(400, "text/plain", "Bad Request");
+                return;
+            }
+        }
+
+        _learner->start(timeout);
+        request->send(202, "application/json", "{\"state\":\"listening\"}");
+    }
+
+    // Milliseconds, digits only and within the bounds; 0 if not.
+    static uint32_t _learnTimeout(const String &value) {
+        auto digits = value.c_str();
+        if (!*digits || value.length() > 5) return 0;
+        for (auto c = digits; *c; c++) {
+            if (!isdigit((unsigned char)*c)) return 0;
+        }
+
+        auto timeout = value.toInt();
+        if (timeout < HTTPD_LEARN_MIN_TIMEOUT_MS || timeout > HTTPD_LEARN_MAX_TIMEOUT_MS) return 0;
+        return timeout;
+    }
+
+    // The body of a batch of device commands, copied as it streams in: it
+    // is checked whole before any command is dispatched, so a bad body
+    // answers 400 without having moved a device. The request frees its
+    // temp object with free(), so the header and the body share one malloc
+    // block, the body right after the header.
+    struct DeviceBatch {
+        DeviceBatch() : len(0), routed(0) {
+        };
+
+        uint16_t len;
+        uint16_t routed;
+
+        static DeviceBatch *create(size_t size) {
+            auto mem = malloc(sizeof(DeviceBatch) + size);
+            return mem ? new (mem) DeviceBatch() : nullptr;
+        };
+
+        uint8_t *body() {
+            return reinterpret_cast<uint8_t *>(this) + sizeof(DeviceBatch);
+        };
+    };
+
+    static void _deviceCommand(const StrView &topic, const StrView &msg, void *arg) {
+        if (bemfaMqtt.dispatch(topic, msg)) {
+            static_cast<DeviceBatch *>(arg)->routed++;
+        }
+    }
+
+    static void _apiDevicesBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+        if (total > HTTPD_MAX_CONTENT_LENGTH) return;
+
+        if (index == 0 && !request->_tempObject) {
+            request->_tempObject = DeviceBatch::create(total);
+        }
+
+        auto batch = static_cast<DeviceBatch *>(request->_tempObject);
+        if (!batch || index != batch->len || index + len > total) return;
+
+        memcpy(batch->body() + index, data, len);
+        batch->len += len;
+    }
+
+    static void _apiDevicesPost(AsyncWebServerRequest *request) {
+        DEBUG_LOG("[HTTP] Devices request, length: "); DEBUG_LOG_LN(request->contentLength());
+
+        if (request->contentLength() > HTTPD_MAX_CONTENT_LENGTH) {
+            request->send(413, "text/plain", "Payload Too Large");
+            return;
+        }
+
+        auto batch = static_cast<DeviceBatch *>(request->_tempObject);
+        if (!batch || batch->len != request->contentLength()) {
+            request->send(400, "text/plain", "Bad Request");
+            return;
+        }
+
+        CommandStreamParser check(nullptr, nullptr);
+        check.feed(batch->body(), batch->len);
+        if (!check.finish()) {
+            request->send(400, "text/plain", "Bad Request");
+            return;
+        }
+
+        CommandStreamParser parser(_deviceCommand, batch);
+        parser.feed(batch->body(), batch->len);
+        parser.finish();
+
+        // local clients should not wait for the coalescing window;
+        // the applied states are published to MQTT by the devices
+        CoalescerBase::expediteAll();
+
+        char body[64];
+        snprintf(body, sizeof(body), "{\"accepted\":%u,\"unrouted\":%u,\"rejected\":%u}",
+            batch->routed, parser.getCommands() - batch->routed, parser.getRejected());
+        request->send(200, "application/json", body);
+    }
 };
@@ -3,7 +3,11 @@
 #ifdef DEV_BOARD
     #define LED_PIN (LED_BUILTIN)
     #define BTN_PIN (0)
+    #define IR_RECV_PIN (12)
 #else
     #define LED_PIN (16)
     #define BTN_PIN (5)
 #endif
+
+#define IR_SWITCH_PIN (14)
+#define IR_LED_PIN (13)
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <Arduino.h>
+
+#ifndef IR_CODE_MAX_BITS
+    #define IR_CODE_MAX_BITS (128)
+#endif
+
+#define IR_CODE_MAX_BYTES ((IR_CODE_MAX_BITS + 7) / 8)
+
+// A pulse-distance IR command: a header mark/space, then every bit as
+// `bit_mark` followed by `zero_space` or `one_space`, then an optional
+// trailing mark. Bits are sent LSB first, starting with bits[0]. Codes and
+// their bits can live in PROGMEM; scripts/ir_convert.py makes them from
+// captured raw timings.
+struct IrCode {
+    uint16_t hz;
+    uint16_t header_mark;
+    uint16_t header_space;
+    uint16_t bit_mark;
+    uint16_t zero_space;
+    uint16_t one_space;
+    uint16_t trailer_mark; // 0 for none
+    uint16_t nbits;
+    const uint8_t *bits;
+};
+
+// An IrCode copied out of flash with its bits, so it can be expanded from
+// the transmitter interrupt.
+class IrCodeTimings {
+public:
+    // `code` and its bits may be in PROGMEM or RAM.
+    bool load(const IrCode *code) {
+        memcpy_P(&_code, code, sizeof(_code));
+        if (_code.nbits > IR_CODE_MAX_BITS) return false;
+
+        memcpy_P(_bits, _code.bits, (_code.nbits + 7) / 8);
+        _code.bits = _bits;
+        return true;
+    };
+
+    uint16_t hz() const {
+        return _code.hz;
+    };
+
+    // number of marks and spaces
+    uint16_t length() const {
+        return 2 + _code.nbits * 2 + (_code.trailer_mark ? 1 : 0);
+    };
+
+    uint16_t IRAM_ATTR at(uint16_t idx) const {
+        if (idx == 0) return _code.header_mark;
+        if (idx == 1) return _code.header_space;
+
+        idx -= 2;
+        uint16_t bit = idx / 2;
+        if (bit >= _code.nbits) return _code.trailer_mark;
+        if ((idx & 1) == 0) return _code.bit_mark;
+
+        return (_bits[bit / 8] >> (bit % 8)) & 1 ? _code.one_space : _code.zero_space;
+    };
+
+private:
+    IrCode _code;
+    uint8_t _bits[IR_CODE_MAX_BYTES];
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <Arduino.h>
+#include <IRrecv.h>
+
+#include "irlearn.h"
+
+// Captures through IRremoteESP8266's receiver: its GPIO interrupt records
+// the edges into a fixed buffer, a capture ends after `timeout_ms` without
+// one. Only the raw capture is used, its protocol decoders can stay
+// compiled out (see -D_IR_ENABLE_DEFAULT_ in platformio.ini).
+class Esp8266IrRecvBackend : public IrRecvBackend {
+public:
+    // A timeout above the usual repeat gap keeps repeats in one capture.
+    Esp8266IrRecvBackend(uint8_t pin, uint8_t timeout_ms = 90)
+        : _recv(pin, IR_LEARN_MAX_TIMINGS + 1, timeout_ms, false), _enabled(false) {
+    };
+
+    virtual void enable() override {
+        if (_enabled) return;
+        _enabled = true;
+        _recv.enableIRIn();
+    };
+
+    virtual void disable() override {
+        if (!_enabled) return;
+        _enabled = false;
+        _recv.disableIRIn();
+    };
+
+    virtual uint16_t read(uint16_t *timings, uint16_t max) override {
+        decode_results results;
+        if (!_recv.decode(&results)) return 0;
+
+        // rawbuf[0] is the gap before the capture
+        uint16_t len = 0;
+        for (uint16_t i = 1; i < results.rawlen && len < max; i++) {
+            uint32_t us = results.rawbuf[i] * kRawTick;
+            timings[len++] = us > 0xFFFF ? 0xFFFF : us;
+        }
+
+        _recv.resume();
+        return len;
+    };
+
+private:
+    IRrecv _recv;
+    bool _enabled;
+};
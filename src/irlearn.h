@@ -0,0 +1,390 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "DebugLog.h"
+#include "ircode.h"
+#include "irproto.h"
+
+#ifndef IR_LEARN_MAX_TIMINGS
+    #define IR_LEARN_MAX_TIMINGS (400)
+#endif
+
+// timings handled per decoder step
+#ifndef IR_LEARN_SLICE
+    #define IR_LEARN_SLICE (32)
+#endif
+
+// a longer space ends a frame; the next one may be a repeat
+#ifndef IR_LEARN_FRAME_GAP_US
+    #define IR_LEARN_FRAME_GAP_US (10000)
+#endif
+
+#ifndef IR_LEARN_TOLERANCE_PCT
+    #define IR_LEARN_TOLERANCE_PCT (25)
+#endif
+
+// Turns one capture, alternating mark/space durations in microseconds,
+// into a pulse-distance IrCode. The work is split into steps of at most
+// IR_LEARN_SLICE timings each, so a long capture never holds up loop():
+// split off the first frame, count identical repeats, average the marks,
+// classify the spaces into zeros and ones, then check that the code
+// expands back to the capture within IR_LEARN_TOLERANCE_PCT.
+class IrLearnDecoder {
+public:
+    typedef enum {
+        IDLE = 0,
+        SPLIT,
+        REPEATS,
+        MEASURE,
+        CLASSIFY,
+        VERIFY,
+        DONE,
+        FAILED   // too short, or not pulse-distance encoded
+    } Phase;
+
+    IrLearnDecoder() : _timings(0), _len(0), _phase(IDLE), _protocol(0) {
+    };
+
+    // `timings` must stay valid until the decoder is done.
+    void begin(const uint16_t *timings, uint16_t len) {
+        _timings = timings;
+        _len = len;
+        _frame_len = len;
+        _repeats = 0;
+        _next_frame = 0;
+        _idx = 0;
+        _phase = len >= 4 ? SPLIT : FAILED;
+    };
+
+    // One slice of work; returns false once done or failed.
+    bool step() {
+        auto end = _idx + IR_LEARN_SLICE;
+
+        switch (_phase) {
+        case SPLIT:
+            // spaces are at odd indices
+            for (; _idx < _len && _idx < end; _idx++) {
+                if ((_idx & 1) && _timings[_idx] >= IR_LEARN_FRAME_GAP_US) {
+                    _frame_len = _idx; // without the gap
+                    _next_frame = _idx + 1;
+                    break;
+                }
+            }
+            if (_idx >= _len || _next_frame) {
+                _idx = 0;
+                _phase = _frame_len >= 4 ? REPEATS : FAILED;
+            }
+            break;
+
+        case REPEATS:
+            // frames identical to the first one, each after a gap
+            if (!_next_frame || _next_frame + _frame_len > _len) {
+                _startMeasure();
+                break;
+            }
+            for (; _idx < _frame_len && _idx < end; _idx++) {
+                if (!_near(_timings[_next_frame + _idx], _timings[_idx])) {
+                    _startMeasure();
+                    return true;
+                }
+            }
+            if (_idx >= _frame_len) {
+                _repeats++;
+                _idx = 0;
+                auto gap = _next_frame + _frame_len;
+                _next_frame = gap + 1 < _len && _timings[gap] >= IR_LEARN_FRAME_GAP_US ? gap + 1 : 0;
+            }
+            break;
+
+        case MEASURE:
+            // body: bit mark/space pairs after the header, maybe a trailing mark
+            for (; _idx < _body_end && _idx < end; _idx++) {
+                auto t = _timings[_idx];
+                if (_idx & 1) {
+                    if (t < _space_min) _space_min = t;
+                    if (t > _space_max) _space_max = t;
+                } else {
+                    _mark_sum += t;
+                }
+            }
+            if (_idx >= _body_end) {
+                _nbits = (_body_end - 2) / 2;
+                if (_space_max - _space_min < _space_min / 2 || _nbits > IR_CODE_MAX_BITS) {
+                    _phase = FAILED;
+                    break;
+                }
+                _threshold = (_space_min + _space_max) / 2;
+                _zero_sum = _one_sum = 0;
+                _zeros = 0;
+                memset(_bits, 0, sizeof(_bits));
+                _idx = 3;
+                _phase = CLASSIFY;
+            }
+            break;
+
+        case CLASSIFY:
+            for (; _idx < _body_end && _idx < end; _idx += 2) {
+                auto t = _timings[_idx];
+                uint16_t bit = (_idx - 3) / 2;
+                if (t >= _threshold) {
+                    _bits[bit / 8] |= 1 << (bit % 8);
+                    _one_sum += t;
+                } else {
+                    _zero_sum += t;
+                    _zeros++;
+                }
+            }
+            if (_idx >= _body_end) {
+                _code.hz = 38000;
+                _code.header_mark = _timings[0];
+                _code.header_space = _timings[1];
+                _code.bit_mark = _mark_sum / _nbits;
+                _code.zero_space = _zero_sum / _zeros;
+                _code.one_space = _one_sum / (_nbits - _zeros);
+                _code.trailer_mark = _body_end < _frame_len ? _timings[_body_end] : 0;
+                _code.nbits = _nbits;
+                _code.bits = _bits;
+                _expanded.load(&_code);
+                _idx = 0;
+                _phase = VERIFY;
+            }
+            break;
+
+        case VERIFY:
+            for (; _idx < _frame_len && _idx < end; _idx++) {
+                if (!_near(_expanded.at(_idx), _timings[_idx])) {
+                    _phase = FAILED;
+                    return false;
+                }
+            }
+            if (_idx >= _frame_len) {
+                _matchProtocol();
+                _phase = DONE;
+            }
+            break;
+
+        default:
+            break;
+        }
+
+        return _phase != DONE && _phase != FAILED && _phase != IDLE;
+    };
+
+    Phase getPhase() const {
+        return _phase;
+    };
+
+    // valid once DONE
+    const IrCode &getCode() const {
+        return _code;
+    };
+
+    // "kaseikyo", "nec", or 0 if the timings match no known protocol
+    const char *getProtocol() const {
+        return _protocol;
+    };
+
+    // identical frames after the first one
+    uint8_t getRepeats() const {
+        return _repeats;
+    };
+
+    // timings of the first frame
+    uint16_t getFrameLength() const {
+        return _frame_len;
+    };
+
+private:
+    const uint16_t *_timings;
+    uint16_t _len;
+    Phase _phase;
+    uint16_t _idx;
+
+    uint16_t _frame_len;
+    uint16_t _next_frame;
+    uint8_t _repeats;
+
+    uint16_t _body_end;
+    uint32_t _mark_sum;
+    uint16_t _space_min;
+    uint16_t _space_max;
+    uint16_t _threshold;
+    uint32_t _zero_sum;
+    uint32_t _one_sum;
+    uint16_t _zeros;
+    uint16_t _nbits;
+    uint8_t _bits[IR_CODE_MAX_BYTES];
+
+    IrCode _code;
+    IrCodeTimings _expanded;
+    const char *_protocol;
+
+    void _startMeasure() {
+        // an odd frame length ends with a trailing mark
+        _body_end = _frame_len & 1 ? _frame_len - 1 : _frame_len;
+        _mark_sum = 0;
+        _space_min = 0xFFFF;
+        _space_max = 0;
+        _idx = 2;
+        _phase = _body_end >= 4 ? MEASURE : FAILED;
+    };
+
+    static bool _near(uint32_t value, uint32_t expected) {
+        auto diff = value > expected ? value - expected : expected - value;
+        return diff * 100 <= expected * IR_LEARN_TOLERANCE_PCT;
+    };
+
+    void _matchProtocol() {
+        static const struct {
+            const char *name;
+            const IrProtocol *protocol;
+        } known[] = {
+            { "kaseikyo", &IR_KASEIKYO },
+            { "nec", &IR_NEC }
+        };
+
+        _protocol = 0;
+        for (auto &k : known) {
+            auto p = k.protocol;
+            if (_near(_code.header_mark, p->header_mark) && _near(_code.header_space, p->header_space) &&
+                _near(_code.bit_mark, p->bit_mark) && _near(_code.zero_space, p->zero_space) &&
+                _near(_code.one_space, p->one_space)) {
+                _protocol = k.name;
+                _code.hz = p->hz;
+                return;
+            }
+        }
+    };
+};
+
+// Receiver side of the learner. `read()` returns the next complete capture
+// as mark/space durations in microseconds, or 0 if there is none yet.
+class IrRecvBackend {
+public:
+    virtual void enable() = 0;
+    virtual void disable() = 0;
+    virtual uint16_t read(uint16_t *timings, uint16_t max) = 0;
+};
+
+// IR learning mode: listens for one remote command, then decodes it from
+// loop() one slice at a time. The result is printed as a device profile
+// fragment (see profiles.h), ready to be saved.
+class IrLearner {
+public:
+    typedef enum {
+        IDLE = 0,
+        LISTENING,
+        DECODING,
+        DONE,
+        FAILED,
+        TIMEOUT
+    } State;
+
+    IrLearner(IrRecvBackend &backend) : _backend(backend), _state(IDLE), _len(0), _started_at(0), _timeout_ms(0) {
+    };
+
+    void start(uint32_t timeout_ms) {
+        DEBUG_LOG_LN("[IRLEARN] Listening...");
+
+        _len = 0;
+        _started_at = millis();
+        _timeout_ms = timeout_ms;
+        _state = LISTENING;
+        _backend.enable();
+    };
+
+    void stop() {
+        if (_state == LISTENING) {
+            _backend.disable();
+            _state = IDLE;
+        }
+    };
+
+    State getState() const {
+        return _state;
+    };
+
+    void loop() {
+        switch (_state) {
+        case LISTENING:
+            _len = _backend.read(_timings, IR_LEARN_MAX_TIMINGS);
+            if (_len) {
+                _backend.disable();
+                _decoder.begin(_timings, _len);
+                _state = DECODING;
+            } else if (millis() - _started_at > _timeout_ms) {
+                DEBUG_LOG_LN("[IRLEARN] Timeout.");
+                _backend.disable();
+                _state = TIMEOUT;
+            }
+            break;
+
+        case DECODING:
+            if (!_decoder.step()) {
+                _state = _decoder.getPhase() == IrLearnDecoder::DONE ? DONE : FAILED;
+                DEBUG_LOG("[IRLEARN] Captured "); DEBUG_LOG(_len);
+                DEBUG_LOG_LN(_state == DONE ? " timings, decoded." : " timings, not pulse-distance.");
+            }
+            break;
+
+        default:
+            break;
+        }
+    };
+
+    // {"state":"done","repeats":..,"protocol":..,"hz":..,"timing":[..],"bits":..,"code":".."}
+    // or for a failed decode {"state":"failed","raw":[..]} with the first frame
+    void printTo(Print &out) const {
+        static const char *states[] = {
+            "idle", "listening", "decoding", "done", "failed", "timeout"
+        };
+
+        out.print("{\"state\":\""); out.print(states[_state]); out.print('"');
+
+        if (_state == DONE) {
+            auto &code = _decoder.getCode();
+
+            out.print(",\"repeats\":"); out.print(_decoder.getRepeats());
+            if (_decoder.getProtocol()) {
+                out.print(",\"protocol\":\""); out.print(_decoder.getProtocol()); out.print('"');
+            }
+            out.print(",\"hz\":"); out.print(code.hz);
+            out.print(",\"timing\":[");
+            out.print(code.header_mark); out.print(',');
+            out.print(code.header_space); out.print(',');
+            out.print(code.bit_mark); out.print(',');
+            out.print(code.zero_space); out.print(',');
+            out.print(code.one_space); out.print(',');
+            out.print(code.trailer_mark);
+            out.print("],\"bits\":"); out.print(code.nbits);
+            out.print(",\"code\":\"");
+            for (uint16_t i = 0; i < (code.nbits + 7) / 8; i++) {
+                if (code.bits[i] < 0x10) out.print('0');
+                out.print(code.bits[i], HEX);
+            }
+            out.print('"');
+        } else if (_state == FAILED) {
+            out.print(",\"raw\":[");
+            auto len = _decoder.getFrameLength();
+            for (uint16_t i = 0; i < len; i++) {
+                if (i) out.print(',');
+                out.print(_timings[i]);
+            }
+            out.print(']');
+        }
+
+        out.print('}');
+    };
+
+private:
+    IrRecvBackend &_backend;
+    State _state;
+
+    uint16_t _timings[IR_LEARN_MAX_TIMINGS];
+    uint16_t _len;
+    IrLearnDecoder _decoder;
+
+    unsigned long _started_at;
+    uint32_t _timeout_ms;
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "DebugLog.h"
+#include "ircode.h"
+#include "irtx.h"
+
+// frames of a macro queued ahead of the one on air
+#ifndef IR_MACRO_PIPELINE
+    #define IR_MACRO_PIPELINE (2)
+#endif
+
+// step repeat taken from the parameter given to `play()`
+#define IR_MACRO_PARAM (0)
+
+// Send `code` `repeat` times, each followed by `gap_ms` of silence.
+struct IrMacroStep {
+    const IrCode *code;
+    uint8_t repeat;
+    uint16_t gap_ms;
+};
+
+// A named sequence of steps. A step with IR_MACRO_PARAM is repeated as many
+// times as the parameter given to `play()`, e.g. for a device with step
+// buttons, N presses from a known baseline (`mute` and `volumeUp` being its
+// IrCodes):
+//
+//   static const IrMacroStep volumeSteps[] = {
+//       { &mute, 1, 100 },
+//       { &volumeUp, IR_MACRO_PARAM, 150 }
+//   };
+//   static const IrMacro volume = { "volume", volumeSteps, 2 };
+//
+//   player.play(volume, 3);
+struct IrMacro {
+    const char *name;
+    const IrMacroStep *steps;
+    uint8_t len;
+};
+
+// Plays one macro at a time through the transmitter. Frames are fed from
+// loop() so that IR_MACRO_PIPELINE of them wait in the queue: the timer
+// starts each one right after the gap of the previous, and the rest of
+// the queue stays free for other devices.
+//
+// Each play is tagged with a new generation; playing again cancels the
+// queued frames of the previous generation, so a new command pre-empts a
+// half-finished macro between two frames.
+class IrMacroPlayer {
+public:
+    IrMacroPlayer(IrTransmitter &irtx) : _irtx(irtx), _macro(0), _generation(0) {
+    };
+
+    void play(const IrMacro &macro, uint8_t param = 0) {
+        stop();
+
+        DEBUG_LOG("[MACRO] Play <"); DEBUG_LOG(macro.name);
+        DEBUG_LOG(">, param: "); DEBUG_LOG_LN(param);
+
+        _generation = _nextGeneration();
+        _macro = &macro;
+        _param = param;
+        _step = 0;
+        _sent = 0;
+
+        _feed();
+    };
+
+    void stop() {
+        if (!_generation) return;
+
+        auto cancelled = _irtx.cancel(_generation);
+        if (_macro && cancelled) {
+            DEBUG_LOG("[MACRO] Pre-empted <"); DEBUG_LOG(_macro->name);
+            DEBUG_LOG(">, frames cancelled: "); DEBUG_LOG_LN(cancelled);
+        }
+        _macro = 0;
+    };
+
+    // still feeding frames, or some of them wait in the queue
+    bool isPlaying() {
+        return _macro || (_generation && _irtx.pending(_generation));
+    };
+
+    void loop() {
+        if (_macro) _feed();
+    };
+
+private:
+    IrTransmitter &_irtx;
+
+    const IrMacro *_macro;
+    uint8_t _param;
+    uint8_t _step;
+    uint8_t _sent; // frames of the current step
+    uint8_t _generation;
+
+    // shared by all players, so their tags never collide; 0 is untagged
+    inline static uint8_t _last_generation = 0;
+
+    static uint8_t _nextGeneration() {
+        if (++_last_generation == 0) _last_generation = 1;
+        return _last_generation;
+    };
+
+    void _feed() {
+        while (_macro && _irtx.pending(_generation) < IR_MACRO_PIPELINE) {
+            if (_step >= _macro->len) {
+                _macro = 0;
+                break;
+            }
+
+            auto &step = _macro->steps[_step];
+            uint8_t repeat = step.repeat == IR_MACRO_PARAM ? _param : step.repeat;
+            if (_sent >= repeat) {
+                _step++;
+                _sent = 0;
+                continue;
+            }
+
+            if (_irtx.isFull()) break; // retry on the next loop
+
+            _irtx.send(step.code, step.gap_ms, _generation);
+            _sent++;
+        }
+    };
+};
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "ircode.h"
+
+// Pulse-distance protocols: the timings of a family plus constexpr encoders
+// that build the bits of a command from its fields, so a command costs a
+// few bytes of flash and can be derived instead of captured:
+//
+//   static constexpr IrBits<5> onBits PROGMEM = kaseikyo40(0x522C, 0, 0x2D);
+//   static constexpr IrCode on PROGMEM = irCode(IR_KASEIKYO, onBits);
+//
+// Declare them constexpr: flash can't take a dynamic initialization. Bits
+// are LSB first, as IrCode sends them.
+struct IrProtocol {
+    uint16_t hz;
+    uint16_t header_mark;
+    uint16_t header_space;
+    uint16_t bit_mark;
+    uint16_t zero_space;
+    uint16_t one_space;
+    uint16_t trailer_mark;
+    uint16_t gap_ms; // silence between two frames
+};
+
+// Panasonic and other Kaseikyo ("Japanese format") vendors; frames start
+// every 130ms. The carrier is Panasonic's 36.7kHz, rounded: codes that were
+// captured and sent at the usual 38kHz move to 37kHz with this, which is
+// inside the receivers' passband either way.
+constexpr IrProtocol IR_KASEIKYO = { 37000, 3456, 1728, 432, 432, 1296, 432, 74 };
+// frames start every 108ms
+constexpr IrProtocol IR_NEC = { 38000, 9000, 4500, 560, 560, 1690, 560, 40 };
+
+template <size_t N>
+struct IrBits {
+    uint8_t data[N];
+    uint16_t nbits;
+};
+
+// timings only, without bits
+constexpr IrCode irCode(const IrProtocol &protocol) {
+    return IrCode {
+        protocol.hz, protocol.header_mark, protocol.header_space,
+        protocol.bit_mark, protocol.zero_space, protocol.one_space,
+        protocol.trailer_mark, 0, 0
+    };
+}
+
+template <size_t N>
+constexpr IrCode irCode(const IrProtocol &protocol, const IrBits<N> &bits) {
+    return IrCode {
+        protocol.hz, protocol.header_mark, protocol.header_space,
+        protocol.bit_mark, protocol.zero_space, protocol.one_space,
+        protocol.trailer_mark, bits.nbits, bits.data
+    };
+}
+
+// Generic: the low `nbits` of `value`, up to 64.
+template <size_t N = 8>
+constexpr IrBits<N> irBits(uint64_t value, uint16_t nbits) {
+    IrBits<N> bits = {};
+    for (uint16_t i = 0; i < nbits && i < N * 8; i++) {
+        if ((value >> i) & 1) bits.data[i / 8] |= 1 << (i % 8);
+    }
+    bits.nbits = nbits < N * 8 ? nbits : N * 8;
+    return bits;
+}
+
+// 4-bit XOR of the vendor id nibbles, sent after the vendor id.
+constexpr uint8_t kaseikyoVendorParity(uint16_t vendor) {
+    return (vendor ^ (vendor >> 4) ^ (vendor >> 8) ^ (vendor >> 12)) & 0x0F;
+}
+
+// 48 bits: vendor id, vendor parity, genre1, genre2, 10-bit command, 2-bit
+// id, then the XOR of the three bytes after the vendor id.
+constexpr IrBits<6> kaseikyo(uint16_t vendor, uint8_t genre1, uint8_t genre2, uint16_t command, uint8_t id = 0) {
+    IrBits<6> bits = {};
+    bits.data[0] = vendor & 0xFF;
+    bits.data[1] = vendor >> 8;
+    bits.data[2] = kaseikyoVendorParity(vendor) | (genre1 & 0x0F) << 4;
+    bits.data[3] = (genre2 & 0x0F) | (command & 0x0F) << 4;
+    bits.data[4] = ((command >> 4) & 0x3F) | (id & 0x03) << 6;
+    bits.data[5] = bits.data[2] ^ bits.data[3] ^ bits.data[4];
+    bits.nbits = 48;
+    return bits;
+}
+
+// The 40-bit variant used by some Panasonic lights: vendor id, vendor
+// parity and genre, one command byte, then the XOR of the last two bytes.
+constexpr IrBits<5> kaseikyo40(uint16_t vendor, uint8_t genre, uint8_t command) {
+    IrBits<5> bits = {};
+    bits.data[0] = vendor & 0xFF;
+    bits.data[1] = vendor >> 8;
+    bits.data[2] = kaseikyoVendorParity(vendor) | (genre & 0x0F) << 4;
+    bits.data[3] = command;
+    bits.data[4] = bits.data[2] ^ bits.data[3];
+    bits.nbits = 40;
+    return bits;
+}
+
+// 32 bits: address and command, each followed by its inverse; addresses
+// above 0xFF are sent as 16 bits (extended NEC).
+constexpr IrBits<4> nec(uint16_t address, uint8_t command) {
+    IrBits<4> bits = {};
+    bits.data[0] = address & 0xFF;
+    bits.data[1] = address > 0xFF ? address >> 8 : ~address & 0xFF;
+    bits.data[2] = command;
+    bits.data[3] = ~command & 0xFF;
+    bits.nbits = 32;
+    return bits;
+}
+
+// Protocol timings by name, for device profiles.
+inline const IrProtocol *irProtocol(const char *name) {
+    if (strcmp(name, "kaseikyo") == 0) return &IR_KASEIKYO;
+    if (strcmp(name, "nec") == 0) return &IR_NEC;
+    return 0;
+}
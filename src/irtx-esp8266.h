@@ -0,0 +1,111 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "irtx.h"
+
+// cycles kept between now and a timer0 compare, so it is never set in the past
+#ifndef IR_TX_MIN_TIMER_CYCLES
+    #define IR_TX_MIN_TIMER_CYCLES (microsecondsToClockCycles(2))
+#endif
+
+// Carrier and edges both from timer0. During a mark the interrupt also
+// fires on every carrier edge and flips the pin through the GPIO set/clear
+// registers, so nothing it runs leaves IRAM or waits; the core waveform
+// generator can't be used here, startWaveform() is not safe from an ISR.
+// The pin must be one of GPIO0-15.
+class Esp8266IrTxBackend : public IrTxBackend {
+public:
+    Esp8266IrTxBackend(uint8_t pin, uint8_t on_val = HIGH)
+        : _mask(1UL << pin), _on_val(on_val), _carrier(false), _level(false),
+          _period(0), _high(0), _edge_at(0), _due(0) {
+    };
+
+    virtual void begin(TickFn fn, void *arg) override {
+        _fn = fn;
+        _arg = arg;
+        _instance = this;
+
+        pinMode(__builtin_ctz(_mask), OUTPUT);
+        _set(false);
+
+        timer0_isr_init();
+        timer0_attachInterrupt(_timer0_isr);
+    };
+
+    virtual void IRAM_ATTR mark(uint16_t hz, uint32_t) override {
+        _period = clockCyclesPerMicrosecond() * 1000000UL / hz;
+        _high = _period / 3; // 33% duty cycle
+
+        _carrier = true;
+        _set(true);
+        _edge_at = ESP.getCycleCount() + _high;
+    };
+
+    virtual void IRAM_ATTR space() override {
+        _carrier = false;
+        _set(false);
+    };
+
+    virtual void IRAM_ATTR arm(uint32_t us) override {
+        _due = ESP.getCycleCount() + microsecondsToClockCycles(us);
+        _schedule();
+    };
+
+    virtual uint32_t IRAM_ATTR now() override {
+        return micros();
+    };
+
+private:
+    uint32_t _mask;
+    uint8_t _on_val;
+
+    volatile bool _carrier;
+    bool _level;
+    uint32_t _period; // carrier, in CPU cycles
+    uint32_t _high;
+    uint32_t _edge_at;
+    uint32_t _due;    // of the next tick
+
+    inline static TickFn _fn = 0;
+    inline static void *_arg = 0;
+    inline static Esp8266IrTxBackend *_instance = 0;
+
+    void IRAM_ATTR _set(bool on) {
+        _level = on;
+        if (on == (_on_val == HIGH)) {
+            GPOS = _mask;
+        } else {
+            GPOC = _mask;
+        }
+    };
+
+    // the earlier of the next carrier edge and the next tick
+    void IRAM_ATTR _schedule() {
+        uint32_t next = _carrier && (int32_t)(_edge_at - _due) < 0 ? _edge_at : _due;
+
+        uint32_t earliest = ESP.getCycleCount() + IR_TX_MIN_TIMER_CYCLES;
+        if ((int32_t)(next - earliest) < 0) next = earliest;
+        timer0_write(next);
+    };
+
+    void IRAM_ATTR _onTimer() {
+        if ((int32_t)(ESP.getCycleCount() - _due) >= 0) {
+            _fn(_arg); // marks, spaces and re-arms, or leaves the timer idle
+            return;
+        }
+
+        // carrier edge. Interrupt latency is absorbed by the next edge, which
+        // keeps the frequency; after a missed phase it resyncs instead.
+        uint32_t now = ESP.getCycleCount();
+        if ((int32_t)(now - _edge_at) > (int32_t)_high) _edge_at = now;
+
+        _set(!_level);
+        _edge_at += _level ? _high : _period - _high;
+        _schedule();
+    };
+
+    static void IRAM_ATTR _timer0_isr() {
+        _instance->_onTimer();
+    };
+};
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "DebugLog.h"
+#include "ircode.h"
+#include "metrics.h"
+
+#ifndef IR_TX_QUEUE_LEN
+    #define IR_TX_QUEUE_LEN (8)
+#endif
+
+// One IR frame: alternating mark/space durations in microseconds, starting with a mark.
+struct IrFrame {
+    const uint16_t *timings;
+    uint16_t len;
+    uint16_t hz;
+    uint16_t gap_ms; // silence after the frame, before the next one starts
+};
+
+struct IrTxStats {
+    uint32_t frames;
+    uint32_t dropped;
+    uint32_t cancelled;
+    uint32_t last_queue_us;
+    uint32_t max_queue_us;
+    uint32_t last_tx_us;
+    uint32_t max_tx_us;
+};
+
+// Pin/timer backend of the transmitter. `arm()` must call the tick function
+// given to `begin()` once the delay has elapsed.
+class IrTxBackend {
+public:
+    typedef void (*TickFn)(void *arg);
+
+    virtual void begin(TickFn fn, void *arg) = 0;
+    virtual void mark(uint16_t hz, uint32_t us) = 0;
+    virtual void space() = 0;
+    virtual void arm(uint32_t us) = 0;
+    virtual uint32_t now() = 0;
+};
+
+// Queued IR transmitter. `send()` only enqueues the frame and returns at once,
+// the marks and spaces are emitted from the backend timer.
+class IrTransmitter {
+public:
+    IrTransmitter(IrTxBackend &backend)
+        : _backend(backend), _head(0), _tail(0), _phase(IDLE), _idx(0), _reported(0) {
+        memset((void *)&_stats, 0, sizeof(_stats));
+    };
+
+    void begin() {
+        _backend.begin(_tick, this);
+    };
+
+    bool send(const IrFrame &frame) {
+        if (frame.len == 0) return false;
+
+        auto slot = _reserve();
+        if (!slot) return false;
+
+        slot->frame = frame;
+        slot->tag = 0;
+        _commit();
+
+        return true;
+    };
+
+    // Sends a pulse-distance code, in PROGMEM or RAM. It is copied, so the
+    // code may go away once this returns. A nonzero `tag` lets the sender
+    // count and cancel its own queued frames.
+    bool send(const IrCode *code, uint16_t gap_ms = 0, uint8_t tag = 0) {
+        auto slot = _reserve();
+        if (!slot) return false;
+
+        if (!slot->code.load(code)) {
+            _stats.dropped++;
+            DEBUG_LOG_LN("[IRTX] Code too long, dropped.");
+            return false;
+        }
+
+        slot->frame.timings = 0;
+        slot->frame.len = slot->code.length();
+        slot->frame.hz = slot->code.hz();
+        slot->frame.gap_ms = gap_ms;
+        slot->tag = tag;
+        _commit();
+
+        return true;
+    };
+
+    // Frames with `tag` still waiting in the queue, not counting the one on air.
+    uint8_t pending(uint8_t tag) {
+        uint8_t count = 0;
+        noInterrupts();
+        for (uint8_t i = _head; i != _tail; i = (i + 1) % IR_TX_QUEUE_LEN) {
+            if (_queue[i].tag == tag && _queue[i].frame.len) count++;
+        }
+        interrupts();
+        return count;
+    };
+
+    // Drops the queued frames with `tag`. The frame on air is finished, so
+    // the receiver never sees half a code; its gap still applies.
+    uint8_t cancel(uint8_t tag) {
+        uint8_t count = 0;
+        noInterrupts();
+        for (uint8_t i = _head; i != _tail; i = (i + 1) % IR_TX_QUEUE_LEN) {
+            if (_queue[i].tag == tag && _queue[i].frame.len) {
+                _queue[i].frame.len = 0; // skipped by the timer
+                count++;
+            }
+        }
+        _stats.cancelled += count;
+        interrupts();
+        return count;
+    };
+
+    bool isFull() {
+        return (_tail + 1) % IR_TX_QUEUE_LEN == _head;
+    };
+
+    bool isIdle() {
+        return _phase == IDLE;
+    };
+
+    IrTxStats getStats() {
+        IrTxStats stats;
+        noInterrupts();
+        memcpy(&stats, (const void *)&_stats, sizeof(stats));
+        interrupts();
+        return stats;
+    };
+
+    void loop() {
+#ifdef ENABLE_DEBUG_LOG
+        if (_reported != _stats.frames) {
+            _reported = _stats.frames;
+
+            DEBUG_LOG("[IRTX] Frame sent, queue: ");
+            DEBUG_LOG(_stats.last_queue_us);
+            DEBUG_LOG("us, tx: ");
+            DEBUG_LOG(_stats.last_tx_us);
+            DEBUG_LOG_LN("us");
+        }
+#endif // ENABLE_DEBUG_LOG
+    };
+
+private:
+    typedef enum {
+        IDLE = 0,
+        STARTING,
+        SENDING,
+        GAP
+    } Phase;
+
+    struct Slot {
+        IrFrame frame; // no timings: expanded from `code`
+        IrCodeTimings code;
+        uint32_t queued_at;
+        uint8_t tag;
+    };
+
+    IrTxBackend &_backend;
+
+    Slot _queue[IR_TX_QUEUE_LEN];
+    volatile uint8_t _head;
+    volatile uint8_t _tail;
+
+    volatile Phase _phase;
+    IrFrame _current;
+    IrCodeTimings _current_code;
+    uint16_t _idx;
+    uint32_t _started_at;
+
+    volatile IrTxStats _stats;
+    uint32_t _reported;
+
+    Slot *_reserve() {
+        uint8_t next = (_tail + 1) % IR_TX_QUEUE_LEN;
+        if (next == _head) {
+            _stats.dropped++;
+            DEBUG_LOG_LN("[IRTX] Queue full, frame dropped.");
+            return 0;
+        }
+        return &_queue[_tail];
+    };
+
+    void _commit() {
+        _queue[_tail].queued_at = _backend.now();
+        _tail = (_tail + 1) % IR_TX_QUEUE_LEN;
+
+        if (_phase == IDLE) {
+            _phase = STARTING;
+            _backend.arm(1);
+        }
+    };
+
+    static void IRAM_ATTR _tick(void *arg) {
+        static_cast<IrTransmitter *>(arg)->_step();
+    };
+
+    void IRAM_ATTR _step() {
+        auto now = _backend.now();
+
+        if (_phase == SENDING && _idx >= _current.len) {
+            // frame done
+            _backend.space();
+
+            auto tx = now - _started_at;
+            _stats.last_tx_us = tx;
+            if (tx > _stats.max_tx_us) _stats.max_tx_us = tx;
+            _stats.frames++;
+
+            Metrics::record(METRIC_IR_TX, tx);
+
+            // without a gap, the next frame starts right away
+            _phase = GAP;
+            if (_current.gap_ms) {
+                _backend.arm(_current.gap_ms * 1000UL);
+                return;
+            }
+        }
+
+        if (_phase != SENDING) {
+            // cancelled frames
+            while (_head != _tail && !_queue[_head].frame.len) {
+                _head = (_head + 1) % IR_TX_QUEUE_LEN;
+            }
+
+            if (_head == _tail) {
+                _phase = IDLE;
+                return;
+            }
+
+            _current = _queue[_head].frame;
+            if (!_current.timings) _current_code = _queue[_head].code;
+            auto queued = now - _queue[_head].queued_at;
+            _head = (_head + 1) % IR_TX_QUEUE_LEN;
+
+            _stats.last_queue_us = queued;
+            if (queued > _stats.max_queue_us) _stats.max_queue_us = queued;
+
+            _phase = SENDING;
+            _idx = 0;
+            _started_at = now;
+        }
+
+        uint32_t duration = _current.timings ? _current.timings[_idx] : _current_code.at(_idx);
+        if (_idx & 1) {
+            _backend.space();
+        } else {
+            _backend.mark(_current.hz, duration);
+        }
+        _idx++;
+
+        _backend.arm(duration);
+    };
+};
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "devices.h"
+#include "scheduler.h"
+
+// Higher layers hide the lower ones while they show a pattern.
+typedef enum {
+    LED_LAYER_DEVICE = 0,
+    LED_LAYER_CONNECTIVITY,
+    LED_LAYER_PROVISIONING,
+    LED_LAYER_ALERT,
+    LED_LAYER_COUNT
+} LedLayer;
+
+struct LedStep {
+    uint8_t level; // brightness, 0-255
+    uint16_t ms;
+};
+
+// Steps are played in a loop; a single step is a steady level.
+struct LedPattern {
+    const LedStep *steps;
+    uint8_t len;
+};
+
+// Plays the pattern of the topmost active layer on a PWM pin. The step
+// timer only runs while that pattern has more than one step.
+class LedSequencer {
+public:
+    static const uint8_t PIN_NONE = 255;
+
+    LedSequencer() : _pin(PIN_NONE), _on_val(HIGH), _top(LED_LAYER_COUNT), _shown(0), _step(0), _task(TASK_NONE) {
+        memset(_patterns, 0, sizeof(_patterns));
+        memset(_steady, 0, sizeof(_steady));
+        for (int i = 0; i < LED_LAYER_COUNT; i++) {
+            _layers[i]._seq = this;
+            _layers[i]._layer = (LedLayer)i;
+        }
+    };
+
+    void begin(uint8_t pin, uint8_t on_val = HIGH) {
+        _pin = pin;
+        _on_val = on_val;
+
+        pinMode(_pin, OUTPUT);
+        analogWriteRange(255);
+        _top = LED_LAYER_COUNT;
+        _update();
+    };
+
+    void set(LedLayer layer, const LedPattern &pattern) {
+        _patterns[layer] = pattern;
+        _update();
+    };
+
+    void set(LedLayer layer, uint8_t level) {
+        _steady[layer].level = level;
+        _patterns[layer].steps = &_steady[layer];
+        _patterns[layer].len = 1;
+        _update();
+    };
+
+    void clear(LedLayer layer) {
+        _patterns[layer].steps = 0;
+        _patterns[layer].len = 0;
+        _update();
+    };
+
+    // The device-facing handle of a layer.
+    Led *getLed(LedLayer layer) {
+        return &_layers[layer];
+    };
+
+private:
+    class Layer : public Led {
+    public:
+        virtual void on() override {
+            _seq->set(_layer, (uint8_t)255);
+        };
+
+        virtual void off() override {
+            _seq->set(_layer, (uint8_t)0);
+        };
+
+        virtual void level(uint8_t level) override {
+            _seq->set(_layer, level);
+        };
+
+        virtual void release() override {
+            _seq->clear(_layer);
+        };
+
+    private:
+        friend class LedSequencer;
+
+        LedSequencer *_seq;
+        LedLayer _layer;
+    };
+
+    uint8_t _pin;
+    uint8_t _on_val;
+
+    LedPattern _patterns[LED_LAYER_COUNT];
+    LedStep _steady[LED_LAYER_COUNT];
+    Layer _layers[LED_LAYER_COUNT];
+
+    uint8_t _top;          // layer being shown, LED_LAYER_COUNT for none
+    const LedStep *_shown; // its steps, to tell a new pattern from a repeated set()
+    uint8_t _step;
+    TaskId _task;
+
+    void _update() {
+        uint8_t top = LED_LAYER_COUNT;
+        for (int i = LED_LAYER_COUNT - 1; i >= 0; i--) {
+            if (_patterns[i].len) {
+                top = i;
+                break;
+            }
+        }
+
+        bool restart = top != _top || (top < LED_LAYER_COUNT && _patterns[top].steps != _shown);
+        bool steady = top == LED_LAYER_COUNT || _patterns[top].len == 1;
+
+        // steady levels may change under the same steps
+        if (!restart && !steady) return;
+
+        _top = top;
+        _shown = top < LED_LAYER_COUNT ? _patterns[top].steps : 0;
+        _step = 0;
+
+        Scheduler::cancel(_task);
+        _task = TASK_NONE;
+        _play();
+    };
+
+    void _play() {
+        if (_top == LED_LAYER_COUNT) {
+            _write(0);
+            return;
+        }
+
+        auto &pattern = _patterns[_top];
+        auto &step = pattern.steps[_step];
+        _write(step.level);
+
+        if (pattern.len > 1) {
+            _task = Scheduler::after("led", step.ms, _next, this);
+        }
+    };
+
+    static void _next(void *arg) {
+        auto self = static_cast<LedSequencer *>(arg);
+        self->_task = TASK_NONE;
+        self->_step = (self->_step + 1) % self->_patterns[self->_top].len;
+        self->_play();
+    };
+
+    void _write(uint8_t level) {
+        if (_pin == PIN_NONE) return;
+
+        analogWrite(_pin, _on_val == HIGH ? level : 255 - level);
+    };
+};
@@ -1,10 +1,22 @@
 #include <Arduino.h>
+#include <LittleFS.h>
 
 #include "DebugLog.h"
 
 #include "ESP8266Boot.h"
 #include "bemfa.h"
+#include "coalescer.h"
 #include "httpd.h"
+#include "irtx.h"
+#include "irtx-esp8266.h"
+#include "irmacro.h"
+#include "irlearn.h"
+#include "irlearn-esp8266.h"
+#include "heapprof.h"
+#include "metrics.h"
+#include "profiles.h"
+#include "statestore.h"
+#include "scheduler.h"
 
 #include "hw.h"
 #include "bemfa.inc"
@@ -21,6 +33,18 @@ BemfaMqtt bemfaMqtt(bemfa_mqtt_server, bemfa_mqtt_port, bemfa_mqtt_client_id);
 
 Httpd httpd(80);
 
+static Esp8266IrTxBackend irTxBackend(IR_LED_PIN);
+IrTransmitter irTransmitter(irTxBackend);
+IrMacroPlayer lightPlayer(irTransmitter);
+
+StateStore stateStore;
+DeviceProfiles deviceProfiles(bemfaMqtt, irTransmitter, stateStore);
+
+#ifdef IR_RECV_PIN
+static Esp8266IrRecvBackend irRecvBackend(IR_RECV_PIN);
+IrLearner irLearner(irRecvBackend);
+#endif
+
 static String hostname;
 
 void setup() {
@@ -28,15 +52,42 @@ void setup() {
 
     hostname = "XE" + String(ESP.getChipId(), DEC);
 
+    // Init IR transmitter
+    irTransmitter.begin();
+
+    // Restore the device states before anything subscribes
+    LittleFS.begin();
+    stateStore.begin(LittleFS, "/state.log");
+    bemfaMqtt.onStateChange([](const StrView &topic, const StrView &msg) {
+        stateStore.set(topic, msg);
+    });
+
     // Init bemfaMqtt
-    register_panasonic_light_01_handler(bemfaMqtt, hostname, boot.getLed());
+    register_panasonic_light_01_handler(bemfaMqtt, lightPlayer, stateStore, hostname, boot.getLed());
+
+    deviceProfiles.begin(LittleFS, "/devices.json", hostname);
 
     bemfaMqtt.begin();
 
     // Init httpd
+#ifdef IR_RECV_PIN
+    httpd.setLearner(&irLearner);
+#endif
     httpd.begin();
 
     // Init boot
+    boot.onStateChange([](ESP8266Boot::State state) {
+        char data[16];
+        snprintf(data, sizeof(data), "{\"state\":%d}", (int)state);
+        httpd.pushEvent("boot", data);
+    });
+
+    boot.onGesture([](Gesture gesture) {
+        if (gesture == GESTURE_CLICK) {
+            toggle_panasonic_light_01();
+        }
+    });
+
     boot.setLed(LED_PIN, HIGH);
     boot.setButton(BTN_PIN);
     boot.setHostname(hostname);
@@ -45,18 +96,34 @@ void setup() {
 }
 
 void loop() {
-    boot.loop();
-    bemfaMqtt.loop();
-
-#ifdef ENABLE_DEBUG_LOG
-    static auto last_loop_at = millis();
+    static auto last_loop_at = micros();
 
-    auto now = millis();
+    auto now = micros();
     auto duration = now - last_loop_at;
-    if (duration >= 100) {
+    last_loop_at = now;
+
+    Metrics::record(METRIC_LOOP, duration);
+
+#ifdef ENABLE_DEBUG_LOG
+    if (duration >= 100000) {
         DEBUG_LOG("WARN: loop duration ");
-        DEBUG_LOG_LN(duration);
+        DEBUG_LOG_LN(duration / 1000);
     }
-    last_loop_at = now;
 #endif // ENABLE_DEBUG_LOG
+
+    {
+        MetricScope scope(METRIC_BOOT_LOOP);
+        HeapTagScope heapTag(HEAP_TAG_BOOT);
+        boot.loop();
+    }
+
+    Scheduler::loop();
+    bemfaMqtt.loop();
+    irTransmitter.loop();
+    lightPlayer.loop();
+#ifdef IR_RECV_PIN
+    irLearner.loop();
+#endif
+    CoalescerBase::loopAll();
+    HeapProf::loop();
 }
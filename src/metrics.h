@@ -0,0 +1,143 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Always-on latency histograms. Bucket 0 counts 0us, bucket i counts
+// [2^(i-1), 2^i) us, and the last bucket everything above.
+#define METRIC_BUCKETS (21)
+
+typedef enum {
+    METRIC_LOOP = 0,
+    METRIC_BOOT_LOOP,
+    METRIC_MQTT_DISPATCH,
+    METRIC_IR_TX,
+    METRIC_HTTP_VERSION,
+    METRIC_HTTP_STATUS,
+    METRIC_HTTP_METRICS,
+    METRIC_HTTP_HEAP,
+    METRIC_HTTP_DEVICES,
+    METRIC_HTTP_LEARN,
+    METRIC_HTTP_STATIC,
+    METRIC_TASK_LATE,
+    METRIC_TASK_RUN,
+    METRIC_COUNT
+} Metric;
+
+// Milliseconds since boot at which a startup milestone was first reached.
+typedef enum {
+    BOOT_WIFI_READY = 0,
+    BOOT_MQTT_SUBSCRIBED,
+    BOOT_MARK_COUNT
+} BootMark;
+
+struct LatencyHistogram {
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t sum_us;
+    uint32_t buckets[METRIC_BUCKETS];
+};
+
+class Metrics {
+public:
+    static void IRAM_ATTR record(Metric metric, uint32_t us) {
+        auto &h = _histograms[metric];
+
+        uint8_t bucket = us ? 32 - __builtin_clz(us) : 0;
+        if (bucket >= METRIC_BUCKETS) bucket = METRIC_BUCKETS - 1;
+
+        h.buckets[bucket]++;
+        h.count++;
+        h.sum_us += us;
+        if (us > h.max_us) h.max_us = us;
+    };
+
+    // Only the first time counts; later reconnects don't move the mark.
+    static void mark(BootMark mark) {
+        if (!_marks[mark]) _marks[mark] = millis() ? millis() : 1;
+    };
+
+    static uint32_t getMark(BootMark mark) {
+        return _marks[mark];
+    };
+
+    // How Wi-Fi came up the first time, e.g. "fast" or "scan".
+    static void setWiFiConnect(const char *kind) {
+        if (!_marks[BOOT_WIFI_READY]) _wifi_connect = kind;
+    };
+
+    static const LatencyHistogram &get(Metric metric) {
+        return _histograms[metric];
+    };
+
+    static const char *name(Metric metric) {
+        static const char *names[METRIC_COUNT] = {
+            "loop", "bootLoop", "mqttDispatch", "irTx",
+            "httpVersion", "httpStatus", "httpMetrics", "httpHeap",
+            "httpDevices", "httpLearn", "httpStatic",
+            "taskLate", "taskRun"
+        };
+        return names[metric];
+    };
+
+    // {"wifiConnect":"..","wifiReady":..,"mqttSubscribed":..}, 0 if not reached yet
+    static void printBootTo(Print &out) {
+        static const char *names[BOOT_MARK_COUNT] = {
+            "wifiReady", "mqttSubscribed"
+        };
+
+        out.print("{\"wifiConnect\":\""); out.print(_wifi_connect);
+        out.print('"');
+        for (int m = 0; m < BOOT_MARK_COUNT; m++) {
+            out.print(",\""); out.print(names[m]);
+            out.print("\":"); out.print(_marks[m]);
+        }
+        out.print('}');
+    };
+
+    // {"<name>":{"n":..,"max":..,"sum":..,"b":[..]},...}, trailing empty buckets omitted
+    static void printTo(Print &out) {
+        out.print('{');
+        for (int m = 0; m < METRIC_COUNT; m++) {
+            LatencyHistogram h;
+            noInterrupts(); // irTx is recorded from the timer interrupt
+            memcpy(&h, &_histograms[m], sizeof(h));
+            interrupts();
+
+            int last = METRIC_BUCKETS - 1;
+            while (last >= 0 && h.buckets[last] == 0) last--;
+
+            if (m) out.print(',');
+            out.print('"'); out.print(name((Metric)m));
+            out.print("\":{\"n\":"); out.print(h.count);
+            out.print(",\"max\":"); out.print(h.max_us);
+            out.print(",\"sum\":"); out.print(h.sum_us);
+            out.print(",\"b\":[");
+            for (int i = 0; i <= last; i++) {
+                if (i) out.print(',');
+                out.print(h.buckets[i]);
+            }
+            out.print("]}");
+        }
+        out.print('}');
+    };
+
+private:
+    inline static LatencyHistogram _histograms[METRIC_COUNT] = {};
+    inline static uint32_t _marks[BOOT_MARK_COUNT] = {};
+    inline static const char *_wifi_connect = "";
+};
+
+// Records the lifetime of the scope into a histogram.
+class MetricScope {
+public:
+    MetricScope(Metric metric) : _metric(metric), _start(micros()) {
+    };
+
+    ~MetricScope() {
+        Metrics::record(_metric, micros() - _start);
+    };
+
+private:
+    Metric _metric;
+    uint32_t _start;
+};
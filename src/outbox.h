@@ -0,0 +1,160 @@
+#pragma once
+
+#include <Arduino.h>
+#include <AsyncMqttClient.h>
+
+#include "DebugLog.h"
+#include "strview.h"
+
+// one entry per device state: the built-in light and every profile
+#ifndef OUTBOX_SIZE
+    #define OUTBOX_SIZE (9)
+#endif
+
+#ifndef OUTBOX_TOPIC_LEN
+    #define OUTBOX_TOPIC_LEN (48)
+#endif
+
+#ifndef OUTBOX_PAYLOAD_LEN
+    #define OUTBOX_PAYLOAD_LEN (32)
+#endif
+
+#ifndef OUTBOX_BATCH
+    #define OUTBOX_BATCH (4)
+#endif
+
+struct OutboxCounters {
+    uint32_t queued;
+    uint32_t coalesced; // replaced a value of the same topic not yet acked
+    uint32_t sent;
+    uint32_t acked;
+    uint32_t dropped;   // pool full, or topic/payload too long
+};
+
+// Retained state messages waiting for the broker. Only the latest value of
+// a topic is kept; entries stay until the QoS 1 publish is acknowledged and
+// go back to pending on disconnect, so they are replayed after reconnect.
+class MqttOutbox {
+public:
+    MqttOutbox(AsyncMqttClient &client) : _client(client) {
+        memset(_entries, 0, sizeof(_entries));
+        memset(&_counters, 0, sizeof(_counters));
+    };
+
+    bool put(const StrView &topic, const StrView &payload) {
+        if (topic.length() >= OUTBOX_TOPIC_LEN || payload.length() > OUTBOX_PAYLOAD_LEN) {
+            _counters.dropped++;
+            return false;
+        }
+
+        Entry *entry = 0;
+        for (int i = 0; i < OUTBOX_SIZE; i++) {
+            auto &e = _entries[i];
+            if (e.state != FREE && topic == e.topic) {
+                _counters.coalesced++;
+                entry = &e;
+                break;
+            }
+            if (!entry && e.state == FREE) entry = &e;
+        }
+
+        if (!entry) {
+            DEBUG_LOG_LN("[OUTBOX] Full, message dropped.");
+            _counters.dropped++;
+            return false;
+        }
+
+        if (entry->state == FREE) {
+            topic.copyTo(entry->topic, sizeof(entry->topic));
+        }
+        memcpy(entry->payload, payload.data(), payload.length());
+        entry->len = payload.length();
+        entry->state = PENDING; // an in-flight older value is superseded
+        _counters.queued++;
+
+        return true;
+    };
+
+    // Publishes up to `max` pending entries; stops when the client can't
+    // take more.
+    void flush(int max = OUTBOX_BATCH) {
+        if (!_client.connected()) return;
+
+        int batch = 0;
+        for (int i = 0; i < OUTBOX_SIZE && batch < max; i++) {
+            auto &e = _entries[i];
+            if (e.state != PENDING) continue;
+
+            auto packetId = _client.publish(e.topic, 1, true, e.payload, e.len);
+            if (packetId == 0) break;
+
+            e.state = IN_FLIGHT;
+            e.packet_id = packetId;
+            _counters.sent++;
+            batch++;
+        }
+    };
+
+    void onAck(uint16_t packetId) {
+        for (int i = 0; i < OUTBOX_SIZE; i++) {
+            auto &e = _entries[i];
+            if (e.packet_id != packetId || e.state == FREE) continue;
+
+            e.packet_id = 0;
+            _counters.acked++;
+            if (e.state == IN_FLIGHT) {
+                e.state = FREE;
+            }
+            return;
+        }
+    };
+
+    void onDisconnect() {
+        for (int i = 0; i < OUTBOX_SIZE; i++) {
+            auto &e = _entries[i];
+            if (e.state == IN_FLIGHT) {
+                e.state = PENDING;
+            }
+            e.packet_id = 0;
+        }
+    };
+
+    // Nothing left to publish; entries may still wait for their ack.
+    bool drained() const {
+        for (int i = 0; i < OUTBOX_SIZE; i++) {
+            if (_entries[i].state == PENDING) return false;
+        }
+        return true;
+    };
+
+    size_t pending() const {
+        size_t n = 0;
+        for (int i = 0; i < OUTBOX_SIZE; i++) {
+            if (_entries[i].state != FREE) n++;
+        }
+        return n;
+    };
+
+    const OutboxCounters &getCounters() const {
+        return _counters;
+    };
+
+private:
+    typedef enum {
+        FREE = 0,
+        PENDING,
+        IN_FLIGHT
+    } EntryState;
+
+    struct Entry {
+        EntryState state;
+        uint16_t packet_id;
+        uint8_t len;
+        char topic[OUTBOX_TOPIC_LEN];
+        char payload[OUTBOX_PAYLOAD_LEN];
+    };
+
+    AsyncMqttClient &_client;
+    Entry _entries[OUTBOX_SIZE];
+    OutboxCounters _counters;
+};
@@ -1,47 +1,41 @@
-#include <IRremoteESP8266.h>
-#include <IRsend.h>
-#include <Ticker.h>
-
 #include "DebugLog.h"
+#include "hw.h"
 #include "panasonic-light-01.h"
 
-#define IR_SWITCH_PIN (14)
-#define IR_LED_PIN (13)
+static IrMacroPlayer *player = 0;
 
-static IRsend irsend(IR_LED_PIN);
+// IR frames per command
+#define LIGHT_FRAMES (2)
 
-static String lastMsg;
+static char lastMsg[32] = "";
 static bool wsState = false;
 
-Ticker irSendTicker;
 static Led *led = 0;
 
-static const uint16_t rawDataLen = 83;
-static const uint16_t rawDataOff[rawDataLen] = {
-    3492, 1712, 466, 406, 464, 406, 464, 1278,
-    466, 1278, 464, 406, 464, 1278, 464, 406,
-    464, 406, 464, 406, 464, 1278, 466, 406,
-    464, 406, 464, 1278, 464, 406, 464, 1278,
-    464, 406, 464, 1278, 464, 406, 464, 406,
-    464, 1278, 464, 406, 464, 406, 464, 406,
-    464, 406, 466, 1276, 466, 1276, 466, 1278,
-    464, 1278, 464, 408, 464, 1278, 464, 406,
-    464, 406, 464, 406, 464, 1278, 464, 1278,
-    464, 408, 464, 408, 464, 1278, 464, 406,
-    464, 406, 464}; // UNKNOWN 1B9C2A92
-static const uint16_t rawDataOn[rawDataLen] = {
-    3488, 1714, 464, 408, 462, 408, 464, 1278,
-    464, 1278, 464, 408, 462, 1278, 464, 408,
-    462, 408, 464, 408, 462, 1280, 464, 408,
-    462, 408, 462, 1280, 462, 408, 462, 1278,
-    464, 408, 462, 1278, 464, 408, 462, 408,
-    462, 1278, 464, 408, 462, 408, 462, 408,
-    464, 408, 462, 1278, 464, 408, 462, 1278,
-    464, 1280, 464, 408, 462, 1280, 464, 408,
-    464, 408, 462, 408, 464, 408, 464, 1278,
-    464, 408, 462, 408, 462, 1280, 462, 408,
-    462, 408, 462}; // UNKNOWN F6B92168
-static const uint16_t sendRawInHz = 38000;
+static String lightTopic;
+
+// Fold bursts within 300ms, at most 2 commands per second
+static CommandCoalescer<bool> lightCommands("light-01", 300, 2 * LIGHT_FRAMES, LIGHT_FRAMES);
+
+// 40-bit Kaseikyo, vendor 0x522C, genre 0. The raw captures these replace
+// were sent at 38kHz, these at IR_KASEIKYO's 37kHz; test_irtx checks them
+// against the captures.
+static constexpr IrBits<5> lightOffBits PROGMEM = kaseikyo40(0x522C, 0, 0x2F);
+static constexpr IrCode lightOff PROGMEM = irCode(IR_KASEIKYO, lightOffBits);
+static constexpr IrBits<5> lightOnBits PROGMEM = kaseikyo40(0x522C, 0, 0x2D);
+static constexpr IrCode lightOn PROGMEM = irCode(IR_KASEIKYO, lightOnBits);
+
+// Send LIGHT_FRAMES times, 100ms apart. Only on and off are captured from
+// the remote, so "on#<brightness>" switches on without dimming.
+static const IrMacroStep lightOffSteps[] = {
+    { &lightOff, LIGHT_FRAMES, 100 }
+};
+static const IrMacro lightOffMacro = { "off", lightOffSteps, 1 };
+
+static const IrMacroStep lightOnSteps[] = {
+    { &lightOn, LIGHT_FRAMES, 100 }
+};
+static const IrMacro lightOnMacro = { "on", lightOnSteps, 1 };
 
 static bool switch_light(bool isOn) {
     if (wsState == isOn) {
@@ -58,47 +52,94 @@ static bool switch_light(bool isOn) {
         }
     }
 
-    // Send 2 times
-    irsend.sendRaw(wsState ? rawDataOn : rawDataOff, rawDataLen, sendRawInHz);
+    // pre-empts whatever is still being sent
+    player->play(isOn ? lightOnMacro : lightOffMacro);
 
-    irSendTicker.once_ms(100, []() {
-        irsend.sendRaw(wsState ? rawDataOn : rawDataOff, rawDataLen, sendRawInHz);
-    });
+    return true;
+}
+
+void toggle_panasonic_light_01() {
+    bool isOn = !lightCommands.getDesired(); // presses within the window undo each other
 
+    DEBUG_LOG("[LIGHT-01] Toggle: "); DEBUG_LOG_LN(isOn ? "on" : "off");
+
+    strcpy(lastMsg, isOn ? "on" : "off");
+    lightCommands.submit(isOn);
+    lightCommands.expedite();
+}
+
+// The last applied state, as its message
+static bool restore_light(const StateStore &stateStore) {
+    char msg[sizeof(lastMsg)];
+    if (!stateStore.get(StrView(lightTopic.c_str(), lightTopic.length()), msg, sizeof(msg))) {
+        return false;
+    }
+
+    BemfaCommand cmd;
+    if (!cmd.parse(StrView(msg)) || cmd.verb == BemfaCommand::OTHER) {
+        return false;
+    }
+
+    wsState = cmd.verb == BemfaCommand::ON;
+    strcpy(lastMsg, wsState ? "on" : "off");
+
+    DEBUG_LOG("[LIGHT-01] Restored: "); DEBUG_LOG_LN(lastMsg);
+
+    if (led) {
+        if (wsState) {
+            led->on();
+        } else {
+            led->off();
+        }
+    }
 
     return true;
 }
 
-void register_panasonic_light_01_handler(BemfaMqtt &bemfaMqtt, const String& topicPrefix, Led *theLed) {
+void register_panasonic_light_01_handler(BemfaMqtt &bemfaMqtt, IrMacroPlayer &thePlayer, const StateStore &stateStore, const String& topicPrefix, Led *theLed) {
     led = theLed;
+    player = &thePlayer;
 
     // init hardware
-    irsend.begin();
-
     pinMode(IR_SWITCH_PIN, OUTPUT);
     digitalWrite(IR_SWITCH_PIN, LOW);
 
     // register mqtt event
-    auto topic = topicPrefix + "x002"; // light device
-    topic.toLowerCase();
+    lightTopic = topicPrefix + "x002"; // light device
+    lightTopic.toLowerCase();
+
+    // The light kept its state over our reboot, so only the gateway's view
+    // of it is restored, and republished as the retained value.
+    if (restore_light(stateStore)) {
+        bemfaMqtt.publishState(StrView(lightTopic.c_str(), lightTopic.length()), StrView(lastMsg));
+    }
 
-    bemfaMqtt.onMessage(topic, [](const String &topic, const String &msg, AsyncMqttClient &mqttClient) {
+    lightCommands.begin(wsState, [&bemfaMqtt](const bool &state) {
+        if (switch_light(state)) {
+            bemfaMqtt.publishState(StrView(lightTopic.c_str(), lightTopic.length()), StrView(lastMsg));
+        }
+    });
+
+    bemfaMqtt.onMessage(lightTopic, [](const StrView &topic, const StrView &msg, AsyncMqttClient &mqttClient) {
         DEBUG_LOG("[LIGHT-01] OnMessage: <");
         DEBUG_LOG(topic);
         DEBUG_LOG(">: ");
         DEBUG_LOG(msg);
         DEBUG_LOG_LN();
 
-        bool changed = false;
-
-        if (msg == "on" || msg.startsWith("on#")) {
-            changed = switch_light(true);
-        } else if (msg == "off" || msg.startsWith("off#")) {
-            changed = switch_light(false);
+        BemfaCommand cmd;
+        if (!cmd.parse(msg)) {
+            DEBUG_LOG_LN("[LIGHT-01] Malformed command.");
+            return;
         }
 
-        if (changed) {
-            mqttClient.publish(topic.c_str(), 1, true, msg.c_str(), msg.length());
+        // the state published back is what was sent: without a brightness
+        if (cmd.verb == BemfaCommand::ON) {
+            strcpy(lastMsg, "on");
+            lightCommands.submit(true);
+        } else if (cmd.verb == BemfaCommand::OFF) {
+            strcpy(lastMsg, "off");
+            lightCommands.submit(false);
         }
     });
 }
@@ -1,6 +1,14 @@
 #pragma once
 
 #include "bemfa.h"
+#include "bemfacmd.h"
+#include "coalescer.h"
 #include "devices.h"
+#include "irmacro.h"
+#include "irproto.h"
+#include "statestore.h"
 
-void register_panasonic_light_01_handler(BemfaMqtt &bemfaMqtt, const String& topicPrefix, Led *ledToggle);
+void register_panasonic_light_01_handler(BemfaMqtt &bemfaMqtt, IrMacroPlayer &player, const StateStore &stateStore, const String& topicPrefix, Led *ledToggle);
+
+// Local control, e.g. from the button.
+void toggle_panasonic_light_01();
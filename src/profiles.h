@@ -0,0 +1,313 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <FS.h>
+
+#include "DebugLog.h"
+#include "bemfa.h"
+#include "bemfacmd.h"
+#include "coalescer.h"
+#include "heapprof.h"
+#include "ircode.h"
+#include "irproto.h"
+#include "irtx.h"
+#include "statestore.h"
+#include "strview.h"
+
+#ifndef PROFILES_MAX_DEVICES
+    #define PROFILES_MAX_DEVICES (8)
+#endif
+
+#ifndef PROFILES_MAX_COMMANDS
+    #define PROFILES_MAX_COMMANDS (48)
+#endif
+
+// code bits of all commands
+#ifndef PROFILES_BITS_POOL
+    #define PROFILES_BITS_POOL (512)
+#endif
+
+#ifndef PROFILES_JSON_CAPACITY
+    #define PROFILES_JSON_CAPACITY (4096)
+#endif
+
+// frames per command, so that the coalescer's frame budget fits its counter
+#ifndef PROFILES_MAX_REPEAT
+    #define PROFILES_MAX_REPEAT (5)
+#endif
+
+// between frames, for timings without a protocol
+#ifndef PROFILES_DEFAULT_GAP_MS
+    #define PROFILES_DEFAULT_GAP_MS (100)
+#endif
+
+// every device's state, and the built-in light's
+static_assert(STATE_MAX_ENTRIES >= PROFILES_MAX_DEVICES + 1, "state store too small for the profiles");
+static_assert(OUTBOX_SIZE >= PROFILES_MAX_DEVICES + 1, "outbox too small for the profiles");
+
+#define PROFILES_TOPIC_LEN (48)
+#define PROFILES_COMMAND_LEN (12)
+
+// IR devices defined in a JSON file instead of code, e.g.
+//
+//   {"devices":[{"topic":"fan003", "hz":38000, "timing":[3490,1712,464,406,1278,464],
+//     "bits":40, "repeat":2, "gap":100, "commands":{"on":"2C52092D24","off":"2C52092F26"}}]}
+//
+// `topic` is appended to the gateway's topic prefix. `timing` is header
+// mark/space, bit mark, zero space, one space and trailing mark of the
+// pulse-distance code (see IrCode); instead of it and "hz", "protocol" can
+// name a known family like "kaseikyo" or "nec" (see irproto.h). `repeat` is
+// clamped to 1..PROFILES_MAX_REPEAT; `gap` is the silence after each frame,
+// by default the protocol's or PROFILES_DEFAULT_GAP_MS. Each command is its bits in hex,
+// LSB first as printed by scripts/ir_convert.py --json. A message selects
+// the command by its name (see BemfaCommand), like "on" for "on#80".
+//
+// Devices are "stateful" unless set to false: their commands go through a
+// coalescer and the applied one is published as the device state. It is
+// restored at boot from the state store and republished. Others, like
+// volume up, are sent for every message.
+//
+// The file is parsed once at boot into fixed tables; only the coalescers
+// are allocated.
+class DeviceProfiles {
+public:
+    DeviceProfiles(BemfaMqtt &bemfaMqtt, IrTransmitter &irtx, const StateStore &stateStore)
+        : _bemfa_mqtt(bemfaMqtt), _irtx(irtx), _state_store(stateStore), _device_count(0), _command_count(0), _bits_used(0) {
+    };
+
+    // Must be called before `BemfaMqtt::begin()`, which freezes the topics.
+    size_t begin(FS &fs, const char *path, const String &topicPrefix) {
+        HeapTagScope heapTag(HEAP_TAG_BOOT);
+
+        auto file = fs.open(path, "r");
+        if (!file) {
+            DEBUG_LOG_LN("[PROFILES] No device profiles.");
+            return 0;
+        }
+
+        DynamicJsonDocument doc(PROFILES_JSON_CAPACITY);
+        auto err = deserializeJson(doc, file);
+        file.close();
+        if (err) {
+            DEBUG_LOG("[PROFILES] Invalid profiles: "); DEBUG_LOG_LN(err.c_str());
+            return 0;
+        }
+
+        for (JsonObject profile : doc["devices"].as<JsonArray>()) {
+            if (!_parse(profile, topicPrefix)) {
+                DEBUG_LOG("[PROFILES] Device skipped: "); DEBUG_LOG_LN(profile["topic"].as<const char *>());
+            }
+        }
+
+        for (uint8_t i = 0; i < _device_count; i++) {
+            _register(i);
+        }
+
+        DEBUG_LOG("[PROFILES] Devices: "); DEBUG_LOG(_device_count);
+        DEBUG_LOG(", commands: "); DEBUG_LOG(_command_count);
+        DEBUG_LOG(", code bytes: "); DEBUG_LOG_LN(_bits_used);
+
+        return _device_count;
+    };
+
+    size_t count() const {
+        return _device_count;
+    };
+
+private:
+    struct Command {
+        char name[PROFILES_COMMAND_LEN];
+        uint16_t nbits;
+        uint16_t bits_at; // in _bits
+    };
+
+    struct Device {
+        char topic[PROFILES_TOPIC_LEN];
+        IrCode code; // timings only, the bits come from the command
+        uint8_t repeat;
+        uint16_t gap_ms;
+        uint8_t first_command;
+        uint8_t command_count;
+        CommandCoalescer<uint8_t> *commands; // null if not stateful
+    };
+
+    static const uint8_t COMMAND_NONE = 255;
+
+    BemfaMqtt &_bemfa_mqtt;
+    IrTransmitter &_irtx;
+    const StateStore &_state_store;
+
+    Device _devices[PROFILES_MAX_DEVICES];
+    uint8_t _device_count;
+    Command _commands[PROFILES_MAX_COMMANDS];
+    uint8_t _command_count;
+    uint8_t _bits[PROFILES_BITS_POOL];
+    uint16_t _bits_used;
+
+    bool _parse(JsonObject profile, const String &topicPrefix) {
+        if (_device_count >= PROFILES_MAX_DEVICES) return false;
+
+        const char *suffix = profile["topic"] | "";
+        JsonArray timing = profile["timing"];
+        auto protocol = irProtocol(profile["protocol"] | "");
+        if (!*suffix || (!protocol && timing.size() != 6)) return false;
+
+        auto topic = topicPrefix + suffix;
+        topic.toLowerCase();
+        if (topic.length() >= PROFILES_TOPIC_LEN) return false;
+
+        auto &device = _devices[_device_count];
+        memset(&device, 0, sizeof(device));
+        strcpy(device.topic, topic.c_str());
+        uint16_t gap_ms = PROFILES_DEFAULT_GAP_MS;
+        if (protocol) {
+            device.code = irCode(*protocol);
+            gap_ms = protocol->gap_ms;
+        } else {
+            device.code.hz = profile["hz"] | 38000;
+            device.code.header_mark = timing[0];
+            device.code.header_space = timing[1];
+            device.code.bit_mark = timing[2];
+            device.code.zero_space = timing[3];
+            device.code.one_space = timing[4];
+            device.code.trailer_mark = timing[5];
+        }
+        int repeat = profile["repeat"] | 1;
+        device.repeat = repeat < 1 ? 1 : repeat > PROFILES_MAX_REPEAT ? PROFILES_MAX_REPEAT : repeat;
+        device.gap_ms = profile["gap"] | gap_ms;
+        device.first_command = _command_count;
+
+        uint16_t nbits = profile["bits"] | 0;
+        uint8_t commands = _command_count;
+        uint16_t bits_used = _bits_used;
+        for (JsonPair pair : profile["commands"].as<JsonObject>()) {
+            if (!_parseCommand(pair.key().c_str(), pair.value().as<const char *>(), nbits)) {
+                // roll back the commands of this device
+                _command_count = commands;
+                _bits_used = bits_used;
+                return false;
+            }
+        }
+
+        device.command_count = _command_count - device.first_command;
+        if (!device.command_count) return false;
+
+        if (profile["stateful"] | true) {
+            // at most 2 commands per second, like the built-in light
+            device.commands = new CommandCoalescer<uint8_t>(device.topic, 300, 2 * device.repeat, device.repeat);
+        }
+
+        _device_count++;
+        return true;
+    };
+
+    bool _parseCommand(const char *name, const char *hex, uint16_t nbits) {
+        if (_command_count >= PROFILES_MAX_COMMANDS || !name || !hex) return false;
+        if (strlen(name) >= PROFILES_COMMAND_LEN) return false;
+
+        size_t digits = strlen(hex);
+        if (!nbits) nbits = digits * 4;
+        size_t bytes = (nbits + 7) / 8;
+        if (nbits > IR_CODE_MAX_BITS || digits != bytes * 2 || _bits_used + bytes > PROFILES_BITS_POOL) return false;
+
+        auto &command = _commands[_command_count];
+        for (size_t i = 0; i < bytes; i++) {
+            int hi = _hex(hex[i * 2]);
+            int lo = _hex(hex[i * 2 + 1]);
+            if (hi < 0 || lo < 0) return false;
+            _bits[_bits_used + i] = (hi << 4) | lo;
+        }
+
+        strcpy(command.name, name);
+        command.nbits = nbits;
+        command.bits_at = _bits_used;
+
+        _bits_used += bytes;
+        _command_count++;
+        return true;
+    };
+
+    static int _hex(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+
+    void _register(uint8_t index) {
+        auto &device = _devices[index];
+
+        if (device.commands) {
+            auto restored = _restore(device);
+            if (restored != COMMAND_NONE) {
+                auto name = _commands[device.first_command + restored].name;
+                _bemfa_mqtt.publishState(StrView(device.topic), StrView(name));
+            }
+
+            device.commands->begin(restored, [this, index](const uint8_t &command) {
+                auto &device = _devices[index];
+                if (!_send(device, command)) {
+                    DEBUG_LOG("[PROFILES] Not sent <"); DEBUG_LOG(device.topic); DEBUG_LOG_LN(">");
+                    return;
+                }
+
+                auto name = _commands[device.first_command + command].name;
+                _bemfa_mqtt.publishState(StrView(device.topic), StrView(name));
+            });
+        }
+
+        _bemfa_mqtt.onMessage(device.topic, [this, index](const StrView &topic, const StrView &msg, AsyncMqttClient &) {
+            auto &device = _devices[index];
+
+            BemfaCommand cmd;
+            auto command = cmd.parse(msg) ? _find(device, cmd.name) : COMMAND_NONE;
+            if (command == COMMAND_NONE) {
+                DEBUG_LOG("[PROFILES] Unknown command: "); DEBUG_LOG_LN(msg);
+                return;
+            }
+
+            if (device.commands) {
+                device.commands->submit(command);
+            } else {
+                _send(device, command);
+            }
+        });
+    };
+
+    // the last applied command, as the device is assumed to have kept it
+    uint8_t _restore(const Device &device) {
+        char msg[STATE_VALUE_LEN + 1];
+        if (!_state_store.get(StrView(device.topic), msg, sizeof(msg))) return COMMAND_NONE;
+
+        BemfaCommand cmd;
+        if (!cmd.parse(StrView(msg))) return COMMAND_NONE;
+
+        DEBUG_LOG("[PROFILES] Restored <"); DEBUG_LOG(device.topic); DEBUG_LOG(">: "); DEBUG_LOG_LN(msg);
+        return _find(device, cmd.name);
+    };
+
+    // command index within the device
+    uint8_t _find(const Device &device, const StrView &name) {
+        for (uint8_t i = 0; i < device.command_count; i++) {
+            if (name == _commands[device.first_command + i].name) return i;
+        }
+        return COMMAND_NONE;
+    };
+
+    // false if none of the frames was queued
+    bool _send(const Device &device, uint8_t index) {
+        auto &command = _commands[device.first_command + index];
+
+        IrCode code = device.code;
+        code.nbits = command.nbits;
+        code.bits = _bits + command.bits_at;
+
+        // the last frame too: the next command may follow right away
+        uint8_t queued = 0;
+        for (uint8_t i = 0; i < device.repeat; i++) {
+            if (_irtx.send(&code, device.gap_ms)) queued++;
+        }
+        return queued > 0;
+    };
+};
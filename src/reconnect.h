@@ -0,0 +1,55 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Delays between connection attempts: a fast first retry, then exponential
+// backoff capped at `max_ms`. Each delay is jittered over [d/2, d) so that
+// a fleet of gateways losing the broker at once doesn't retry in lockstep.
+class ReconnectPolicy {
+public:
+    ReconnectPolicy(uint32_t first_ms, uint32_t base_ms, uint32_t max_ms)
+        : _first_ms(first_ms), _base_ms(base_ms), _max_ms(max_ms), _attempt(0) {
+    };
+
+    // After a successful connection.
+    void reset() {
+        _attempt = 0;
+    };
+
+    uint32_t nextDelay() {
+        uint32_t delay;
+        if (_attempt == 0) {
+            delay = _first_ms;
+        } else {
+            uint8_t shift = _attempt - 1 < 16 ? _attempt - 1 : 16;
+            delay = _base_ms << shift;
+            if (delay > _max_ms || delay < _base_ms) delay = _max_ms;
+        }
+
+        if (_attempt < 255) _attempt++;
+
+        auto half = delay / 2;
+        return half + (half ? random(half) : 0);
+    };
+
+    uint8_t getAttempt() const {
+        return _attempt;
+    };
+
+private:
+    uint32_t _first_ms;
+    uint32_t _base_ms;
+    uint32_t _max_ms;
+    uint8_t _attempt;
+};
+
+// Breakdown of the last connection, in milliseconds. `connack` covers the
+// TCP connect and the MQTT handshake; `suback` runs from CONNACK until all
+// subscriptions are acknowledged.
+struct ConnectTiming {
+    uint32_t attempts; // since the last successful connection
+    uint32_t dns;
+    uint32_t connack;
+    uint32_t suback;
+    bool dns_cached;
+};
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <Arduino.h>
+#include <vector>
+#include <algorithm>
+
+#include "DebugLog.h"
+#include "fnv.h"
+#include "strview.h"
+
+// Topic -> listeners routing table. Routes are collected with `add()` and
+// frozen by `freeze()` into flat arrays: every topic is stored once in a
+// shared pool, listeners of a topic are contiguous, and lookups go through
+// an open addressing hash index, comparing hash and length before bytes.
+template <typename Listener>
+class TopicRouter {
+public:
+    struct Route {
+        uint32_t hash;
+        uint16_t len;
+        uint16_t offset; // into the topic pool
+        uint16_t first;  // into the listener array
+        uint16_t count;
+    };
+
+    TopicRouter() : _frozen(false), _mask(0) {
+    };
+
+    bool add(const char *topic, const Listener &listener) {
+        if (_frozen) {
+            DEBUG_LOG("[ROUTER] Frozen, route ignored: "); DEBUG_LOG_LN(topic);
+            return false;
+        }
+
+        auto len = strlen(topic);
+        auto hash = _hash(topic, len);
+
+        uint16_t idx = 0;
+        for (; idx < _routes.size(); idx++) {
+            auto &r = _routes[idx];
+            if (r.hash == hash && r.len == len && memcmp(&_pool[r.offset], topic, len) == 0) {
+                break;
+            }
+        }
+
+        if (idx == _routes.size()) {
+            Route r = { hash, (uint16_t)len, (uint16_t)_pool.size(), 0, 0 };
+            _pool.insert(_pool.end(), topic, topic + len + 1);
+            _routes.push_back(r);
+        }
+
+        _routes[idx].count++;
+        _pending.push_back(std::make_pair(idx, listener));
+        return true;
+    };
+
+    void freeze() {
+        if (_frozen) return;
+        _frozen = true;
+
+        // listeners, grouped by route
+        std::stable_sort(_pending.begin(), _pending.end(), [](const PendingListener &a, const PendingListener &b) {
+            return a.first < b.first;
+        });
+
+        _listeners.reserve(_pending.size());
+        for (auto it = _pending.begin(); it != _pending.end(); ++it) {
+            _listeners.push_back(it->second);
+        }
+        std::vector<PendingListener>().swap(_pending);
+
+        uint16_t first = 0;
+        for (auto it = _routes.begin(); it != _routes.end(); ++it) {
+            it->first = first;
+            first += it->count;
+        }
+
+        // hash index, load factor <= 0.5
+        size_t cap = 4;
+        while (cap < _routes.size() * 2) cap <<= 1;
+        _mask = cap - 1;
+        _index.assign(cap, 0);
+
+        for (uint16_t i = 0; i < _routes.size(); i++) {
+            auto slot = _routes[i].hash & _mask;
+            while (_index[slot]) slot = (slot + 1) & _mask;
+            _index[slot] = i + 1;
+        }
+
+        _pool.shrink_to_fit();
+        _routes.shrink_to_fit();
+    };
+
+    // Returns the route of `topic`, or null if nobody listens to it.
+    const Route *find(const char *topic, size_t len) const {
+        if (!_frozen) return 0;
+
+        auto hash = _hash(topic, len);
+        for (auto slot = hash & _mask; _index[slot]; slot = (slot + 1) & _mask) {
+            auto &r = _routes[_index[slot] - 1];
+            if (r.hash == hash && r.len == len && memcmp(&_pool[r.offset], topic, len) == 0) {
+                return &r;
+            }
+        }
+
+        return 0;
+    };
+
+    size_t size() const {
+        return _routes.size();
+    };
+
+    const Route &route(size_t i) const {
+        return _routes[i];
+    };
+
+    StrView topic(const Route &r) const {
+        return StrView(&_pool[r.offset], r.len);
+    };
+
+    const Listener *listeners(const Route &r) const {
+        return &_listeners[r.first];
+    };
+
+private:
+    typedef std::pair<uint16_t, Listener> PendingListener;
+
+    bool _frozen;
+
+    std::vector<char> _pool;
+    std::vector<Route> _routes;
+    std::vector<Listener> _listeners;
+    std::vector<PendingListener> _pending;
+
+    std::vector<uint16_t> _index;
+    size_t _mask;
+
+    static uint32_t _hash(const char *s, size_t len) {
+        return fnv1a(s, len);
+    };
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "fnv.h"
+
+// RTC user memory slots, in 4-byte blocks. It survives resets and OTA but
+// not power loss; the first 128 bytes are left to the OTA updater.
+#define RTC_SLOT_WIFI (32)
+#define RTC_SLOT_STATE (48)
+
+// A checksummed record of `T` in RTC user memory.
+template <typename T>
+class RtcRecord {
+public:
+    RtcRecord(uint32_t slot) : _slot(slot) {
+    };
+
+    bool load(T &data) {
+        Block block;
+        if (!ESP.rtcUserMemoryRead(_slot, reinterpret_cast<uint32_t *>(&block), sizeof(block))) return false;
+        if (block.check != fnv1a(&block.data, sizeof(block.data))) return false;
+
+        data = block.data;
+        return true;
+    };
+
+    bool save(const T &data) {
+        Block block;
+        memset(&block, 0, sizeof(block));
+        block.data = data;
+        block.check = fnv1a(&block.data, sizeof(block.data));
+        return ESP.rtcUserMemoryWrite(_slot, reinterpret_cast<uint32_t *>(&block), sizeof(block));
+    };
+
+    void invalidate() {
+        uint32_t zero = 0;
+        ESP.rtcUserMemoryWrite(_slot, &zero, sizeof(zero));
+    };
+
+private:
+    struct Block {
+        uint32_t check;
+        T data;
+    } __attribute__((aligned(4)));
+
+    uint32_t _slot;
+};
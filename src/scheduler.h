@@ -0,0 +1,218 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "DebugLog.h"
+#include "metrics.h"
+
+#ifndef SCHEDULER_SLOTS
+    #define SCHEDULER_SLOTS (12)
+#endif
+
+// 0 is never a valid id. The upper byte is a generation counter, so an id
+// kept after its one-shot ran can't cancel the task that reused the slot.
+typedef uint16_t TaskId;
+
+#define TASK_NONE ((TaskId)0)
+
+struct TaskStats {
+    uint32_t runs;
+    uint32_t late_max_us; // how long after its due time the task started
+    uint32_t run_max_us;
+    uint32_t run_sum_us;
+};
+
+// Cooperative timers run from loop(), so callbacks may block, allocate and
+// touch any state of the main loop. Tasks are kept in a min-heap over a
+// fixed pool of slots; due times are in micros(), which limits delays and
+// periods to about 35 minutes.
+class Scheduler {
+public:
+    typedef void (*TaskFn)(void *arg);
+
+    // Runs `fn` once after `delay_ms`.
+    static TaskId after(const char *name, uint32_t delay_ms, TaskFn fn, void *arg) {
+        return _add(name, delay_ms, 0, fn, arg);
+    };
+
+    // Runs `fn` every `period_ms`, the first time after one period. A task
+    // that falls behind skips the missed runs rather than bursting.
+    static TaskId every(const char *name, uint32_t period_ms, TaskFn fn, void *arg) {
+        return _add(name, period_ms, period_ms, fn, arg);
+    };
+
+    static bool cancel(TaskId id) {
+        auto task = _find(id);
+        if (!task) return false;
+
+        _remove(task->heap_pos);
+        _free(*task);
+        return true;
+    };
+
+    static bool active(TaskId id) {
+        return _find(id) != 0;
+    };
+
+    static void loop() {
+        while (_size) {
+            auto &task = _tasks[_heap[0]];
+            uint32_t now = micros();
+            uint32_t late = now - task.due;
+            if ((int32_t)late < 0) break;
+
+            _remove(0);
+
+            auto fn = task.fn;
+            auto arg = task.arg;
+            auto id = task.id;
+            if (task.period_us) {
+                // before the call, so it may cancel itself
+                task.due += task.period_us;
+                if ((int32_t)(task.due - now) <= 0) task.due = now + task.period_us;
+                _insert(&task - _tasks);
+            } else {
+                task.pending = false;
+            }
+
+            fn(arg);
+
+            uint32_t run = micros() - now;
+            Metrics::record(METRIC_TASK_LATE, late);
+            Metrics::record(METRIC_TASK_RUN, run);
+
+            // the slot may have been freed and reused by the callback
+            if (task.id == id) {
+                auto &s = task.stats;
+                s.runs++;
+                if (late > s.late_max_us) s.late_max_us = late;
+                if (run > s.run_max_us) s.run_max_us = run;
+                s.run_sum_us += run;
+                if (!task.pending) _free(task);
+            }
+        }
+    };
+
+    // [{"name":..,"period":..,"runs":..,"lateMax":..,"runMax":..,"runSum":..},...]
+    static void printTo(Print &out) {
+        out.print('[');
+        bool first = true;
+        for (int i = 0; i < SCHEDULER_SLOTS; i++) {
+            auto &task = _tasks[i];
+            if (!task.pending) continue;
+
+            if (!first) out.print(',');
+            first = false;
+
+            out.print("{\"name\":\""); out.print(task.name);
+            out.print("\",\"period\":"); out.print(task.period_us / 1000);
+            out.print(",\"runs\":"); out.print(task.stats.runs);
+            out.print(",\"lateMax\":"); out.print(task.stats.late_max_us);
+            out.print(",\"runMax\":"); out.print(task.stats.run_max_us);
+            out.print(",\"runSum\":"); out.print(task.stats.run_sum_us);
+            out.print('}');
+        }
+        out.print(']');
+    };
+
+private:
+    struct Task {
+        TaskId id;
+        bool pending;
+        uint8_t heap_pos;
+        const char *name;
+        uint32_t due;
+        uint32_t period_us;
+        TaskFn fn;
+        void *arg;
+        TaskStats stats;
+    };
+
+    inline static Task _tasks[SCHEDULER_SLOTS] = {};
+    inline static uint8_t _heap[SCHEDULER_SLOTS] = {};
+    inline static uint8_t _size = 0;
+    inline static uint8_t _generation = 0;
+
+    static TaskId _add(const char *name, uint32_t delay_ms, uint32_t period_ms, TaskFn fn, void *arg) {
+        for (int i = 0; i < SCHEDULER_SLOTS; i++) {
+            auto &task = _tasks[i];
+            if (task.pending) continue;
+
+            if (++_generation == 0) _generation = 1;
+
+            memset(&task.stats, 0, sizeof(task.stats));
+            task.id = ((TaskId)_generation << 8) | i;
+            task.pending = true;
+            task.name = name;
+            task.due = micros() + delay_ms * 1000;
+            task.period_us = period_ms * 1000;
+            task.fn = fn;
+            task.arg = arg;
+            _insert(i);
+            return task.id;
+        }
+
+        DEBUG_LOG("[SCHED] No free slot for "); DEBUG_LOG_LN(name);
+        return TASK_NONE;
+    };
+
+    static Task *_find(TaskId id) {
+        if (id == TASK_NONE) return 0;
+
+        auto &task = _tasks[(id & 0xFF) % SCHEDULER_SLOTS];
+        return task.pending && task.id == id ? &task : 0;
+    };
+
+    static void _free(Task &task) {
+        task.pending = false;
+        task.id = TASK_NONE;
+    };
+
+    static bool _before(uint8_t a, uint8_t b) {
+        return (int32_t)(_tasks[_heap[a]].due - _tasks[_heap[b]].due) < 0;
+    };
+
+    static void _swap(uint8_t a, uint8_t b) {
+        auto t = _heap[a];
+        _heap[a] = _heap[b];
+        _heap[b] = t;
+        _tasks[_heap[a]].heap_pos = a;
+        _tasks[_heap[b]].heap_pos = b;
+    };
+
+    static void _up(uint8_t pos) {
+        while (pos && _before(pos, (pos - 1) / 2)) {
+            _swap(pos, (pos - 1) / 2);
+            pos = (pos - 1) / 2;
+        }
+    };
+
+    static void _down(uint8_t pos) {
+        while (true) {
+            uint8_t min = pos;
+            uint8_t l = pos * 2 + 1;
+            uint8_t r = l + 1;
+            if (l < _size && _before(l, min)) min = l;
+            if (r < _size && _before(r, min)) min = r;
+            if (min == pos) return;
+
+            _swap(pos, min);
+            pos = min;
+        }
+    };
+
+    static void _insert(uint8_t slot) {
+        _heap[_size] = slot;
+        _tasks[slot].heap_pos = _size;
+        _up(_size++);
+    };
+
+    static void _remove(uint8_t pos) {
+        _size--;
+        if (pos == _size) return;
+
+        _swap(pos, _size);
+        _down(pos);
+        _up(pos);
+    };
+};
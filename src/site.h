@@ -0,0 +1,84 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+#include <vector>
+#include <algorithm>
+
+#include "DebugLog.h"
+
+// In-memory index of the precompressed site, loaded from the manifest
+// written by scripts/build_site.py. Assets are stored as `<path>.gz`.
+class SiteIndex {
+public:
+    struct Asset {
+        String path;
+        String file;
+        String etag; // quoted
+        String cacheControl;
+        String mime;
+        uint32_t size;
+    };
+
+    void begin(FS &fs, const char *dir) {
+        _assets.clear();
+
+        auto manifest = fs.open(String(dir) + "/manifest", "r");
+        if (!manifest) {
+            DEBUG_LOG_LN("[SITE] No manifest, static contents disabled.");
+            return;
+        }
+
+        while (manifest.available()) {
+            auto line = manifest.readStringUntil('\n');
+            _parse(dir, line);
+        }
+        manifest.close();
+
+        std::sort(_assets.begin(), _assets.end(), [](const Asset &a, const Asset &b) {
+            return strcmp(a.path.c_str(), b.path.c_str()) < 0;
+        });
+        _assets.shrink_to_fit();
+
+        DEBUG_LOG("[SITE] Assets: "); DEBUG_LOG_LN(_assets.size());
+    };
+
+    const Asset *find(const String &path) const {
+        auto it = std::lower_bound(_assets.begin(), _assets.end(), path, [](const Asset &a, const String &p) {
+            return strcmp(a.path.c_str(), p.c_str()) < 0;
+        });
+
+        if (it != _assets.end() && it->path == path) {
+            return &*it;
+        }
+        return 0;
+    };
+
+private:
+    std::vector<Asset> _assets;
+
+    // <path>\t<size>\t<etag>\t<max-age>\t<mime>
+    void _parse(const char *dir, const String &line) {
+        int f[4];
+        int from = 0;
+        for (int i = 0; i < 4; i++) {
+            f[i] = line.indexOf('\t', from);
+            if (f[i] < 0) return;
+            from = f[i] + 1;
+        }
+
+        Asset asset;
+        asset.path = line.substring(0, f[0]);
+        asset.file = String(dir) + "/" + asset.path + ".gz";
+        asset.size = line.substring(f[0] + 1, f[1]).toInt();
+        asset.etag = "\"" + line.substring(f[1] + 1, f[2]) + "\"";
+
+        auto maxAge = line.substring(f[2] + 1, f[3]).toInt();
+        asset.cacheControl = maxAge ? "max-age=" + String(maxAge) : String("no-cache");
+
+        asset.mime = line.substring(f[3] + 1);
+        asset.mime.trim();
+
+        _assets.push_back(asset);
+    };
+};
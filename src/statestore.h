@@ -0,0 +1,333 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include "DebugLog.h"
+#include "fnv.h"
+#include "rtcmem.h"
+#include "scheduler.h"
+#include "strview.h"
+
+// the built-in light and every device profile; 32 bytes each in RTC memory
+#ifndef STATE_MAX_ENTRIES
+    #define STATE_MAX_ENTRIES (9)
+#endif
+
+// longest state kept, e.g. "on#100#16711680#1" is 17
+#define STATE_VALUE_LEN (27)
+
+// value room of a log record, which predates the shorter RTC entries
+#define STATE_RECORD_VALUE_LEN (31)
+
+// a burst of changes is written once, this long after the last one...
+#ifndef STATE_FLUSH_DELAY_MS
+    #define STATE_FLUSH_DELAY_MS (3000)
+#endif
+
+// ...but no later than this after the first one
+#ifndef STATE_FLUSH_MAX_DELAY_MS
+    #define STATE_FLUSH_MAX_DELAY_MS (30000)
+#endif
+
+// after a failed write
+#ifndef STATE_FLUSH_RETRY_MS
+    #define STATE_FLUSH_RETRY_MS (10000)
+#endif
+
+// records in the log before it is compacted
+#ifndef STATE_LOG_MAX_RECORDS
+    #define STATE_LOG_MAX_RECORDS (128)
+#endif
+
+// Last state of each device, as the message of its topic ("on#80"), kept
+// across reboots so a device can start from what it last applied.
+//
+// Every change goes to RTC memory at once: it survives resets, OTA and
+// crashes, and is the fast path at boot. Flash is for power loss: changes
+// are appended to a log file, batched and debounced so that a flurry of
+// commands costs one write, and the log is compacted to one record per
+// device once it grows past STATE_LOG_MAX_RECORDS. Appending spreads the
+// writes over LittleFS blocks instead of rewriting one file in place; a
+// torn record at the end fails its checksum and the log is read up to it.
+// A change stays dirty until a write of it succeeded; a failed one is
+// retried after STATE_FLUSH_RETRY_MS.
+class StateStore {
+public:
+    StateStore() : _fs(0), _count(0), _dirty(false), _dirty_since(0), _flush_task(TASK_NONE),
+        _log_records(0), _rtc(RTC_SLOT_STATE) {
+        memset(&_table, 0, sizeof(_table));
+    };
+
+    ~StateStore() {
+        Scheduler::cancel(_flush_task);
+    };
+
+    // Loads the last states; call before the devices register.
+    void begin(FS &fs, const char *path) {
+        _fs = &fs;
+        _path = path;
+
+        if (_rtc.load(_table) && _table.count <= STATE_MAX_ENTRIES) {
+            DEBUG_LOG("[STATE] Restored from RTC memory: "); DEBUG_LOG_LN(_table.count);
+            _count = _table.count;
+            _countLog();
+
+            // changes the reset came before writing
+            for (uint8_t i = 0; i < _count; i++) {
+                _dirty |= _table.entries[i].dirty;
+            }
+            if (_dirty) {
+                _dirty_since = millis();
+                _scheduleFlush();
+            }
+            return;
+        }
+
+        memset(&_table, 0, sizeof(_table));
+        _count = 0;
+        _readLog();
+        _table.count = _count;
+        _rtc.save(_table);
+
+        DEBUG_LOG("[STATE] Restored from flash: "); DEBUG_LOG_LN(_count);
+    };
+
+    // The last state of `key`, zero terminated; false if there is none.
+    bool get(const StrView &key, char *value, size_t size) const {
+        auto entry = _find(_hash(key));
+        if (!entry || !size) return false;
+
+        StrView(entry->value, entry->len).copyTo(value, size);
+        return true;
+    };
+
+    void set(const StrView &key, const StrView &value) {
+        if (value.length() > STATE_VALUE_LEN) return;
+
+        auto hash = _hash(key);
+        auto entry = _find(hash);
+        if (entry && StrView(entry->value, entry->len) == value) return;
+
+        if (!entry) {
+            if (_count >= STATE_MAX_ENTRIES) {
+                DEBUG_LOG_LN("[STATE] Table full, state not kept.");
+                return;
+            }
+            entry = &_table.entries[_count++];
+            entry->key = hash;
+            entry->dirty = false;
+        }
+
+        memcpy(entry->value, value.data(), value.length());
+        entry->len = value.length();
+        entry->dirty = true;
+        _table.count = _count;
+        _rtc.save(_table);
+
+        if (!_dirty) {
+            _dirty = true;
+            _dirty_since = millis();
+        }
+        _scheduleFlush();
+    };
+
+    // Writes the pending changes to flash now, e.g. before a restart;
+    // false if they are still pending.
+    bool flush() {
+        Scheduler::cancel(_flush_task);
+        _flush_task = TASK_NONE;
+        if (!_dirty) return true;
+        if (!_fs) return false;
+
+        bool written = _log_records >= STATE_LOG_MAX_RECORDS ? _compact() : _append();
+        if (!written) {
+            _flush_task = Scheduler::after("stateFlush", STATE_FLUSH_RETRY_MS,
+                [](void *arg) { static_cast<StateStore *>(arg)->flush(); }, this);
+            return false;
+        }
+
+        for (uint8_t i = 0; i < _count; i++) {
+            _table.entries[i].dirty = false;
+        }
+        _dirty = false;
+        _rtc.save(_table);
+        return true;
+    };
+
+private:
+    struct Entry {
+        uint32_t key; // hash of the topic
+        uint8_t len : 7;
+        uint8_t dirty : 1; // not yet in the log, kept in RTC memory across resets
+        char value[STATE_VALUE_LEN];
+    };
+
+    struct Table {
+        uint8_t count;
+        Entry entries[STATE_MAX_ENTRIES];
+    };
+
+    struct Record {
+        uint32_t key;
+        uint8_t len;
+        char value[STATE_RECORD_VALUE_LEN];
+        uint32_t check;
+    } __attribute__((packed));
+
+    static_assert(sizeof(Entry) == 32, "state entry isn't packed");
+    static_assert(sizeof(Table) + 4 <= 512 - RTC_SLOT_STATE * 4, "state table doesn't fit in RTC memory");
+
+    FS *_fs;
+    const char *_path;
+
+    Table _table;
+    uint8_t _count;
+    bool _dirty;
+    unsigned long _dirty_since;
+    TaskId _flush_task;
+    uint16_t _log_records;
+
+    RtcRecord<Table> _rtc;
+
+    static uint32_t _hash(const StrView &key) {
+        return fnv1a(key.data(), key.length());
+    };
+
+    const Entry *_find(uint32_t key) const {
+        for (uint8_t i = 0; i < _count; i++) {
+            if (_table.entries[i].key == key) return &_table.entries[i];
+        }
+        return 0;
+    };
+
+    Entry *_find(uint32_t key) {
+        return const_cast<Entry *>(static_cast<const StateStore *>(this)->_find(key));
+    };
+
+    void _scheduleFlush() {
+        Scheduler::cancel(_flush_task);
+
+        uint32_t waited = millis() - _dirty_since;
+        uint32_t left = waited < STATE_FLUSH_MAX_DELAY_MS ? STATE_FLUSH_MAX_DELAY_MS - waited : 0;
+        _flush_task = Scheduler::after("stateFlush", left < STATE_FLUSH_DELAY_MS ? left : STATE_FLUSH_DELAY_MS,
+            [](void *arg) { static_cast<StateStore *>(arg)->flush(); }, this);
+    };
+
+    static void _fill(Record &record, const Entry &entry) {
+        memset(&record, 0, sizeof(record));
+        record.key = entry.key;
+        record.len = entry.len;
+        memcpy(record.value, entry.value, entry.len);
+        record.check = fnv1a(&record, sizeof(record) - sizeof(record.check));
+    };
+
+    void _readLog() {
+        auto file = _fs->open(_path, "r");
+        if (!file) return;
+
+        Record record;
+        _log_records = 0;
+        while (file.read(reinterpret_cast<uint8_t *>(&record), sizeof(record)) == sizeof(record)) {
+            if (record.check != fnv1a(&record, sizeof(record) - sizeof(record.check)) || record.len > STATE_RECORD_VALUE_LEN) {
+                DEBUG_LOG_LN("[STATE] Torn record, log read up to it.");
+                _rewrite();
+                break;
+            }
+            _log_records++;
+            if (record.len > STATE_VALUE_LEN) continue; // from a longer build
+
+            // the last record of a key wins
+            auto entry = _find(record.key);
+            if (!entry) {
+                if (_count >= STATE_MAX_ENTRIES) continue;
+                entry = &_table.entries[_count++];
+                entry->key = record.key;
+            }
+            entry->len = record.len;
+            entry->dirty = false;
+            memcpy(entry->value, record.value, record.len);
+        }
+        if (file.size() % sizeof(Record)) _rewrite();
+        file.close();
+    };
+
+    void _countLog() {
+        auto file = _fs->open(_path, "r");
+        if (!file) return;
+
+        _log_records = file.size() / sizeof(Record);
+        if (file.size() % sizeof(Record)) _rewrite();
+        file.close();
+    };
+
+    // Records appended after a torn one would never be read, so the next
+    // flush compacts the log instead.
+    void _rewrite() {
+        _log_records = STATE_LOG_MAX_RECORDS;
+        if (!_dirty) {
+            _dirty = true;
+            _dirty_since = millis();
+            _scheduleFlush();
+        }
+    };
+
+    bool _append() {
+        auto file = _fs->open(_path, "a");
+        if (!file) {
+            DEBUG_LOG_LN("[STATE] Can't open the log.");
+            return false;
+        }
+
+        Record record;
+        uint8_t written = 0;
+        bool ok = true;
+        for (uint8_t i = 0; i < _count && ok; i++) {
+            if (!_table.entries[i].dirty) continue;
+            _fill(record, _table.entries[i]);
+            ok = file.write(reinterpret_cast<const uint8_t *>(&record), sizeof(record)) == sizeof(record);
+            written++;
+        }
+        file.close();
+        _log_records += written;
+
+        if (!ok) {
+            // a torn record may end the log now
+            DEBUG_LOG_LN("[STATE] Can't append to the log.");
+            _log_records = STATE_LOG_MAX_RECORDS;
+            return false;
+        }
+
+        DEBUG_LOG("[STATE] Records appended: "); DEBUG_LOG_LN(written);
+        return true;
+    };
+
+    // Rewrites the log with the current state only. The new log is complete
+    // before it replaces the old one (LittleFS renames atomically), so a
+    // power loss keeps either of them.
+    bool _compact() {
+        String tmp = String(_path) + ".new";
+        auto file = _fs->open(tmp.c_str(), "w");
+        if (!file) {
+            DEBUG_LOG_LN("[STATE] Can't compact the log.");
+            return false;
+        }
+
+        Record record;
+        bool ok = true;
+        for (uint8_t i = 0; i < _count && ok; i++) {
+            _fill(record, _table.entries[i]);
+            ok = file.write(reinterpret_cast<const uint8_t *>(&record), sizeof(record)) == sizeof(record);
+        }
+        file.close();
+
+        if (!ok || !_fs->rename(tmp.c_str(), _path)) {
+            DEBUG_LOG_LN("[STATE] Can't compact the log.");
+            return false;
+        }
+        _log_records = _count;
+
+        DEBUG_LOG("[STATE] Log compacted, records: "); DEBUG_LOG_LN(_count);
+        return true;
+    };
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Non-owning view of a character range; the range need not be zero terminated.
+class StrView : public Printable {
+public:
+    StrView() : _data(""), _len(0) {
+    };
+
+    StrView(const char *data, size_t len) : _data(data), _len(len) {
+    };
+
+    StrView(const char *str) : _data(str), _len(strlen(str)) {
+    };
+
+    const char *data() const {
+        return _data;
+    };
+
+    size_t length() const {
+        return _len;
+    };
+
+    bool operator==(const StrView &other) const {
+        return _len == other._len && memcmp(_data, other._data, _len) == 0;
+    };
+
+    bool operator==(const char *str) const {
+        return *this == StrView(str);
+    };
+
+    bool operator!=(const char *str) const {
+        return !(*this == str);
+    };
+
+    bool startsWith(const char *prefix) const {
+        auto n = strlen(prefix);
+        return n <= _len && memcmp(_data, prefix, n) == 0;
+    };
+
+    // Copy into `buf` as a zero terminated string, truncating if needed.
+    size_t copyTo(char *buf, size_t size) const {
+        if (size == 0) return 0;
+
+        auto n = _len < size - 1 ? _len : size - 1;
+        memcpy(buf, _data, n);
+        buf[n] = 0;
+        return n;
+    };
+
+    String toString() const {
+        String s;
+        s.concat(_data, _len);
+        return s;
+    };
+
+    virtual size_t printTo(Print &p) const override {
+        return p.write(reinterpret_cast<const uint8_t *>(_data), _len);
+    };
+
+private:
+    const char *_data;
+    size_t _len;
+};
@@ -0,0 +1,489 @@
+#pragma once
+
+// Host stand-in for the parts of the ESP8266 Arduino core the gateway uses,
+// for the native test env. Time only moves when a test advances HostClock,
+// so timeouts and debouncing can be stepped through exactly.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define F(s) (s)
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x00
+#define INPUT_PULLUP 0x02
+#define OUTPUT 0x01
+
+#define CHANGE 0x03
+#define FALLING 0x02
+#define RISING 0x01
+
+#define LED_BUILTIN 2
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define SERIAL_8N1 0x1c
+#define SERIAL_FULL 0
+#define SERIAL_TX_ONLY 2
+
+#define clockCyclesPerMicrosecond() (80L)
+#define microsecondsToClockCycles(a) ((a) * clockCyclesPerMicrosecond())
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+inline void *memcpy_P(void *dst, const void *src, size_t n) { return memcpy(dst, src, n); }
+inline uint8_t pgm_read_byte(const void *p) { return *static_cast<const uint8_t *>(p); }
+inline uint16_t pgm_read_word(const void *p) { uint16_t v; memcpy(&v, p, sizeof(v)); return v; }
+inline uint32_t pgm_read_dword(const void *p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+inline size_t strlen_P(const char *s) { return strlen(s); }
+inline int strcmp_P(const char *a, const char *b) { return strcmp(a, b); }
+inline char *strcpy_P(char *dst, const char *src) { return strcpy(dst, src); }
+
+// Simulated time, in microseconds since boot.
+struct HostClock {
+    inline static uint64_t us = 0;
+
+    static void reset() { us = 0; }
+    static void advanceUs(uint64_t d) { us += d; }
+    static void advanceMs(uint64_t d) { us += d * 1000; }
+};
+
+// 32 bits, like on the device, so wrap-around is the same.
+inline unsigned long millis() { return (uint32_t)(HostClock::us / 1000); }
+inline unsigned long micros() { return (uint32_t)HostClock::us; }
+inline void delay(unsigned long ms) { HostClock::advanceMs(ms); }
+inline void delayMicroseconds(unsigned int us) { HostClock::advanceUs(us); }
+inline void yield() {}
+
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+// Pin levels and interrupt handlers, for tests to set and fire.
+struct HostPin {
+    uint8_t mode;
+    int value;
+    void (*isr)(void *);
+    void *arg;
+    int isr_mode;
+};
+
+// A write to the GPIO set/clear registers, and when it happened.
+struct HostGpioWrite {
+    uint64_t us;
+    uint8_t pin;
+    int value;
+};
+
+struct HostPins {
+    inline static HostPin pins[17] = {};
+    inline static std::vector<HostGpioWrite> writes;
+
+    static void reset() {
+        memset(pins, 0, sizeof(pins));
+        writes.clear();
+    }
+
+    // sets an input level and runs its interrupt handler, if any
+    static void set(uint8_t pin, int value) {
+        auto &p = pins[pin];
+        if (p.value == value) return;
+        p.value = value;
+        if (p.isr) p.isr(p.arg);
+    }
+};
+
+inline void pinMode(uint8_t pin, uint8_t mode) { HostPins::pins[pin].mode = mode; }
+inline void digitalWrite(uint8_t pin, uint8_t val) { HostPins::pins[pin].value = val; }
+inline int digitalRead(uint8_t pin) { return HostPins::pins[pin].value; }
+inline void analogWrite(uint8_t pin, int val) { HostPins::pins[pin].value = val; }
+inline void analogWriteRange(uint32_t) {}
+inline void analogWriteFreq(uint32_t) {}
+inline uint8_t digitalPinToInterrupt(uint8_t pin) { return pin; }
+
+inline void attachInterruptArg(uint8_t pin, void (*isr)(void *), void *arg, int mode) {
+    HostPins::pins[pin].isr = isr;
+    HostPins::pins[pin].arg = arg;
+    HostPins::pins[pin].isr_mode = mode;
+}
+
+inline void detachInterrupt(uint8_t pin) {
+    HostPins::pins[pin].isr = 0;
+    HostPins::pins[pin].arg = 0;
+}
+
+// GPOS/GPOC: writing a mask sets/clears those of GPIO0-15, and is logged.
+struct HostGpioRegister {
+    int value;
+
+    HostGpioRegister &operator=(uint32_t mask) {
+        for (uint8_t pin = 0; pin < 16; pin++) {
+            if (!(mask & (1UL << pin))) continue;
+            HostPins::pins[pin].value = value;
+            HostPins::writes.push_back(HostGpioWrite { HostClock::us, pin, value });
+        }
+        return *this;
+    }
+};
+
+inline HostGpioRegister GPOS = { HIGH };
+inline HostGpioRegister GPOC = { LOW };
+
+// timer0 compares against the cycle counter, see EspClass::getCycleCount().
+typedef void (*timercallback)(void);
+
+struct HostTimer0 {
+    inline static timercallback isr = 0;
+    inline static uint32_t compare = 0;
+    inline static bool armed = false;
+
+    static void reset() {
+        isr = 0;
+        armed = false;
+    }
+
+    // Moves HostClock up to the compare value and runs the interrupt;
+    // false if the timer isn't armed.
+    static bool fire() {
+        if (!armed || !isr) return false;
+        armed = false;
+
+        uint32_t wait = compare - (uint32_t)(HostClock::us * clockCyclesPerMicrosecond());
+        HostClock::us += (wait + clockCyclesPerMicrosecond() - 1) / clockCyclesPerMicrosecond();
+        isr();
+        return true;
+    }
+};
+
+inline void timer0_isr_init() {}
+inline void timer0_attachInterrupt(timercallback isr) { HostTimer0::isr = isr; }
+inline void timer0_detachInterrupt() { HostTimer0::isr = 0; HostTimer0::armed = false; }
+inline void timer0_write(uint32_t count) { HostTimer0::compare = count; HostTimer0::armed = true; }
+
+// Deterministic, so jittered delays repeat from run to run.
+struct HostRandom {
+    inline static uint32_t state = 1;
+};
+
+inline void randomSeed(unsigned long seed) { HostRandom::state = seed ? seed : 1; }
+
+inline long random(long howbig) {
+    if (howbig <= 0) return 0;
+    HostRandom::state = HostRandom::state * 1103515245UL + 12345UL;
+    return (HostRandom::state >> 8) % howbig;
+}
+
+inline long random(long howsmall, long howbig) {
+    return howsmall >= howbig ? howsmall : howsmall + random(howbig - howsmall);
+}
+
+class String {
+public:
+    String(const char *cstr = "") : _s(cstr ? cstr : "") {}
+    String(const char *cstr, unsigned int length) : _s(cstr, length) {}
+    String(const std::string &s) : _s(s) {}
+    explicit String(char c) : _s(1, c) {}
+    explicit String(int value, unsigned char base = 10) : _s(_format((long long)value, base)) {}
+    explicit String(unsigned int value, unsigned char base = 10) : _s(_format((unsigned long long)value, base)) {}
+    explicit String(long value, unsigned char base = 10) : _s(_format((long long)value, base)) {}
+    explicit String(unsigned long value, unsigned char base = 10) : _s(_format((unsigned long long)value, base)) {}
+
+    const char *c_str() const { return _s.c_str(); }
+    unsigned int length() const { return _s.size(); }
+    bool isEmpty() const { return _s.empty(); }
+    bool reserve(unsigned int size) { _s.reserve(size); return true; }
+    void clear() { _s.clear(); }
+
+    bool concat(const String &s) { _s += s._s; return true; }
+    bool concat(const char *cstr) { if (cstr) _s += cstr; return cstr != 0; }
+    bool concat(const char *cstr, unsigned int length) { _s.append(cstr, length); return true; }
+    bool concat(char c) { _s += c; return true; }
+    bool concat(int value) { _s += _format((long long)value, 10); return true; }
+    bool concat(unsigned int value) { _s += _format((unsigned long long)value, 10); return true; }
+    bool concat(long value) { _s += _format((long long)value, 10); return true; }
+    bool concat(unsigned long value) { _s += _format((unsigned long long)value, 10); return true; }
+
+    template <typename T>
+    String &operator+=(const T &v) { concat(v); return *this; }
+
+    bool operator==(const String &s) const { return _s == s._s; }
+    bool operator==(const char *cstr) const { return _s == (cstr ? cstr : ""); }
+    bool operator!=(const String &s) const { return !(*this == s); }
+    bool operator!=(const char *cstr) const { return !(*this == cstr); }
+    bool operator<(const String &s) const { return _s < s._s; }
+
+    char operator[](unsigned int i) const { return i < _s.size() ? _s[i] : 0; }
+    char charAt(unsigned int i) const { return (*this)[i]; }
+
+    bool equals(const String &s) const { return *this == s; }
+    bool equalsIgnoreCase(const String &s) const {
+        return _s.size() == s._s.size() && std::equal(_s.begin(), _s.end(), s._s.begin(), [](char a, char b) {
+            return tolower((unsigned char)a) == tolower((unsigned char)b);
+        });
+    }
+    bool startsWith(const String &prefix) const { return _s.compare(0, prefix._s.size(), prefix._s) == 0; }
+    bool endsWith(const String &suffix) const {
+        return _s.size() >= suffix._s.size() && _s.compare(_s.size() - suffix._s.size(), suffix._s.size(), suffix._s) == 0;
+    }
+
+    int indexOf(char c, unsigned int from = 0) const { return _pos(_s.find(c, from)); }
+    int indexOf(const String &s, unsigned int from = 0) const { return _pos(_s.find(s._s, from)); }
+    int lastIndexOf(char c) const { return _pos(_s.rfind(c)); }
+
+    String substring(unsigned int from) const { return from < _s.size() ? String(_s.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const {
+        if (from > to) std::swap(from, to);
+        if (from >= _s.size()) return String();
+        return String(_s.substr(from, std::min<size_t>(to, _s.size()) - from));
+    }
+
+    long toInt() const { return atol(_s.c_str()); }
+    void toLowerCase() { for (auto &c : _s) c = tolower((unsigned char)c); }
+    void toUpperCase() { for (auto &c : _s) c = toupper((unsigned char)c); }
+    void trim() {
+        auto begin = _s.find_first_not_of(" \t\r\n");
+        auto end = _s.find_last_not_of(" \t\r\n");
+        _s = begin == std::string::npos ? std::string() : _s.substr(begin, end - begin + 1);
+    }
+
+    friend String operator+(const String &a, const String &b) { return String(a._s + b._s); }
+    friend String operator+(const String &a, const char *b) { return String(a._s + b); }
+    friend String operator+(const char *a, const String &b) { return String(a + b._s); }
+    friend String operator+(const String &a, char b) { return String(a._s + b); }
+
+private:
+    std::string _s;
+
+    static int _pos(size_t pos) { return pos == std::string::npos ? -1 : (int)pos; }
+
+    static std::string _format(unsigned long long value, unsigned char base) {
+        char buf[66];
+        char *p = buf + sizeof(buf) - 1;
+        *p = 0;
+        if (base < 2) base = 10;
+        do {
+            auto digit = value % base;
+            *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+            value /= base;
+        } while (value);
+        return p;
+    }
+
+    static std::string _format(long long value, unsigned char base) {
+        if (value < 0 && base == 10) return "-" + _format((unsigned long long)-value, base);
+        return _format((unsigned long long)value, base);
+    }
+};
+
+class Print;
+
+class Printable {
+public:
+    virtual ~Printable() {}
+    virtual size_t printTo(Print &p) const = 0;
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t c) = 0;
+
+    virtual size_t write(const uint8_t *buffer, size_t size) {
+        size_t n = 0;
+        while (size--) n += write(*buffer++);
+        return n;
+    }
+
+    size_t write(const char *str) { return str ? write(reinterpret_cast<const uint8_t *>(str), strlen(str)) : 0; }
+    size_t write(const char *buffer, size_t size) { return write(reinterpret_cast<const uint8_t *>(buffer), size); }
+
+    size_t print(const char *s) { return write(s); }
+    size_t print(const String &s) { return write(s.c_str(), s.length()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(unsigned char n, int base = DEC) { return _number(n, base); }
+    size_t print(int n, int base = DEC) { return _signed(n, base); }
+    size_t print(unsigned int n, int base = DEC) { return _number(n, base); }
+    size_t print(long n, int base = DEC) { return _signed(n, base); }
+    size_t print(unsigned long n, int base = DEC) { return _number(n, base); }
+    size_t print(long long n, int base = DEC) { return _signed(n, base); }
+    size_t print(unsigned long long n, int base = DEC) { return _number(n, base); }
+    size_t print(double n, int digits = 2) {
+        char buf[40];
+        snprintf(buf, sizeof(buf), "%.*f", digits, n);
+        return write(buf);
+    }
+    size_t print(const Printable &x) { return x.printTo(*this); }
+
+    template <typename T>
+    size_t println(const T &x) { return print(x) + println(); }
+    template <typename T>
+    size_t println(const T &x, int base) { return print(x, base) + println(); }
+    size_t println() { return write("\r\n"); }
+
+    size_t printf(const char *format, ...) {
+        char buf[256];
+        va_list args;
+        va_start(args, format);
+        auto n = vsnprintf(buf, sizeof(buf), format, args);
+        va_end(args);
+        if (n < 0) return 0;
+        return write(buf, (size_t)n < sizeof(buf) ? n : sizeof(buf) - 1);
+    }
+
+private:
+    size_t _number(unsigned long long n, int base) {
+        return print(String((unsigned long)n, base < 2 ? 10 : base));
+    }
+
+    size_t _signed(long long n, int base) {
+        if (n < 0 && base == DEC) return print('-') + _number(-n, base);
+        return _number(n, base);
+    }
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    size_t readBytes(uint8_t *buffer, size_t length) {
+        size_t n = 0;
+        int c;
+        while (n < length && (c = read()) >= 0) buffer[n++] = c;
+        return n;
+    }
+
+    String readStringUntil(char terminator) {
+        String s;
+        int c;
+        while ((c = read()) >= 0 && c != terminator) s.concat((char)c);
+        return s;
+    }
+};
+
+class HardwareSerial : public Stream {
+public:
+    void begin(unsigned long, int = SERIAL_8N1, int = SERIAL_FULL) {}
+
+    virtual size_t write(uint8_t c) override {
+        return fputc(c, stdout) == EOF ? 0 : 1;
+    }
+
+    using Print::write;
+
+    virtual int available() override { return 0; }
+    virtual int read() override { return -1; }
+    virtual int peek() override { return -1; }
+};
+
+inline HardwareSerial Serial;
+
+// IPv4 address; the 32-bit form has the first octet in the low byte, like lwIP.
+// lwIP's address, IPv4 only like the gateway's build
+struct ip4_addr {
+    uint32_t addr;
+};
+typedef ip4_addr ip_addr_t;
+
+class IPAddress : public Printable {
+public:
+    IPAddress() : _addr(0) {}
+    IPAddress(uint32_t addr) : _addr(addr) {}
+    IPAddress(const ip_addr_t *addr) : _addr(addr->addr) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : _addr(a | b << 8 | c << 16 | (uint32_t)d << 24) {}
+
+    operator uint32_t() const { return _addr; }
+    uint8_t operator[](int i) const { return _addr >> (i * 8); }
+    bool operator==(const IPAddress &other) const { return _addr == other._addr; }
+    bool operator!=(const IPAddress &other) const { return _addr != other._addr; }
+    bool isSet() const { return _addr != 0; }
+
+    bool fromString(const char *s) {
+        unsigned a, b, c, d;
+        char extra;
+        if (sscanf(s, "%u.%u.%u.%u%c", &a, &b, &c, &d, &extra) != 4 || a > 255 || b > 255 || c > 255 || d > 255) {
+            return false;
+        }
+        *this = IPAddress(a, b, c, d);
+        return true;
+    }
+
+    String toString() const {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+        return String(buf);
+    }
+
+    virtual size_t printTo(Print &p) const override {
+        return p.print(toString());
+    }
+
+private:
+    uint32_t _addr;
+};
+
+// Chip services; heap figures are whatever the test sets.
+class EspClass {
+public:
+    uint32_t free_heap = 40000;
+    uint16_t max_free_block = 30000;
+    uint8_t fragmentation = 10;
+    uint32_t restarts = 0;
+    uint8_t rtc_memory[512] = {};
+
+    uint32_t getChipId() { return 0x424242; }
+    uint32_t getFreeHeap() { return free_heap; }
+    uint16_t getMaxFreeBlockSize() { return max_free_block; }
+    uint8_t getHeapFragmentation() { return fragmentation; }
+
+    void getHeapStats(uint32_t *hfree, uint16_t *hmax, uint8_t *hfrag) {
+        if (hfree) *hfree = free_heap;
+        if (hmax) *hmax = max_free_block;
+        if (hfrag) *hfrag = fragmentation;
+    }
+
+    const char *getSdkVersion() { return "host"; }
+    uint8_t getBootVersion() { return 0; }
+    String getCoreVersion() { return "host"; }
+    String getFullVersion() { return "SDK:host/Core:host"; }
+    String getResetReason() { return "External System"; }
+
+    uint32_t getCycleCount() { return (uint32_t)(HostClock::us * clockCyclesPerMicrosecond()); }
+    void restart() { restarts++; }
+
+    // `offset` in 4-byte blocks, like the SDK
+    bool rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size) {
+        if (offset * 4 + size > sizeof(rtc_memory) || size == 0) return false;
+        memcpy(data, rtc_memory + offset * 4, size);
+        return true;
+    }
+
+    bool rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size) {
+        if (offset * 4 + size > sizeof(rtc_memory) || size == 0) return false;
+        memcpy(rtc_memory + offset * 4, data, size);
+        return true;
+    }
+};
+
+inline EspClass ESP;
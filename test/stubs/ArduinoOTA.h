@@ -0,0 +1,28 @@
+#pragma once
+
+// Host stand-in for ArduinoOTA; starts mDNS like the real one.
+
+#include <Arduino.h>
+#include <ESP8266mDNS.h>
+
+class ArduinoOTAClass {
+public:
+    void setHostname(const char *hostname) { _hostname = hostname; }
+    String getHostname() { return _hostname; }
+    void setPassword(const char *password) { _password = password; }
+    void setPort(uint16_t) {}
+
+    void begin(bool useMDNS = true) {
+        if (useMDNS) MDNS.begin(_hostname.c_str());
+        _begun = true;
+    }
+
+    void handle() {}
+
+private:
+    String _hostname;
+    String _password;
+    bool _begun = false;
+};
+
+inline ArduinoOTAClass ArduinoOTA;
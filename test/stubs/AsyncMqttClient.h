@@ -0,0 +1,158 @@
+#pragma once
+
+// Host stand-in for AsyncMqttClient. Nothing goes on the wire: packets
+// sent by the gateway are recorded, and a test plays the broker by calling
+// the `broker*()` functions, which run the callbacks as the library does.
+
+#include <Arduino.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+enum class AsyncMqttClientDisconnectReason : uint8_t {
+    TCP_DISCONNECTED = 0,
+    MQTT_UNACCEPTABLE_PROTOCOL_VERSION = 1,
+    MQTT_IDENTIFIER_REJECTED = 2,
+    MQTT_SERVER_UNAVAILABLE = 3,
+    MQTT_MALFORMED_CREDENTIALS = 4,
+    MQTT_NOT_AUTHORIZED = 5,
+    ESP8266_NOT_ENOUGH_SPACE = 6,
+    TLS_BAD_FINGERPRINT = 7
+};
+
+struct AsyncMqttClientMessageProperties {
+    uint8_t qos;
+    bool dup;
+    bool retain;
+};
+
+class AsyncMqttClient {
+public:
+    typedef std::function<void(bool sessionPresent)> OnConnectUserCallback;
+    typedef std::function<void(AsyncMqttClientDisconnectReason reason)> OnDisconnectUserCallback;
+    typedef std::function<void(uint16_t packetId, uint8_t qos)> OnSubscribeUserCallback;
+    typedef std::function<void(uint16_t packetId)> OnUnsubscribeUserCallback;
+    typedef std::function<void(char *topic, char *payload, AsyncMqttClientMessageProperties properties,
+        size_t len, size_t index, size_t total)> OnMessageUserCallback;
+    typedef std::function<void(uint16_t packetId)> OnPublishUserCallback;
+
+    struct Packet {
+        uint16_t id;
+        std::string topic;
+        std::string payload;
+        uint8_t qos;
+        bool retain;
+    };
+
+    AsyncMqttClient &setClientId(const char *clientId) { _client_id = clientId; return *this; }
+    AsyncMqttClient &setKeepAlive(uint16_t) { return *this; }
+    AsyncMqttClient &setCleanSession(bool) { return *this; }
+    AsyncMqttClient &setCredentials(const char *, const char * = nullptr) { return *this; }
+    AsyncMqttClient &setServer(IPAddress ip, uint16_t port) { server_ip = ip; server_host.clear(); server_port = port; return *this; }
+    AsyncMqttClient &setServer(const char *host, uint16_t port) { server_ip = IPAddress(); server_host = host; server_port = port; return *this; }
+
+    AsyncMqttClient &onConnect(OnConnectUserCallback callback) { _on_connect.push_back(callback); return *this; }
+    AsyncMqttClient &onDisconnect(OnDisconnectUserCallback callback) { _on_disconnect.push_back(callback); return *this; }
+    AsyncMqttClient &onSubscribe(OnSubscribeUserCallback callback) { _on_subscribe.push_back(callback); return *this; }
+    AsyncMqttClient &onUnsubscribe(OnUnsubscribeUserCallback callback) { _on_unsubscribe.push_back(callback); return *this; }
+    AsyncMqttClient &onMessage(OnMessageUserCallback callback) { _on_message.push_back(callback); return *this; }
+    AsyncMqttClient &onPublish(OnPublishUserCallback callback) { _on_publish.push_back(callback); return *this; }
+
+    const char *getClientId() const { return _client_id.c_str(); }
+    bool connected() const { return _connected; }
+
+    void connect() {
+        connects++;
+        _connecting = true;
+    }
+
+    void disconnect(bool = false) {
+        if (_connected || _connecting) brokerDisconnect(AsyncMqttClientDisconnectReason::TCP_DISCONNECTED);
+    }
+
+    uint16_t subscribe(const char *topic, uint8_t qos) {
+        if (!_connected) return 0;
+        subscribed.push_back(Packet { _nextId(), topic, "", qos, false });
+        return subscribed.back().id;
+    }
+
+    uint16_t unsubscribe(const char *) {
+        return _connected ? _nextId() : 0;
+    }
+
+    // 0 when not connected or when the send buffer is full, like the library
+    uint16_t publish(const char *topic, uint8_t qos, bool retain, const char *payload = nullptr, size_t length = 0,
+                     bool = false, uint16_t = 0) {
+        if (!_connected || send_capacity == 0) return 0;
+        send_capacity--;
+
+        if (payload && !length) length = strlen(payload);
+        published.push_back(Packet { qos ? _nextId() : (uint16_t)1, topic, std::string(payload ? payload : "", length), qos, retain });
+        return published.back().id;
+    }
+
+    // test side
+
+    IPAddress server_ip;
+    std::string server_host;
+    uint16_t server_port = 0;
+    uint32_t connects = 0;
+    size_t send_capacity = SIZE_MAX; // publishes accepted before the buffer is full
+
+    std::vector<Packet> published;
+    std::vector<Packet> subscribed;
+
+    bool isConnecting() const { return _connecting; }
+
+    void brokerConnAck(bool sessionPresent = false) {
+        _connecting = false;
+        _connected = true;
+        for (auto &cb : _on_connect) cb(sessionPresent);
+    }
+
+    void brokerDisconnect(AsyncMqttClientDisconnectReason reason = AsyncMqttClientDisconnectReason::TCP_DISCONNECTED) {
+        _connecting = false;
+        _connected = false;
+        for (auto &cb : _on_disconnect) cb(reason);
+    }
+
+    void brokerSubAck(uint16_t packetId, uint8_t qos = 1) {
+        for (auto &cb : _on_subscribe) cb(packetId, qos);
+    }
+
+    void brokerPubAck(uint16_t packetId) {
+        for (auto &cb : _on_publish) cb(packetId);
+    }
+
+    // One piece of a message; `index` and `total` as for a fragmented payload.
+    void brokerMessage(const char *topic, const char *payload, size_t len, size_t index, size_t total,
+                       uint8_t qos = 1, bool retain = false) {
+        std::string t(topic);
+        std::string p(payload, len);
+        AsyncMqttClientMessageProperties properties = { qos, false, retain };
+        for (auto &cb : _on_message) cb(&t[0], &p[0], properties, len, index, total);
+    }
+
+    void brokerMessage(const char *topic, const char *payload) {
+        auto len = strlen(payload);
+        brokerMessage(topic, payload, len, 0, len);
+    }
+
+private:
+    std::string _client_id;
+    bool _connected = false;
+    bool _connecting = false;
+    uint16_t _last_id = 0;
+
+    std::vector<OnConnectUserCallback> _on_connect;
+    std::vector<OnDisconnectUserCallback> _on_disconnect;
+    std::vector<OnSubscribeUserCallback> _on_subscribe;
+    std::vector<OnUnsubscribeUserCallback> _on_unsubscribe;
+    std::vector<OnMessageUserCallback> _on_message;
+    std::vector<OnPublishUserCallback> _on_publish;
+
+    uint16_t _nextId() {
+        if (++_last_id == 0) _last_id = 1;
+        return _last_id;
+    }
+};
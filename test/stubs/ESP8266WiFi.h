@@ -0,0 +1,254 @@
+#pragma once
+
+// Host stand-in for the ESP8266 WiFi station. Calls are recorded; a test
+// plays the access point by calling `stationGotIP()` and
+// `stationDisconnected()`, which run the event handlers like the SDK does.
+
+#include <Arduino.h>
+#include <functional>
+#include <memory>
+#include <vector>
+
+typedef enum {
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3
+} WiFiMode_t;
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+struct WiFiEventStationModeGotIP {
+    IPAddress ip;
+    IPAddress mask;
+    IPAddress gw;
+};
+
+struct WiFiEventStationModeDisconnected {
+    String ssid;
+    uint8_t bssid[6];
+    uint8_t reason;
+};
+
+struct WiFiEventHandlerOpaque {
+    virtual ~WiFiEventHandlerOpaque() {}
+};
+
+// Events reach a handler for as long as its returned pointer is kept.
+typedef std::shared_ptr<WiFiEventHandlerOpaque> WiFiEventHandler;
+
+class ESP8266WiFiClass {
+public:
+    // what the last begin() and config() asked for
+    struct Begin {
+        String ssid;
+        String psk;
+        int32_t channel;
+        bool has_bssid;
+        uint8_t bssid[6];
+    };
+
+    struct Config {
+        IPAddress ip;
+        IPAddress gw;
+        IPAddress mask;
+        IPAddress dns;
+    };
+
+    bool mode(WiFiMode_t m) { _mode = m; return true; }
+    WiFiMode_t getMode() { return _mode; }
+
+    void persistent(bool persistent) { _persistent = persistent; }
+    bool setAutoConnect(bool autoConnect) { _auto_connect = autoConnect; return true; }
+    bool setAutoReconnect(bool) { return true; }
+
+    bool setHostname(const char *hostname) { _hostname = hostname; return true; }
+    const char *getHostname() { return _hostname.c_str(); }
+    String hostname() { return _hostname; }
+
+    // static when `local` is set, DHCP when it is 0
+    bool config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns1 = (uint32_t)0, IPAddress = (uint32_t)0) {
+        config_calls++;
+        last_config = Config { local, gateway, subnet, dns1 };
+        _dhcp = !local.isSet();
+        return true;
+    }
+
+    wl_status_t begin(const char *ssid, const char *passphrase = nullptr, int32_t channel = 0,
+                      const uint8_t *bssid = nullptr, bool connect = true) {
+        begins++;
+        last_begin.ssid = ssid;
+        last_begin.psk = passphrase ? passphrase : "";
+        last_begin.channel = channel;
+        last_begin.has_bssid = bssid != nullptr;
+        if (bssid) memcpy(last_begin.bssid, bssid, 6);
+
+        if (_persistent) {
+            _ssid = last_begin.ssid;
+            _psk = last_begin.psk;
+        }
+        if (connect) _status = WL_DISCONNECTED;
+        return _status;
+    }
+
+    wl_status_t begin(const String &ssid, const String &passphrase = String(), int32_t channel = 0,
+                      const uint8_t *bssid = nullptr, bool connect = true) {
+        return begin(ssid.c_str(), passphrase.c_str(), channel, bssid, connect);
+    }
+
+    // with the saved config
+    wl_status_t begin() {
+        return begin(_ssid, _psk);
+    }
+
+    bool disconnect(bool = false) {
+        if (_status == WL_CONNECTED) stationDisconnected();
+        return true;
+    }
+
+    bool reconnect() { return true; }
+
+    bool isConnected() { return _status == WL_CONNECTED; }
+    wl_status_t status() { return _status; }
+
+    String SSID() const { return _ssid; }
+    String psk() const { return _psk; }
+    uint8_t *BSSID() { return _bssid; }
+    int32_t channel() { return _channel; }
+    int32_t RSSI() { return -60; }
+    String macAddress() { return "5C:CF:7F:42:42:42"; }
+
+    IPAddress localIP() { return _ip; }
+    IPAddress gatewayIP() { return _gw; }
+    IPAddress subnetMask() { return _mask; }
+    IPAddress dnsIP(uint8_t = 0) { return _dns; }
+
+    // Blocking resolve; names in `hosts` resolve, others fail.
+    int hostByName(const char *name, IPAddress &result, uint32_t = 10000) {
+        for (auto &h : hosts) {
+            if (h.first == name) {
+                result = h.second;
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    bool beginSmartConfig() { _smart_config = true; return true; }
+    bool stopSmartConfig() { _smart_config = false; return true; }
+    bool smartConfigDone() { return _smart_config && _smart_config_done; }
+
+    WiFiEventHandler onStationModeGotIP(std::function<void(const WiFiEventStationModeGotIP &)> f) {
+        auto handler = std::make_shared<Handler<WiFiEventStationModeGotIP>>(f);
+        _got_ip.push_back(handler);
+        return handler;
+    }
+
+    WiFiEventHandler onStationModeDisconnected(std::function<void(const WiFiEventStationModeDisconnected &)> f) {
+        auto handler = std::make_shared<Handler<WiFiEventStationModeDisconnected>>(f);
+        _disconnected.push_back(handler);
+        return handler;
+    }
+
+    // test side
+
+    uint32_t begins = 0;
+    uint32_t config_calls = 0;
+    Begin last_begin = {};
+    Config last_config = {};
+    std::vector<std::pair<String, IPAddress>> hosts;
+
+    // credentials saved in flash
+    void setSaved(const char *ssid, const char *psk) {
+        _ssid = ssid;
+        _psk = psk;
+    }
+
+    bool isDhcp() const { return _dhcp; }
+
+    // The association and the IP config completed. Without DHCP the
+    // address is the static one given to config().
+    void stationGotIP(const uint8_t *bssid, int32_t channel, const WiFiEventStationModeGotIP &lease, IPAddress dns) {
+        memcpy(_bssid, bssid, 6);
+        _channel = channel;
+        if (_dhcp) {
+            _ip = lease.ip;
+            _gw = lease.gw;
+            _mask = lease.mask;
+            _dns = dns;
+        } else {
+            _ip = last_config.ip;
+            _gw = last_config.gw;
+            _mask = last_config.mask;
+            _dns = last_config.dns;
+        }
+        _status = WL_CONNECTED;
+
+        WiFiEventStationModeGotIP event = { _ip, _mask, _gw };
+        _fire(_got_ip, event);
+    }
+
+    void stationDisconnected(uint8_t reason = 8) {
+        _status = WL_DISCONNECTED;
+        _ip = IPAddress();
+
+        WiFiEventStationModeDisconnected event;
+        event.ssid = _ssid;
+        memcpy(event.bssid, _bssid, 6);
+        event.reason = reason;
+        _fire(_disconnected, event);
+    }
+
+    void smartConfigReceived(const char *ssid, const char *psk) {
+        _ssid = ssid;
+        _psk = psk;
+        _smart_config_done = true;
+    }
+
+private:
+    template <typename Event>
+    struct Handler : public WiFiEventHandlerOpaque {
+        Handler(std::function<void(const Event &)> f) : f(f) {}
+        std::function<void(const Event &)> f;
+    };
+
+    WiFiMode_t _mode = WIFI_OFF;
+    wl_status_t _status = WL_IDLE_STATUS;
+    bool _persistent = true;
+    bool _auto_connect = true;
+    bool _dhcp = true;
+    bool _smart_config = false;
+    bool _smart_config_done = false;
+
+    String _hostname;
+    String _ssid;
+    String _psk;
+    uint8_t _bssid[6] = {};
+    int32_t _channel = 0;
+
+    IPAddress _ip;
+    IPAddress _gw;
+    IPAddress _mask;
+    IPAddress _dns;
+
+    std::vector<std::weak_ptr<Handler<WiFiEventStationModeGotIP>>> _got_ip;
+    std::vector<std::weak_ptr<Handler<WiFiEventStationModeDisconnected>>> _disconnected;
+
+    template <typename Event>
+    static void _fire(std::vector<std::weak_ptr<Handler<Event>>> &handlers, const Event &event) {
+        // copied: a handler may register another one
+        auto alive = handlers;
+        for (auto &weak : alive) {
+            if (auto handler = weak.lock()) handler->f(event);
+        }
+    }
+};
+
+inline ESP8266WiFiClass WiFi;
@@ -0,0 +1,40 @@
+#pragma once
+
+// Host stand-in for the ESP8266 mDNS responder; running once begun.
+
+#include <Arduino.h>
+#include <functional>
+
+class MDNSResponder {
+public:
+    using MDNSHostProbeFn = std::function<void(const char *, bool)>;
+
+    bool begin(const char *hostname) {
+        _hostname = hostname;
+        _running = true;
+        if (_probe_fn) _probe_fn(hostname, true);
+        return true;
+    }
+
+    bool setHostProbeResultCallback(MDNSHostProbeFn fn) {
+        _probe_fn = fn;
+        return true;
+    }
+
+    bool end() {
+        _running = false;
+        return true;
+    }
+
+    bool isRunning() { return _running; }
+    void update() {}
+    bool addService(const char *, const char *, uint16_t) { return true; }
+    void enableArduino(uint16_t, bool = false) {}
+
+private:
+    String _hostname;
+    bool _running = false;
+    MDNSHostProbeFn _probe_fn;
+};
+
+inline MDNSResponder MDNS;
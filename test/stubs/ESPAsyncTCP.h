@@ -0,0 +1,83 @@
+#pragma once
+
+// Host stand-in for an ESPAsyncTCP connection: what is sent is collected
+// in `sent`, and `space()` is what the test leaves in the send window.
+
+#include <Arduino.h>
+#include <functional>
+#include <string>
+
+class AsyncClient;
+
+typedef std::function<void(void *, AsyncClient *)> AcConnectHandler;
+typedef std::function<void(void *, AsyncClient *, size_t len, uint32_t time)> AcAckHandler;
+typedef std::function<void(void *, AsyncClient *, int8_t error)> AcErrorHandler;
+typedef std::function<void(void *, AsyncClient *, void *data, size_t len)> AcDataHandler;
+typedef std::function<void(void *, AsyncClient *, uint32_t time)> AcTimeoutHandler;
+
+class AsyncClient {
+public:
+    void setRxTimeout(uint32_t) {}
+
+    void onError(AcErrorHandler cb, void *arg = 0) { _on_error = cb; _error_arg = arg; }
+    void onData(AcDataHandler cb, void *arg = 0) { _on_data = cb; _data_arg = arg; }
+    void onAck(AcAckHandler cb, void *arg = 0) { _on_ack = cb; _ack_arg = arg; }
+    void onPoll(AcConnectHandler cb, void *arg = 0) { _on_poll = cb; _poll_arg = arg; }
+    void onTimeout(AcTimeoutHandler cb, void *arg = 0) { _on_timeout = cb; _timeout_arg = arg; }
+    void onDisconnect(AcConnectHandler cb, void *arg = 0) { _on_disconnect = cb; _disconnect_arg = arg; }
+
+    bool canSend() { return !closed && window > 0; }
+    size_t space() { return closed ? 0 : window; }
+
+    size_t add(const char *data, size_t size, uint8_t = 0) {
+        auto n = size < window ? size : window;
+        sent.append(data, n);
+        window -= n;
+        return n;
+    }
+
+    bool send() { return !closed; }
+
+    size_t write(const char *data, size_t size) {
+        auto n = add(data, size);
+        send();
+        return n;
+    }
+
+    size_t write(const char *data) { return write(data, strlen(data)); }
+
+    void close(bool = false) {
+        if (closed) return;
+        closed = true;
+        if (_on_disconnect) _on_disconnect(_disconnect_arg, this);
+    }
+
+    // test side
+
+    std::string sent;
+    size_t window = 1460;
+    bool closed = false;
+
+    void ack(size_t len) {
+        window += len;
+        if (_on_ack) _on_ack(_ack_arg, this, len, 0);
+    }
+
+    void poll() {
+        if (_on_poll) _on_poll(_poll_arg, this);
+    }
+
+private:
+    AcErrorHandler _on_error;
+    AcDataHandler _on_data;
+    AcAckHandler _on_ack;
+    AcConnectHandler _on_poll;
+    AcTimeoutHandler _on_timeout;
+    AcConnectHandler _on_disconnect;
+    void *_error_arg = 0;
+    void *_data_arg = 0;
+    void *_ack_arg = 0;
+    void *_poll_arg = 0;
+    void *_timeout_arg = 0;
+    void *_disconnect_arg = 0;
+};
@@ -0,0 +1,482 @@
+#pragma once
+
+// Host stand-in for ESPAsyncWebServer with ASYNCWEBSERVER_REGEX. There is
+// no socket: a test builds an AsyncWebServerRequest and passes it to
+// `AsyncWebServer::handle()`, which picks the handler like the library
+// (first match in registration order), streams the body to it in chunks,
+// then runs its request callback. The response stays with the request.
+
+#include <Arduino.h>
+#include <ESPAsyncTCP.h>
+#include <FS.h>
+#include <functional>
+#include <memory>
+#include <regex>
+#include <string>
+#include <vector>
+
+typedef enum {
+    HTTP_GET = 0b00000001,
+    HTTP_POST = 0b00000010,
+    HTTP_DELETE = 0b00000100,
+    HTTP_PUT = 0b00001000,
+    HTTP_PATCH = 0b00010000,
+    HTTP_HEAD = 0b00100000,
+    HTTP_OPTIONS = 0b01000000,
+    HTTP_ANY = 0b01111111
+} WebRequestMethod;
+
+typedef uint8_t WebRequestMethodComposite;
+
+typedef enum {
+    RESPONSE_SETUP,
+    RESPONSE_HEADERS,
+    RESPONSE_CONTENT,
+    RESPONSE_WAIT_ACK,
+    RESPONSE_END,
+    RESPONSE_FAILED
+} WebResponseState;
+
+class AsyncWebServer;
+class AsyncWebServerRequest;
+
+class AsyncWebHeader {
+public:
+    AsyncWebHeader(const String &name, const String &value) : _name(name), _value(value) {}
+
+    const String &name() const { return _name; }
+    const String &value() const { return _value; }
+
+private:
+    String _name;
+    String _value;
+};
+
+class AsyncWebParameter {
+public:
+    AsyncWebParameter(const String &name, const String &value, bool form = false, bool file = false, size_t size = 0)
+        : _name(name), _value(value), _size(size), _is_form(form), _is_file(file) {}
+
+    const String &name() const { return _name; }
+    const String &value() const { return _value; }
+    size_t size() const { return _size; }
+    bool isPost() const { return _is_form; }
+    bool isFile() const { return _is_file; }
+
+private:
+    String _name;
+    String _value;
+    size_t _size;
+    bool _is_form;
+    bool _is_file;
+};
+
+class AsyncWebServerResponse {
+public:
+    AsyncWebServerResponse()
+        : _code(0), _contentLength(0), _sendContentLength(true), _chunked(false), _headLength(0), _state(RESPONSE_SETUP) {}
+    virtual ~AsyncWebServerResponse() {}
+
+    void setCode(int code) { _code = code; }
+    void setContentLength(size_t len) { _contentLength = len; }
+    void setContentType(const String &type) { _contentType = type; }
+
+    void addHeader(const String &name, const String &value) {
+        _headers.push_back(AsyncWebHeader(name, value));
+    }
+
+    String _assembleHead(uint8_t version) {
+        String head = String("HTTP/1.") + String((int)version) + " " + String(_code) + "\r\n";
+        if (_sendContentLength) head += String("Content-Length: ") + String((unsigned long)_contentLength) + "\r\n";
+        if (_contentType.length()) head += String("Content-Type: ") + _contentType + "\r\n";
+        for (auto &h : _headers) head += h.name() + ": " + h.value() + "\r\n";
+        head += "\r\n";
+        _headLength = head.length();
+        return head;
+    }
+
+    virtual bool _started() const { return _state > RESPONSE_SETUP; }
+    virtual bool _finished() const { return _state > RESPONSE_WAIT_ACK; }
+    virtual bool _failed() const { return _state == RESPONSE_FAILED; }
+    virtual bool _sourceValid() const { return true; }
+    virtual void _respond(AsyncWebServerRequest *) { _state = RESPONSE_END; }
+    virtual size_t _ack(AsyncWebServerRequest *, size_t, uint32_t) { return 0; }
+
+    // test side
+
+    int code() const { return _code; }
+    const String &contentType() const { return _contentType; }
+
+    const AsyncWebHeader *header(const char *name) const {
+        for (auto &h : _headers) {
+            if (h.name().equalsIgnoreCase(name)) return &h;
+        }
+        return nullptr;
+    }
+
+    // The content as it would be sent now; a response that streams from a
+    // buffer reads it only at this point, like the library does.
+    virtual std::string body() const { return std::string(); }
+
+protected:
+    int _code;
+    std::vector<AsyncWebHeader> _headers;
+    String _contentType;
+    size_t _contentLength;
+    bool _sendContentLength;
+    bool _chunked;
+    size_t _headLength;
+    WebResponseState _state;
+};
+
+class AsyncBasicResponse : public AsyncWebServerResponse {
+public:
+    AsyncBasicResponse(int code, const String &contentType = String(), const String &content = String()) : _content(content) {
+        _code = code;
+        _contentType = contentType;
+        _contentLength = content.length();
+    }
+
+    virtual std::string body() const override { return std::string(_content.c_str(), _content.length()); }
+
+private:
+    String _content;
+};
+
+class AsyncProgmemResponse : public AsyncWebServerResponse {
+public:
+    AsyncProgmemResponse(int code, const String &contentType, const uint8_t *content, size_t len) : _content(content) {
+        _code = code;
+        _contentType = contentType;
+        _contentLength = len;
+    }
+
+    virtual std::string body() const override { return std::string(reinterpret_cast<const char *>(_content), _contentLength); }
+
+private:
+    const uint8_t *_content;
+};
+
+class AsyncFileResponse : public AsyncWebServerResponse {
+public:
+    AsyncFileResponse(File content, const String &path, const String &contentType) : _content(content) {
+        _code = 200;
+        _contentType = contentType;
+        _contentLength = content.size();
+        if (String(content.name()).endsWith(".gz") && !path.endsWith(".gz")) addHeader("Content-Encoding", "gzip");
+    }
+
+    virtual std::string body() const override {
+        auto file = _content;
+        file.seek(0);
+        std::string s(file.size(), 0);
+        file.read(reinterpret_cast<uint8_t *>(&s[0]), s.size());
+        return s;
+    }
+
+private:
+    File _content;
+};
+
+class AsyncResponseStream : public AsyncWebServerResponse, public Print {
+public:
+    AsyncResponseStream(const String &contentType, size_t) {
+        _code = 200;
+        _contentType = contentType;
+        _sendContentLength = false;
+    }
+
+    virtual size_t write(uint8_t c) override {
+        _content += (char)c;
+        return 1;
+    }
+
+    virtual size_t write(const uint8_t *data, size_t len) override {
+        _content.append(reinterpret_cast<const char *>(data), len);
+        return len;
+    }
+
+    using Print::write;
+
+    virtual std::string body() const override { return _content; }
+
+private:
+    std::string _content;
+};
+
+typedef std::function<void(AsyncWebServerRequest *request)> ArRequestHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *request, const String &filename, size_t index,
+    uint8_t *data, size_t len, bool final)> ArUploadHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *request, uint8_t *data, size_t len,
+    size_t index, size_t total)> ArBodyHandlerFunction;
+
+class AsyncWebServerRequest {
+public:
+    void *_tempObject;
+
+    AsyncWebServerRequest(WebRequestMethod method, const String &url, const std::string &body = std::string())
+        : _tempObject(nullptr), _method(method), _url(url), _body(body) {
+        auto query = url.indexOf('?');
+        if (query >= 0) {
+            _url = url.substring(0, query);
+            _parseQuery(url.substring(query + 1));
+        }
+    }
+
+    // frees the temp object, like the library
+    ~AsyncWebServerRequest() {
+        if (_tempObject) free(_tempObject);
+    }
+
+    WebRequestMethodComposite method() const { return _method; }
+    const String &url() const { return _url; }
+    uint8_t version() const { return 1; }
+    AsyncClient *client() { return &_client; }
+    size_t contentLength() const { return _body.size(); }
+
+    const char *methodToString() const {
+        switch (_method) {
+        case HTTP_GET: return "GET";
+        case HTTP_POST: return "POST";
+        case HTTP_DELETE: return "DELETE";
+        case HTTP_PUT: return "PUT";
+        case HTTP_PATCH: return "PATCH";
+        case HTTP_HEAD: return "HEAD";
+        case HTTP_OPTIONS: return "OPTIONS";
+        default: return "UNKNOWN";
+        }
+    }
+
+    const String &pathArg(size_t i) const {
+        static const String empty;
+        return i < _path_args.size() ? _path_args[i] : empty;
+    }
+
+    bool hasHeader(const String &name) const { return getHeader(name) != nullptr; }
+
+    AsyncWebHeader *getHeader(const String &name) const {
+        for (auto &h : _headers) {
+            if (h.name().equalsIgnoreCase(name)) return const_cast<AsyncWebHeader *>(&h);
+        }
+        return nullptr;
+    }
+
+    bool hasParam(const String &name, bool post = false, bool file = false) const {
+        return getParam(name, post, file) != nullptr;
+    }
+
+    AsyncWebParameter *getParam(const String &name, bool post = false, bool file = false) const {
+        for (auto &p : _params) {
+            if (p.name() == name && p.isPost() == post && p.isFile() == file) return const_cast<AsyncWebParameter *>(&p);
+        }
+        return nullptr;
+    }
+
+    void send(AsyncWebServerResponse *response) {
+        if (_response) {
+            delete response; // only the first response goes out
+            return;
+        }
+        _response.reset(response);
+        _response->_respond(this);
+    }
+
+    void send(int code, const String &contentType = String(), const String &content = String()) {
+        send(beginResponse(code, contentType, content));
+    }
+
+    AsyncWebServerResponse *beginResponse(int code, const String &contentType = String(), const String &content = String()) {
+        return new AsyncBasicResponse(code, contentType, content);
+    }
+
+    AsyncWebServerResponse *beginResponse(File content, const String &path, const String &contentType = String(), bool = false) {
+        return new AsyncFileResponse(content, path, contentType);
+    }
+
+    AsyncWebServerResponse *beginResponse_P(int code, const String &contentType, const uint8_t *content, size_t len) {
+        return new AsyncProgmemResponse(code, contentType, content, len);
+    }
+
+    AsyncWebServerResponse *beginResponse_P(int code, const String &contentType, PGM_P content) {
+        return beginResponse_P(code, contentType, reinterpret_cast<const uint8_t *>(content), strlen(content));
+    }
+
+    AsyncResponseStream *beginResponseStream(const String &contentType, size_t bufferSize = 1460) {
+        return new AsyncResponseStream(contentType, bufferSize);
+    }
+
+    // test side
+
+    void addHeader(const String &name, const String &value) { _headers.push_back(AsyncWebHeader(name, value)); }
+    void addParam(const String &name, const String &value) { _params.push_back(AsyncWebParameter(name, value)); }
+
+    const std::string &body() const { return _body; }
+    AsyncWebServerResponse *response() const { return _response.get(); }
+
+private:
+    friend class AsyncCallbackWebHandler;
+
+    WebRequestMethod _method;
+    String _url;
+    std::string _body;
+    std::vector<AsyncWebHeader> _headers;
+    std::vector<AsyncWebParameter> _params;
+    std::vector<String> _path_args;
+    AsyncClient _client;
+    std::unique_ptr<AsyncWebServerResponse> _response;
+
+    void _parseQuery(const String &query) {
+        unsigned from = 0;
+        while (from < query.length()) {
+            auto end = query.indexOf('&', from);
+            auto pair = query.substring(from, end < 0 ? query.length() : end);
+            auto eq = pair.indexOf('=');
+            if (eq < 0) {
+                addParam(pair, String());
+            } else {
+                addParam(pair.substring(0, eq), pair.substring(eq + 1));
+            }
+            if (end < 0) break;
+            from = end + 1;
+        }
+    }
+};
+
+class AsyncWebHandler {
+public:
+    virtual ~AsyncWebHandler() {}
+    virtual bool canHandle(AsyncWebServerRequest *) { return false; }
+    virtual void handleRequest(AsyncWebServerRequest *) {}
+    virtual void handleUpload(AsyncWebServerRequest *, const String &, size_t, uint8_t *, size_t, bool) {}
+    virtual void handleBody(AsyncWebServerRequest *, uint8_t *, size_t, size_t, size_t) {}
+    virtual bool isRequestHandlerTrivial() { return true; }
+};
+
+class AsyncCallbackWebHandler : public AsyncWebHandler {
+public:
+    AsyncCallbackWebHandler(const String &uri, WebRequestMethodComposite method)
+        : _uri(uri), _method(method), _is_regex(uri.startsWith("^") && uri.endsWith("$")) {
+        if (_is_regex) _regex = std::regex(uri.c_str());
+    }
+
+    void onRequest(ArRequestHandlerFunction fn) { _on_request = fn; }
+    void onUpload(ArUploadHandlerFunction fn) { _on_upload = fn; }
+    void onBody(ArBodyHandlerFunction fn) { _on_body = fn; }
+
+    virtual bool canHandle(AsyncWebServerRequest *request) override {
+        if (!_on_request || !(_method & request->method())) return false;
+
+        if (_is_regex) {
+            std::cmatch matches;
+            if (!std::regex_search(request->url().c_str(), matches, _regex)) return false;
+            request->_path_args.clear();
+            for (size_t i = 1; i < matches.size(); i++) request->_path_args.push_back(String(matches[i].str()));
+            return true;
+        }
+
+        return request->url() == _uri || request->url().startsWith(_uri + "/");
+    }
+
+    virtual void handleRequest(AsyncWebServerRequest *request) override {
+        if (_on_request) _on_request(request);
+        else request->send(500);
+    }
+
+    virtual void handleBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) override {
+        if (_on_body) _on_body(request, data, len, index, total);
+    }
+
+    virtual bool isRequestHandlerTrivial() override { return !_on_body; }
+
+private:
+    String _uri;
+    WebRequestMethodComposite _method;
+    bool _is_regex;
+    std::regex _regex;
+    ArRequestHandlerFunction _on_request;
+    ArUploadHandlerFunction _on_upload;
+    ArBodyHandlerFunction _on_body;
+};
+
+class AsyncWebServer {
+public:
+    AsyncWebServer(uint16_t port) : _port(port), _begun(false) {
+        _servers().push_back(this);
+    }
+
+    ~AsyncWebServer() {
+        auto &servers = _servers();
+        servers.erase(std::remove(servers.begin(), servers.end(), this), servers.end());
+    }
+
+    void begin() { _begun = true; }
+    void end() { _begun = false; }
+
+    AsyncCallbackWebHandler &on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+                                ArUploadHandlerFunction onUpload = nullptr, ArBodyHandlerFunction onBody = nullptr) {
+        auto handler = new AsyncCallbackWebHandler(uri, method);
+        handler->onRequest(onRequest);
+        handler->onUpload(onUpload);
+        handler->onBody(onBody);
+        _owned.emplace_back(handler);
+        _handlers.push_back(handler);
+        return *handler;
+    }
+
+    AsyncWebHandler &addHandler(AsyncWebHandler *handler) {
+        _handlers.push_back(handler);
+        return *handler;
+    }
+
+    void onNotFound(ArRequestHandlerFunction fn) { _not_found = fn; }
+
+    // test side
+
+    // the server listening on `port`
+    static AsyncWebServer *onPort(uint16_t port) {
+        for (auto server : _servers()) {
+            if (server->_port == port) return server;
+        }
+        return nullptr;
+    }
+
+    bool isBegun() const { return _begun; }
+
+    // The handler `handle()` would pick, with the path args of the request
+    // filled in, or null if none matches.
+    AsyncWebHandler *route(AsyncWebServerRequest &request) {
+        for (auto handler : _handlers) {
+            if (handler->canHandle(&request)) return handler;
+        }
+        return nullptr;
+    }
+
+    void handle(AsyncWebServerRequest &request, size_t chunk = 1460) {
+        auto handler = route(request);
+        if (!handler) {
+            if (_not_found) _not_found(&request);
+            else request.send(404);
+            return;
+        }
+
+        auto &body = request.body();
+        for (size_t index = 0; index < body.size(); index += chunk) {
+            auto len = std::min(chunk, body.size() - index);
+            std::string piece = body.substr(index, len); // the library hands out a mutable buffer
+            handler->handleBody(&request, reinterpret_cast<uint8_t *>(&piece[0]), len, index, body.size());
+        }
+        handler->handleRequest(&request);
+    }
+
+private:
+    uint16_t _port;
+    bool _begun;
+    std::vector<AsyncWebHandler *> _handlers;
+    std::vector<std::unique_ptr<AsyncWebHandler>> _owned;
+    ArRequestHandlerFunction _not_found;
+
+    static std::vector<AsyncWebServer *> &_servers() {
+        static std::vector<AsyncWebServer *> servers;
+        return servers;
+    }
+};
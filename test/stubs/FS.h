@@ -0,0 +1,145 @@
+#pragma once
+
+// Host stand-in for the Arduino FS API over an in-memory file tree. Files
+// are shared between handles, writes land at once, and a test can make
+// opens or writes fail to play a full or broken flash.
+
+#include <Arduino.h>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace fs {
+
+class File : public Stream {
+public:
+    File() : _pos(0), _writable(false) {}
+
+    File(std::shared_ptr<std::string> data, const std::string &name, bool writable, bool append, const bool *fail_writes)
+        : _data(data), _name(name), _pos(append ? data->size() : 0), _writable(writable), _fail_writes(fail_writes) {}
+
+    explicit operator bool() const { return _data != nullptr; }
+
+    virtual size_t write(uint8_t c) override {
+        return write(&c, 1);
+    }
+
+    virtual size_t write(const uint8_t *buf, size_t size) override {
+        if (!_data || !_writable || (_fail_writes && *_fail_writes)) return 0;
+        if (_pos > _data->size()) _data->resize(_pos);
+        _data->replace(_pos, std::min(size, _data->size() - _pos), reinterpret_cast<const char *>(buf), size);
+        _pos += size;
+        return size;
+    }
+
+    using Print::write;
+
+    virtual int available() override { return _data && _pos < _data->size() ? _data->size() - _pos : 0; }
+    virtual int read() override { return available() ? (uint8_t)(*_data)[_pos++] : -1; }
+    virtual int peek() override { return available() ? (uint8_t)(*_data)[_pos] : -1; }
+
+    size_t read(uint8_t *buf, size_t size) {
+        auto n = std::min<size_t>(size, available());
+        if (n) memcpy(buf, _data->data() + _pos, n);
+        _pos += n;
+        return n;
+    }
+
+    bool seek(uint32_t pos) {
+        if (!_data || pos > _data->size()) return false;
+        _pos = pos;
+        return true;
+    }
+
+    size_t position() const { return _pos; }
+    size_t size() const { return _data ? _data->size() : 0; }
+    const char *name() const { return _name.c_str(); }
+    void flush() {}
+    void close() { _data.reset(); }
+
+private:
+    std::shared_ptr<std::string> _data;
+    std::string _name;
+    size_t _pos;
+    bool _writable;
+    const bool *_fail_writes = nullptr;
+};
+
+class FS {
+public:
+    bool begin() { mounted = true; return true; }
+    void end() { mounted = false; }
+    bool format() { _files.clear(); return true; }
+
+    // "r", "r+", "w", "w+", "a" or "a+"
+    File open(const char *path, const char *mode) {
+        if (fail_opens) return File();
+
+        auto it = _files.find(path);
+        if (mode[0] == 'r' && it == _files.end()) return File();
+
+        if (it == _files.end()) {
+            it = _files.emplace(path, std::make_shared<std::string>()).first;
+        } else if (mode[0] == 'w') {
+            // a new file: handles still open on the old one keep it
+            it->second = std::make_shared<std::string>();
+        }
+
+        bool writable = mode[0] != 'r' || mode[1] == '+';
+        return File(it->second, _basename(path), writable, mode[0] == 'a', &fail_writes);
+    }
+
+    File open(const String &path, const char *mode) { return open(path.c_str(), mode); }
+
+    bool exists(const char *path) { return _files.count(path) != 0; }
+    bool exists(const String &path) { return exists(path.c_str()); }
+
+    bool remove(const char *path) { return _files.erase(path) != 0; }
+    bool remove(const String &path) { return remove(path.c_str()); }
+
+    // replaces `to`, like LittleFS
+    bool rename(const char *from, const char *to) {
+        if (fail_writes) return false;
+        auto it = _files.find(from);
+        if (it == _files.end()) return false;
+        auto data = it->second;
+        _files.erase(it);
+        _files[to] = data;
+        return true;
+    }
+
+    bool rename(const String &from, const String &to) { return rename(from.c_str(), to.c_str()); }
+
+    // test side
+
+    bool mounted = false;
+    bool fail_opens = false;
+    bool fail_writes = false;
+
+    void put(const char *path, const std::string &content) {
+        _files[path] = std::make_shared<std::string>(content);
+    }
+
+    std::string get(const char *path) const {
+        auto it = _files.find(path);
+        return it == _files.end() ? std::string() : *it->second;
+    }
+
+    void clear() {
+        _files.clear();
+        fail_opens = fail_writes = false;
+    }
+
+private:
+    std::map<std::string, std::shared_ptr<std::string>> _files;
+
+    static std::string _basename(const char *path) {
+        auto slash = strrchr(path, '/');
+        return slash ? slash + 1 : path;
+    }
+};
+
+} // namespace fs
+
+using fs::FS;
+using fs::File;
@@ -0,0 +1,32 @@
+#pragma once
+
+// Host stand-in for IRremoteESP8266's sender: raw frames are recorded.
+
+#include <Arduino.h>
+#include <vector>
+
+class IRsend {
+public:
+    IRsend(uint16_t pin, bool inverted = false, bool use_modulation = true) : _pin(pin) {
+        (void)inverted;
+        (void)use_modulation;
+    }
+
+    void begin() { pinMode(_pin, OUTPUT); }
+
+    void sendRaw(const uint16_t buf[], uint16_t len, uint16_t hz) {
+        sent.push_back(Frame { std::vector<uint16_t>(buf, buf + len), hz });
+    }
+
+    // test side
+
+    struct Frame {
+        std::vector<uint16_t> timings;
+        uint16_t hz;
+    };
+
+    std::vector<Frame> sent;
+
+private:
+    uint16_t _pin;
+};
@@ -0,0 +1,7 @@
+#pragma once
+
+// Host stand-in for the LittleFS mount, see FS.h.
+
+#include <FS.h>
+
+inline fs::FS LittleFS;
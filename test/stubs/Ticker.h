@@ -0,0 +1,61 @@
+#pragma once
+
+// Host stand-in for the core Ticker. Nothing runs by itself: a test calls
+// `Ticker::runDue()` after moving HostClock.
+
+#include <Arduino.h>
+#include <functional>
+#include <vector>
+
+class Ticker {
+public:
+    typedef std::function<void(void)> callback_function_t;
+
+    Ticker() : _active(false), _repeat(false), _period_us(0), _due_us(0) {
+        _tickers().push_back(this);
+    }
+
+    ~Ticker() {
+        auto &tickers = _tickers();
+        tickers.erase(std::remove(tickers.begin(), tickers.end(), this), tickers.end());
+    }
+
+    void attach_ms(uint32_t ms, callback_function_t callback) { _arm(ms, true, callback); }
+    void attach(float seconds, callback_function_t callback) { _arm(seconds * 1000, true, callback); }
+    void once_ms(uint32_t ms, callback_function_t callback) { _arm(ms, false, callback); }
+    void once(float seconds, callback_function_t callback) { _arm(seconds * 1000, false, callback); }
+
+    void detach() { _active = false; }
+    bool active() const { return _active; }
+
+    static void runDue() {
+        auto tickers = _tickers(); // a callback may attach or detach
+        for (auto t : tickers) {
+            while (t->_active && HostClock::us >= t->_due_us) {
+                t->_active = t->_repeat;
+                t->_due_us += t->_period_us;
+                t->_callback();
+            }
+        }
+    }
+
+private:
+    bool _active;
+    bool _repeat;
+    uint64_t _period_us;
+    uint64_t _due_us;
+    callback_function_t _callback;
+
+    void _arm(uint32_t ms, bool repeat, callback_function_t callback) {
+        _period_us = ms ? ms * 1000ULL : 1;
+        _due_us = HostClock::us + _period_us;
+        _repeat = repeat;
+        _callback = callback;
+        _active = true;
+    }
+
+    static std::vector<Ticker *> &_tickers() {
+        static std::vector<Ticker *> tickers;
+        return tickers;
+    }
+};
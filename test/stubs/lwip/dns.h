@@ -0,0 +1,75 @@
+#pragma once
+
+// Host stand-in for lwIP's DNS client. Names in `HostDns::hosts` resolve.
+// A lookup is answered at once when `HostDns::cached` is set, like lwIP
+// does from its table; otherwise it stays pending until the test plays the
+// server with `HostDns::answer()`, or never answers.
+
+#include <Arduino.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+typedef int8_t err_t;
+
+#define ERR_OK (0)
+#define ERR_INPROGRESS (-5)
+#define ERR_ARG (-16)
+
+typedef void (*dns_found_callback)(const char *name, const ip_addr_t *ipaddr, void *callback_arg);
+
+struct HostDns {
+    inline static std::vector<std::pair<std::string, IPAddress>> hosts;
+    inline static bool cached = false;
+    inline static uint32_t lookups = 0;
+
+    inline static std::string pending_name;
+    inline static dns_found_callback pending_fn = nullptr;
+    inline static void *pending_arg = nullptr;
+
+    static void reset() {
+        hosts.clear();
+        cached = false;
+        lookups = 0;
+        pending_fn = nullptr;
+    }
+
+    static bool pending() {
+        return pending_fn != nullptr;
+    }
+
+    static bool find(const char *name, ip_addr_t &addr) {
+        for (auto &h : hosts) {
+            if (h.first == name) {
+                addr.addr = (uint32_t)h.second;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Replies to the pending lookup: the address, or a failure.
+    static void answer() {
+        auto fn = pending_fn;
+        pending_fn = nullptr;
+
+        ip_addr_t addr;
+        if (find(pending_name.c_str(), addr)) {
+            fn(pending_name.c_str(), &addr, pending_arg);
+        } else {
+            fn(pending_name.c_str(), nullptr, pending_arg);
+        }
+    }
+};
+
+inline err_t dns_gethostbyname(const char *hostname, ip_addr_t *addr, dns_found_callback found, void *callback_arg) {
+    if (!hostname || !*hostname) return ERR_ARG;
+    HostDns::lookups++;
+
+    if (HostDns::cached && HostDns::find(hostname, *addr)) return ERR_OK;
+
+    HostDns::pending_name = hostname;
+    HostDns::pending_fn = found;
+    HostDns::pending_arg = callback_arg;
+    return ERR_INPROGRESS;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <Arduino.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "heapprof.h"
+
+#ifndef BENCH_WARMUP
+    #define BENCH_WARMUP (16)
+#endif
+
+struct BenchResult {
+    std::string name;
+    uint32_t ops;
+    double ns_per_op;
+    double allocs_per_op;
+};
+
+// Host microbenchmarks. Allocations are counted by HeapProf, so the runner
+// must be linked with heapprof.cpp and the -Wl,--wrap flags of env:native.
+// Times are wall clock on the host: compare them between builds of the same
+// machine, not with the ESP8266.
+class BenchRunner {
+public:
+    // Calls `fn(i)` for i in [0, ops), after a warm-up of BENCH_WARMUP calls
+    // with i in [ops, ops + BENCH_WARMUP). Anything `fn` needs must be set
+    // up before, so that only the measured code is timed and counted.
+    template <typename Fn>
+    const BenchResult &run(const char *name, uint32_t ops, Fn fn) {
+        for (uint32_t i = ops; i < ops + BENCH_WARMUP; i++) fn(i);
+
+        auto allocs = _allocs();
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < ops; i++) fn(i);
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        allocs = _allocs() - allocs;
+
+        _results.push_back(BenchResult { name, ops, (double)ns / ops, (double)allocs / ops });
+
+        auto &r = _results.back();
+        printf("%-16s %10u ops %12.1f ns/op %8.2f allocs/op\n", name, ops, r.ns_per_op, r.allocs_per_op);
+        return r;
+    };
+
+    const std::vector<BenchResult> &results() const {
+        return _results;
+    };
+
+    // {"benchmarks":[{"name":..,"ops":..,"nsPerOp":..,"allocsPerOp":..},...]}
+    bool write(const char *path) const {
+        auto f = fopen(path, "w");
+        if (!f) return false;
+
+        fprintf(f, "{\"benchmarks\":[");
+        for (size_t i = 0; i < _results.size(); i++) {
+            auto &r = _results[i];
+            fprintf(f, "%s\n  {\"name\":\"%s\",\"ops\":%u,\"nsPerOp\":%.1f,\"allocsPerOp\":%.3f}",
+                i ? "," : "", r.name.c_str(), r.ops, r.ns_per_op, r.allocs_per_op);
+        }
+        fprintf(f, "\n]}\n");
+        return fclose(f) == 0;
+    };
+
+private:
+    std::vector<BenchResult> _results;
+
+    static uint64_t _allocs() {
+        uint64_t n = 0;
+        for (int t = 0; t < HEAP_TAG_COUNT; t++) {
+            n += HeapProf::get((HeapTag)t).allocs;
+        }
+        return n;
+    };
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Raw frames of the Panasonic light's remote (light-01) as printed by
+// IRrecvDumpV2: header, 40 bits, trailing mark, in us.
+
+#define LIGHT_CAPTURE_LEN (83)
+
+static const uint16_t lightOnCapture[LIGHT_CAPTURE_LEN] = {
+    3488, 1714, 464, 408, 462, 408, 464, 1278,
+    464, 1278, 464, 408, 462, 1278, 464, 408,
+    462, 408, 464, 408, 462, 1280, 464, 408,
+    462, 408, 462, 1280, 462, 408, 462, 1278,
+    464, 408, 462, 1278, 464, 408, 462, 408,
+    462, 1278, 464, 408, 462, 408, 462, 408,
+    464, 408, 462, 1278, 464, 408, 462, 1278,
+    464, 1280, 464, 408, 462, 1280, 464, 408,
+    464, 408, 462, 408, 464, 408, 464, 1278,
+    464, 408, 462, 408, 462, 1280, 462, 408,
+    462, 408, 462
+}; // UNKNOWN F6B92168
+
+static const uint16_t lightOffCapture[LIGHT_CAPTURE_LEN] = {
+    3492, 1712, 466, 406, 464, 406, 464, 1278,
+    466, 1278, 464, 406, 464, 1278, 464, 406,
+    464, 406, 464, 406, 464, 1278, 466, 406,
+    464, 406, 464, 1278, 464, 406, 464, 1278,
+    464, 406, 464, 1278, 464, 406, 464, 406,
+    464, 1278, 464, 406, 464, 406, 464, 406,
+    464, 406, 466, 1276, 466, 1276, 466, 1278,
+    464, 1278, 464, 408, 464, 1278, 464, 406,
+    464, 406, 464, 406, 464, 1278, 464, 1278,
+    464, 408, 464, 408, 464, 1278, 464, 406,
+    464, 406, 464
+}; // UNKNOWN 1B9C2A92
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Arduino.h>
+#include <vector>
+
+#include "irlearn.h"
+
+// Receiver backend for the host tests: `read()` hands out the capture the
+// test queued with `capture()`, once, and only while enabled.
+class FakeIrRecvBackend : public IrRecvBackend {
+public:
+    FakeIrRecvBackend() : enabled(false), enables(0) {
+    };
+
+    virtual void enable() override {
+        enabled = true;
+        enables++;
+    };
+
+    virtual void disable() override {
+        enabled = false;
+    };
+
+    virtual uint16_t read(uint16_t *timings, uint16_t max) override {
+        if (!enabled || _pending.empty()) return 0;
+
+        uint16_t len = 0;
+        for (; len < _pending.size() && len < max; len++) {
+            timings[len] = _pending[len];
+        }
+        _pending.clear();
+        return len;
+    };
+
+    // test side
+
+    bool enabled;
+    uint16_t enables;
+
+    void capture(const uint16_t *timings, size_t len) {
+        _pending.assign(timings, timings + len);
+    };
+
+    void capture(const std::vector<uint16_t> &timings) {
+        _pending = timings;
+    };
+
+private:
+    std::vector<uint16_t> _pending;
+};
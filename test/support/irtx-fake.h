@@ -0,0 +1,97 @@
+#pragma once
+
+#include <Arduino.h>
+#include <vector>
+
+#include "irtx.h"
+
+// Transmitter backend for the host tests: marks and spaces are recorded
+// with the HostClock time they started at, and the timer only fires when
+// the test calls `tick()` or `run()`, which move HostClock to its due time.
+class FakeIrTxBackend : public IrTxBackend {
+public:
+    struct Edge {
+        uint32_t at;
+        bool mark;
+        uint16_t hz;
+    };
+
+    FakeIrTxBackend() : _fn(0), _arg(0), _armed(false), _due(0) {
+    };
+
+    virtual void begin(TickFn fn, void *arg) override {
+        _fn = fn;
+        _arg = arg;
+    };
+
+    virtual void mark(uint16_t hz, uint32_t) override {
+        edges.push_back(Edge { now(), true, hz });
+    };
+
+    virtual void space() override {
+        edges.push_back(Edge { now(), false, 0 });
+    };
+
+    virtual void arm(uint32_t us) override {
+        _armed = true;
+        _due = HostClock::us + us;
+    };
+
+    virtual uint32_t now() override {
+        return micros();
+    };
+
+    // test side
+
+    std::vector<Edge> edges;
+
+    bool armed() const {
+        return _armed;
+    };
+
+    uint64_t due() const {
+        return _due;
+    };
+
+    // Fires the timer once; false if it wasn't armed.
+    bool tick() {
+        if (!_armed) return false;
+
+        _armed = false;
+        if (_due > HostClock::us) HostClock::us = _due;
+        _fn(_arg);
+        return true;
+    };
+
+    // Fires the timer until the transmitter stops arming it.
+    size_t run(size_t max_ticks = 100000) {
+        size_t ticks = 0;
+        while (ticks < max_ticks && tick()) ticks++;
+        return ticks;
+    };
+
+    // Durations of the recorded marks and spaces, as the receiver would see
+    // them: repeated spaces are merged and the trailing one is dropped.
+    std::vector<uint32_t> timings() const {
+        std::vector<uint32_t> out;
+        for (size_t i = 0; i + 1 < edges.size(); i++) {
+            if (!edges[i].mark && !out.empty() && (out.size() & 1) == 0) {
+                out.back() += edges[i + 1].at - edges[i].at; // space after a space
+                continue;
+            }
+            out.push_back(edges[i + 1].at - edges[i].at);
+        }
+        if (!out.empty() && (out.size() & 1) == 0) out.pop_back();
+        return out;
+    };
+
+    void clear() {
+        edges.clear();
+    };
+
+private:
+    TickFn _fn;
+    void *_arg;
+    bool _armed;
+    uint64_t _due;
+};
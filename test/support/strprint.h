@@ -0,0 +1,19 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Print into a growing String, to check what a printTo() writes.
+class StringPrint : public Print {
+public:
+    String str;
+
+    virtual size_t write(uint8_t c) override {
+        str.concat((char)c);
+        return 1;
+    };
+
+    virtual size_t write(const uint8_t *data, size_t len) override {
+        str.concat(reinterpret_cast<const char *>(data), len);
+        return len;
+    };
+};
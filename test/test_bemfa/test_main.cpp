@@ -0,0 +1,221 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <memory>
+
+#include "bemfa.h"
+
+// The connection to a simulated broker: DNS answers, CONNACK and SUBACK
+// come when the test says so, and the clock only moves when it advances.
+
+static const uint8_t bssid[6] = { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 };
+static const IPAddress brokerIp(192, 168, 7, 7);
+
+static std::unique_ptr<BemfaMqtt> mqtt;
+
+static AsyncMqttClient &client() {
+    return mqtt->getMqttClient();
+}
+
+static void wifiUp() {
+    WiFiEventStationModeGotIP lease = { IPAddress(192, 168, 1, 50), IPAddress(255, 255, 255, 0), IPAddress(192, 168, 1, 1) };
+    WiFi.stationGotIP(bssid, 6, lease, IPAddress(192, 168, 1, 1));
+}
+
+// runs what is due after `ms`
+static void run(uint32_t ms = 0) {
+    HostClock::advanceMs(ms);
+    Scheduler::loop();
+}
+
+void setUp(void) {
+    HostClock::reset();
+    HostClock::advanceMs(1000);
+    HostDns::reset();
+    HostDns::hosts.push_back({ "bemfa.example", brokerIp });
+
+    mqtt.reset(new BemfaMqtt("bemfa.example", 9501, "test"));
+    mqtt->onMessage("light002", [](const StrView &, const StrView &, AsyncMqttClient &) {});
+    mqtt->onMessage("fan003", [](const StrView &, const StrView &, AsyncMqttClient &) {});
+    mqtt->begin();
+}
+
+void tearDown(void) {
+    // leaves no task or lookup pointing at the instance
+    WiFi.stationDisconnected();
+    HostDns::reset();
+    mqtt.reset();
+}
+
+void test_lookup_does_not_block_the_loop(void) {
+    wifiUp();
+    auto before = HostClock::us;
+    run();
+    TEST_ASSERT_EQUAL(before, HostClock::us);
+    TEST_ASSERT_TRUE(HostDns::pending());
+    TEST_ASSERT_FALSE(client().isConnecting());
+
+    // the server answers while the loop keeps going
+    run(40);
+    run(80);
+    HostDns::answer();
+    TEST_ASSERT_TRUE(client().isConnecting());
+    TEST_ASSERT_TRUE(client().server_ip == brokerIp);
+    TEST_ASSERT_EQUAL(9501, client().server_port);
+
+    auto &timing = mqtt->getConnectTiming();
+    TEST_ASSERT_EQUAL(120, timing.dns);
+    TEST_ASSERT_FALSE(timing.dns_cached);
+}
+
+void test_connect_timing(void) {
+    wifiUp();
+    run();
+    run(30);
+    HostDns::answer();
+
+    run(250);
+    client().brokerConnAck();
+    TEST_ASSERT_EQUAL(2, client().subscribed.size());
+
+    run(60);
+    client().brokerSubAck(client().subscribed[0].id);
+    run(15);
+    client().brokerSubAck(client().subscribed[1].id);
+
+    auto &timing = mqtt->getConnectTiming();
+    TEST_ASSERT_EQUAL(1, timing.attempts);
+    TEST_ASSERT_EQUAL(30, timing.dns);
+    TEST_ASSERT_EQUAL(250, timing.connack);
+    TEST_ASSERT_EQUAL(75, timing.suback);
+}
+
+void test_lwip_cache_answers_at_once(void) {
+    HostDns::cached = true;
+    wifiUp();
+    run();
+    TEST_ASSERT_FALSE(HostDns::pending());
+    TEST_ASSERT_TRUE(client().isConnecting());
+    TEST_ASSERT_EQUAL(0, mqtt->getConnectTiming().dns);
+}
+
+void test_reconnect_uses_cached_address(void) {
+    wifiUp();
+    run();
+    HostDns::answer();
+    client().brokerConnAck();
+
+    client().brokerDisconnect();
+    run(1000);
+    TEST_ASSERT_EQUAL(1, HostDns::lookups);
+    TEST_ASSERT_TRUE(client().isConnecting());
+    TEST_ASSERT_TRUE(mqtt->getConnectTiming().dns_cached);
+}
+
+void test_timeout_without_address_backs_off(void) {
+    wifiUp();
+    run();
+    run(BEMFA_DNS_TIMEOUT_MS);
+    TEST_ASSERT_FALSE(client().isConnecting());
+    TEST_ASSERT_EQUAL(BEMFA_DNS_TIMEOUT_MS, mqtt->getConnectTiming().dns);
+    TEST_ASSERT_FALSE(mqtt->getConnectTiming().dns_cached); // no address to fall back to
+
+    // a late answer fills the cache only; the retry connects without a lookup
+    HostDns::answer();
+    TEST_ASSERT_FALSE(client().isConnecting());
+
+    run(1000);
+    TEST_ASSERT_TRUE(client().isConnecting());
+    TEST_ASSERT_EQUAL(1, HostDns::lookups);
+    TEST_ASSERT_EQUAL(1, client().connects);
+    TEST_ASSERT_TRUE(mqtt->getConnectTiming().dns_cached);
+}
+
+void test_failed_lookup_falls_back_to_stale_address(void) {
+    wifiUp();
+    run();
+    HostDns::answer();
+    client().brokerConnAck();
+
+    // after failed attempts on the cached address the name is looked up
+    // again, and fails
+    HostDns::hosts.clear();
+    for (int i = 0; i < BEMFA_DNS_RETRY_ATTEMPTS && !HostDns::pending(); i++) {
+        client().brokerDisconnect();
+        run(130000);
+    }
+    TEST_ASSERT_TRUE(HostDns::pending());
+    TEST_ASSERT_EQUAL(BEMFA_DNS_RETRY_ATTEMPTS, client().connects);
+
+    HostDns::answer();
+    TEST_ASSERT_TRUE(client().isConnecting());
+    TEST_ASSERT_TRUE(client().server_ip == brokerIp);
+    TEST_ASSERT_TRUE(mqtt->getConnectTiming().dns_cached);
+}
+
+void test_answer_after_wifi_loss_does_not_connect(void) {
+    wifiUp();
+    run();
+    WiFi.stationDisconnected();
+    HostDns::answer();
+    TEST_ASSERT_FALSE(client().isConnecting());
+
+    // nor does the timeout, which was cancelled
+    run(BEMFA_DNS_TIMEOUT_MS);
+    TEST_ASSERT_EQUAL(0, client().connects);
+}
+
+void test_states_replayed_before_subscribing(void) {
+    // a state for every device, restored at boot while offline
+    char topic[16];
+    for (int i = 0; i < OUTBOX_SIZE; i++) {
+        snprintf(topic, sizeof(topic), "device%03d", i);
+        mqtt->publishState(StrView(topic), StrView("on"));
+    }
+
+    wifiUp();
+    run();
+    HostDns::answer();
+    client().brokerConnAck();
+    TEST_ASSERT_EQUAL(OUTBOX_SIZE, client().published.size());
+    TEST_ASSERT_EQUAL(2, client().subscribed.size());
+}
+
+void test_subscribing_waits_for_the_outbox(void) {
+    char topic[16];
+    for (int i = 0; i < OUTBOX_SIZE; i++) {
+        snprintf(topic, sizeof(topic), "device%03d", i);
+        mqtt->publishState(StrView(topic), StrView("on"));
+    }
+
+    wifiUp();
+    run();
+    HostDns::answer();
+    client().send_capacity = 3;
+    client().brokerConnAck();
+    TEST_ASSERT_EQUAL(3, client().published.size());
+    TEST_ASSERT_EQUAL(0, client().subscribed.size());
+
+    // the client takes the rest in later loops
+    while (client().subscribed.empty()) {
+        client().send_capacity = 2;
+        auto before = client().published.size();
+        mqtt->loop();
+        TEST_ASSERT_GREATER_THAN(before, client().published.size());
+    }
+    TEST_ASSERT_EQUAL(OUTBOX_SIZE, client().published.size());
+    TEST_ASSERT_EQUAL(2, client().subscribed.size());
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_lookup_does_not_block_the_loop);
+    RUN_TEST(test_connect_timing);
+    RUN_TEST(test_lwip_cache_answers_at_once);
+    RUN_TEST(test_reconnect_uses_cached_address);
+    RUN_TEST(test_timeout_without_address_backs_off);
+    RUN_TEST(test_failed_lookup_falls_back_to_stale_address);
+    RUN_TEST(test_answer_after_wifi_loss_does_not_connect);
+    RUN_TEST(test_states_replayed_before_subscribing);
+    RUN_TEST(test_subscribing_waits_for_the_outbox);
+    return UNITY_END();
+}
@@ -0,0 +1,144 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <stdlib.h>
+
+#include "bemfacmd.h"
+
+static BemfaCommand cmd;
+
+static bool parse(const char *payload) {
+    return cmd.parse(StrView(payload));
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_plain_verbs(void) {
+    TEST_ASSERT_TRUE(parse("on"));
+    TEST_ASSERT_EQUAL(BemfaCommand::ON, cmd.verb);
+    TEST_ASSERT_EQUAL(0, cmd.argc);
+
+    TEST_ASSERT_TRUE(parse("off"));
+    TEST_ASSERT_EQUAL(BemfaCommand::OFF, cmd.verb);
+
+    TEST_ASSERT_TRUE(parse("toggle"));
+    TEST_ASSERT_EQUAL(BemfaCommand::OTHER, cmd.verb);
+    TEST_ASSERT_TRUE(cmd.name == "toggle");
+}
+
+void test_arguments(void) {
+    TEST_ASSERT_TRUE(parse("on#80#16711680"));
+    TEST_ASSERT_EQUAL(BemfaCommand::ON, cmd.verb);
+    TEST_ASSERT_EQUAL(2, cmd.argc);
+    TEST_ASSERT_EQUAL(80, cmd.arg(BEMFA_LIGHT_BRIGHTNESS, -1));
+    TEST_ASSERT_EQUAL(16711680, cmd.arg(BEMFA_LIGHT_COLOUR, -1));
+    TEST_ASSERT_EQUAL(7, cmd.arg(2, 7));
+}
+
+void test_absent_argument_is_not_zero(void) {
+    TEST_ASSERT_TRUE(parse("on##2700"));
+    TEST_ASSERT_EQUAL(2, cmd.argc);
+    TEST_ASSERT_FALSE(cmd.has(0));
+    TEST_ASSERT_EQUAL(-1, cmd.arg(0, -1));
+    TEST_ASSERT_EQUAL(2700, cmd.arg(1, -1));
+
+    TEST_ASSERT_TRUE(parse("on#"));
+    TEST_ASSERT_EQUAL(1, cmd.argc);
+    TEST_ASSERT_FALSE(cmd.has(0));
+}
+
+void test_name_points_into_payload(void) {
+    const char *payload = "cool#2#24";
+    TEST_ASSERT_TRUE(cmd.parse(StrView(payload)));
+    TEST_ASSERT_TRUE(cmd.name.data() == payload);
+    TEST_ASSERT_EQUAL(4, cmd.name.length());
+}
+
+void test_payload_is_not_read_past_its_length(void) {
+    TEST_ASSERT_TRUE(cmd.parse(StrView("on#80#xyz", 5)));
+    TEST_ASSERT_EQUAL(1, cmd.argc);
+    TEST_ASSERT_EQUAL(80, cmd.arg(0, -1));
+}
+
+void test_rejects_malformed(void) {
+    const char *bad[] = {
+        "", "#1", "o n", "on!", "on#8x", "on#1#2#3#4#5", "on#4294967296", "on#2147483648", "on#-", "on#1-2"
+    };
+    for (auto payload : bad) {
+        TEST_ASSERT_FALSE_MESSAGE(parse(payload), payload);
+        TEST_ASSERT_EQUAL(BemfaCommand::OTHER, cmd.verb);
+        TEST_ASSERT_EQUAL(0, cmd.argc);
+        TEST_ASSERT_EQUAL(0, cmd.name.length());
+    }
+}
+
+void test_negative_arguments(void) {
+    TEST_ASSERT_TRUE(parse("cool#-5#-2147483647"));
+    TEST_ASSERT_EQUAL(-5, cmd.arg(0, 0));
+    TEST_ASSERT_EQUAL(-INT32_MAX, cmd.arg(1, 0));
+
+    TEST_ASSERT_TRUE(parse("on#-0"));
+    TEST_ASSERT_EQUAL(0, cmd.arg(0, 1));
+
+    TEST_ASSERT_FALSE(parse("on#--1"));
+    TEST_ASSERT_FALSE(parse("on#-2147483648"));
+}
+
+void test_limits(void) {
+    TEST_ASSERT_TRUE(parse("on#1#2#3#4"));
+    TEST_ASSERT_EQUAL(BEMFA_CMD_MAX_ARGS, cmd.argc);
+
+    TEST_ASSERT_TRUE(parse("on#2147483647"));
+    TEST_ASSERT_EQUAL(INT32_MAX, cmd.arg(0, 0));
+}
+
+void test_non_ascii_name_is_rejected(void) {
+    TEST_ASSERT_FALSE(parse("\xe5\xbc\x80"));
+    TEST_ASSERT_FALSE(parse("on\xff"));
+}
+
+// Random payloads from the characters that matter, every length up to 24,
+// each in a buffer of exactly its size so that a sanitizer build catches a
+// read past it. Accepted ones must hold together.
+void test_random_payloads(void) {
+    static const char alphabet[] = "on#f0123456789-_x \xff";
+    srand(1);
+
+    int accepted = 0;
+    for (int i = 0; i < 200000; i++) {
+        size_t len = rand() % 25;
+        auto buf = (char *)malloc(len ? len : 1);
+        for (size_t j = 0; j < len; j++) buf[j] = alphabet[rand() % (sizeof(alphabet) - 1)];
+
+        if (cmd.parse(StrView(buf, len))) {
+            accepted++;
+            TEST_ASSERT_TRUE(cmd.name.data() == buf);
+            TEST_ASSERT_TRUE(cmd.name.length() > 0 && cmd.name.length() <= len);
+            TEST_ASSERT_TRUE(cmd.argc <= BEMFA_CMD_MAX_ARGS);
+            TEST_ASSERT_TRUE(cmd.present < (1 << cmd.argc));
+        } else {
+            TEST_ASSERT_EQUAL(0, cmd.argc);
+            TEST_ASSERT_EQUAL(0, cmd.name.length());
+        }
+        free(buf);
+    }
+    TEST_ASSERT_GREATER_THAN(0, accepted);
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_plain_verbs);
+    RUN_TEST(test_arguments);
+    RUN_TEST(test_absent_argument_is_not_zero);
+    RUN_TEST(test_name_points_into_payload);
+    RUN_TEST(test_payload_is_not_read_past_its_length);
+    RUN_TEST(test_rejects_malformed);
+    RUN_TEST(test_negative_arguments);
+    RUN_TEST(test_limits);
+    RUN_TEST(test_non_ascii_name_is_rejected);
+    RUN_TEST(test_random_payloads);
+    return UNITY_END();
+}
@@ -0,0 +1,235 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <memory>
+#include <vector>
+
+#include "bemfa.h"
+#include "bemfacmd.h"
+#include "httpd.h"
+#include "irproto.h"
+#include "irtx.h"
+#include "router.h"
+#include "site.h"
+
+#include "bench.h"
+
+// Hot paths of the gateway, timed on the host. Results go to
+// bench_output.json, or to the file named by $BENCH_OUTPUT.
+
+#define BENCH_OPS (20000)
+
+BemfaMqtt bemfaMqtt("bemfa.example", 9501, "bench");
+Httpd httpd(80);
+
+static BenchRunner runner;
+
+// Counts edges and fires the timer at once, so a frame costs only the
+// transmitter's own work.
+class CountingIrTxBackend : public IrTxBackend {
+public:
+    uint32_t marks = 0;
+
+    virtual void begin(TickFn fn, void *arg) override {
+        _fn = fn;
+        _arg = arg;
+    };
+
+    virtual void mark(uint16_t, uint32_t) override {
+        marks++;
+    };
+
+    virtual void space() override {
+    };
+
+    virtual void arm(uint32_t) override {
+        _armed = true;
+    };
+
+    virtual uint32_t now() override {
+        return 0;
+    };
+
+    void run() {
+        while (_armed) {
+            _armed = false;
+            _fn(_arg);
+        }
+    };
+
+private:
+    TickFn _fn = 0;
+    void *_arg = 0;
+    bool _armed = false;
+};
+
+static const char *const topics[] = {
+    "light002", "light003", "fan004", "ac005", "curtain006", "outlet007", "light008", "fan009"
+};
+
+static uint32_t handled;
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_mqtt_dispatch(void) {
+    std::vector<StrView> topicViews;
+    for (auto topic : topics) topicViews.push_back(StrView(topic));
+    const StrView msg("on#80#2700");
+
+    auto &r = runner.run("mqttDispatch", BENCH_OPS * 10, [&](uint32_t i) {
+        bemfaMqtt.dispatch(topicViews[i % topicViews.size()], msg);
+    });
+
+    TEST_ASSERT_EQUAL_FLOAT(0, r.allocs_per_op);
+}
+
+void test_bemfa_command(void) {
+    static const char *const payloads[] = {
+        "on", "off", "on#80", "on#100#16711680#1", "off#0", "cool#2#24", "on##2700", "speed#3"
+    };
+    std::vector<StrView> msgs;
+    for (auto payload : payloads) msgs.push_back(StrView(payload));
+
+    uint32_t parsed = 0;
+    auto &r = runner.run("bemfaCommand", BENCH_OPS * 10, [&](uint32_t i) {
+        BemfaCommand cmd;
+        if (cmd.parse(msgs[i % msgs.size()])) parsed++;
+    });
+
+    TEST_ASSERT_EQUAL_FLOAT(0, r.allocs_per_op);
+    TEST_ASSERT_EQUAL(BENCH_OPS * 10 + BENCH_WARMUP, parsed);
+}
+
+void test_ir_frame(void) {
+    static constexpr IrBits<5> bits = kaseikyo40(0x522C, 0, 0x2D);
+    static constexpr IrCode code = irCode(IR_KASEIKYO, bits);
+
+    CountingIrTxBackend backend;
+    IrTransmitter tx(backend);
+    tx.begin();
+
+    auto &r = runner.run("irFrame", BENCH_OPS, [&](uint32_t) {
+        tx.send(&code);
+        backend.run();
+    });
+
+    TEST_ASSERT_EQUAL_FLOAT(0, r.allocs_per_op);
+    TEST_ASSERT_TRUE(tx.isIdle());
+}
+
+void test_route_lookup(void) {
+    // a gateway with many devices; every other lookup misses
+    TopicRouter<int> router;
+    std::vector<std::string> names;
+    for (int i = 0; i < 64; i++) {
+        char topic[16];
+        snprintf(topic, sizeof(topic), "device%03d", i);
+        names.push_back(topic);
+        router.add(topic, i);
+    }
+    router.freeze();
+    for (int i = 0; i < 64; i++) {
+        names.push_back("unknown" + std::to_string(i));
+    }
+
+    auto &r = runner.run("routeLookup", BENCH_OPS * 10, [&](uint32_t i) {
+        auto &topic = names[(i * 7) % names.size()];
+        if (router.find(topic.data(), topic.size())) handled++;
+    });
+
+    TEST_ASSERT_EQUAL_FLOAT(0, r.allocs_per_op);
+}
+
+// requests built and routed up front: only the handler is timed
+static std::vector<std::unique_ptr<AsyncWebServerRequest>> routed(const char *url, AsyncWebHandler *&handler) {
+    auto server = AsyncWebServer::onPort(80);
+    std::vector<std::unique_ptr<AsyncWebServerRequest>> requests;
+    for (int i = 0; i < BENCH_OPS + BENCH_WARMUP; i++) {
+        requests.emplace_back(new AsyncWebServerRequest(HTTP_GET, url));
+        handler = server->route(*requests.back());
+    }
+    return requests;
+}
+
+void test_status_json(void) {
+    AsyncWebHandler *handler = 0;
+    auto requests = routed("/api/status", handler);
+    TEST_ASSERT_NOT_NULL(handler);
+
+    runner.run("statusJson", BENCH_OPS, [&](uint32_t i) {
+        handler->handleRequest(requests[i].get());
+    });
+
+    auto response = requests.front()->response();
+    TEST_ASSERT_EQUAL(200, response->code());
+    TEST_ASSERT_EQUAL('{', response->body()[0]);
+}
+
+void test_static_lookup(void) {
+    SiteIndex site;
+    site.begin(LittleFS, "/site");
+
+    static const char *const paths[] = {
+        "index.html", "app.js", "style.css", "favicon.ico", "missing.html", "img/logo.7e8f9a0b.svg"
+    };
+    std::vector<String> pathStrings;
+    for (auto p : paths) pathStrings.push_back(p);
+
+    auto &r = runner.run("staticLookup", BENCH_OPS * 10, [&](uint32_t i) {
+        if (site.find(pathStrings[i % pathStrings.size()])) handled++;
+    });
+
+    TEST_ASSERT_EQUAL_FLOAT(0, r.allocs_per_op);
+}
+
+static void fillSite() {
+    std::string manifest;
+    static const char *const assets[] = {
+        "index.html\t1200\t1a2b3c4d\t0\ttext/html",
+        "app.js\t5300\t5e6f7a8b\t0\tapplication/javascript",
+        "style.css\t900\t9c0d1e2f\t0\ttext/css",
+        "favicon.ico\t300\t3a4b5c6d\t0\timage/x-icon",
+        "img/logo.7e8f9a0b.svg\t700\t7e8f9a0b\t2592000\timage/svg+xml"
+    };
+    for (auto a : assets) {
+        manifest += a;
+        manifest += '\n';
+    }
+    for (int i = 0; i < 24; i++) {
+        char line[64];
+        snprintf(line, sizeof(line), "docs/page%02d.html\t1000\t%08x\t0\ttext/html\n", i, i * 2654435761u);
+        manifest += line;
+    }
+    LittleFS.put("/site/manifest", manifest);
+}
+
+int main(int, char **) {
+    fillSite();
+
+    for (auto topic : topics) {
+        bemfaMqtt.onMessage(topic, [](const StrView &, const StrView &msg, AsyncMqttClient &) {
+            BemfaCommand cmd;
+            if (cmd.parse(msg)) handled++;
+        });
+    }
+    bemfaMqtt.begin();
+    httpd.begin();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_mqtt_dispatch);
+    RUN_TEST(test_route_lookup);
+    RUN_TEST(test_bemfa_command);
+    RUN_TEST(test_ir_frame);
+    RUN_TEST(test_status_json);
+    RUN_TEST(test_static_lookup);
+
+    auto path = getenv("BENCH_OUTPUT");
+    if (!runner.write(path ? path : "bench_output.json")) {
+        printf("Can't write the benchmark results.\n");
+    }
+
+    return UNITY_END();
+}
@@ -0,0 +1,135 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <memory>
+
+#include "ESP8266Boot.h"
+
+// Connecting through a simulated access point: the test hands out the
+// association and the leases, a reset is a new ESP8266Boot on the same RTC
+// memory.
+
+static const uint8_t bssid[6] = { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 };
+static const IPAddress gw(192, 168, 1, 1);
+static const IPAddress mask(255, 255, 255, 0);
+
+static std::unique_ptr<ESP8266Boot> boot;
+
+static void reset() {
+    if (WiFi.isConnected()) WiFi.stationDisconnected();
+    boot.reset(new ESP8266Boot());
+    boot->begin();
+}
+
+static void lease(IPAddress ip) {
+    WiFi.stationGotIP(bssid, 6, WiFiEventStationModeGotIP { ip, mask, gw }, gw);
+}
+
+static void run(uint32_t ms = 0) {
+    HostClock::advanceMs(ms);
+    Scheduler::loop();
+    boot->loop();
+}
+
+void setUp(void) {
+    HostClock::reset();
+    HostClock::advanceMs(100);
+    memset(ESP.rtc_memory, 0, sizeof(ESP.rtc_memory));
+    WiFi.setSaved("home", "secret");
+}
+
+void tearDown(void) {
+    if (WiFi.isConnected()) WiFi.stationDisconnected();
+    boot.reset();
+}
+
+void test_first_boot_scans_with_dhcp(void) {
+    reset();
+    TEST_ASSERT_TRUE(WiFi.isDhcp());
+    TEST_ASSERT_FALSE(WiFi.last_begin.has_bssid);
+
+    lease(IPAddress(192, 168, 1, 50));
+    run();
+    TEST_ASSERT_EQUAL(ESP8266Boot::READY, boot->getState());
+    TEST_ASSERT_TRUE(WiFi.isDhcp());
+}
+
+void test_reset_connects_fast_then_hands_back_to_dhcp(void) {
+    reset();
+    lease(IPAddress(192, 168, 1, 50));
+
+    reset();
+    TEST_ASSERT_FALSE(WiFi.isDhcp());
+    TEST_ASSERT_TRUE(WiFi.last_begin.has_bssid);
+    TEST_ASSERT_EQUAL(6, WiFi.last_begin.channel);
+    TEST_ASSERT_TRUE(WiFi.last_config.ip == IPAddress(192, 168, 1, 50));
+
+    // up on the cached config, then DHCP runs on the live connection
+    auto begins = WiFi.begins;
+    lease(IPAddress(192, 168, 1, 50));
+    TEST_ASSERT_EQUAL(ESP8266Boot::READY, boot->getState());
+    TEST_ASSERT_FALSE(WiFi.isDhcp());
+    run();
+    TEST_ASSERT_TRUE(WiFi.isDhcp());
+    TEST_ASSERT_EQUAL(begins, WiFi.begins);
+    TEST_ASSERT_TRUE(WiFi.isConnected());
+}
+
+void test_new_lease_replaces_the_record(void) {
+    reset();
+    lease(IPAddress(192, 168, 1, 50));
+
+    reset();
+    lease(IPAddress(192, 168, 1, 50));
+    run();
+
+    // the server moved us; the next reset uses the new address
+    lease(IPAddress(192, 168, 1, 77));
+    TEST_ASSERT_EQUAL(ESP8266Boot::READY, boot->getState());
+
+    reset();
+    TEST_ASSERT_FALSE(WiFi.isDhcp());
+    TEST_ASSERT_TRUE(WiFi.last_config.ip == IPAddress(192, 168, 1, 77));
+}
+
+void test_drop_before_hand_back_reschedules_it(void) {
+    reset();
+    lease(IPAddress(192, 168, 1, 50));
+
+    reset();
+    lease(IPAddress(192, 168, 1, 50));
+    WiFi.stationDisconnected();
+    run();
+    TEST_ASSERT_FALSE(WiFi.isDhcp());
+
+    // the SDK reconnects on the same static config
+    lease(IPAddress(192, 168, 1, 50));
+    run();
+    TEST_ASSERT_TRUE(WiFi.isDhcp());
+}
+
+void test_fast_connect_timeout_falls_back_to_scan(void) {
+    reset();
+    lease(IPAddress(192, 168, 1, 50));
+
+    reset();
+    TEST_ASSERT_FALSE(WiFi.isDhcp());
+
+    run(BOOT_FAST_CONNECT_TIMEOUT_MS + 1);
+    TEST_ASSERT_TRUE(WiFi.isDhcp());
+    TEST_ASSERT_FALSE(WiFi.last_begin.has_bssid);
+
+    // and the record is gone
+    lease(IPAddress(192, 168, 1, 60));
+    reset();
+    TEST_ASSERT_TRUE(WiFi.last_config.ip == IPAddress(192, 168, 1, 60));
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_first_boot_scans_with_dhcp);
+    RUN_TEST(test_reset_connects_fast_then_hands_back_to_dhcp);
+    RUN_TEST(test_new_lease_replaces_the_record);
+    RUN_TEST(test_drop_before_hand_back_reschedules_it);
+    RUN_TEST(test_fast_connect_timeout_falls_back_to_scan);
+    return UNITY_END();
+}
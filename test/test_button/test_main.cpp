@@ -0,0 +1,327 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <vector>
+
+#include "button.h"
+
+static std::vector<Gesture> gestures;
+
+static void onGesture(Gesture gesture, void *) {
+    gestures.push_back(gesture);
+}
+
+// Polls every 10ms from `from` to `to`, like loop() would while busy.
+static void pollUntil(GestureRecognizer &r, uint32_t from, uint32_t to) {
+    for (auto t = from; t <= to; t += 10) r.poll(t);
+}
+
+void setUp(void) {
+    gestures.clear();
+}
+
+void tearDown(void) {
+}
+
+void test_click_after_double_click_time(void) {
+    GestureRecognizer r(onGesture, 0);
+    r.edge(true, 1000);
+    pollUntil(r, 1000, 1100);
+    r.edge(false, 1100);
+    pollUntil(r, 1100, 1400);
+    TEST_ASSERT_EQUAL(0, gestures.size());
+
+    pollUntil(r, 1400, 1500);
+    TEST_ASSERT_EQUAL(1, gestures.size());
+    TEST_ASSERT_EQUAL(GESTURE_CLICK, gestures[0]);
+    TEST_ASSERT_FALSE(r.busy());
+}
+
+void test_double_click(void) {
+    GestureRecognizer r(onGesture, 0);
+    r.edge(true, 1000);
+    pollUntil(r, 1000, 1100);
+    r.edge(false, 1100);
+    pollUntil(r, 1100, 1250);
+    r.edge(true, 1250);
+    pollUntil(r, 1250, 1350);
+    r.edge(false, 1350);
+    pollUntil(r, 1350, 2000);
+
+    TEST_ASSERT_EQUAL(1, gestures.size());
+    TEST_ASSERT_EQUAL(GESTURE_DOUBLE_CLICK, gestures[0]);
+}
+
+void test_bounces_are_filtered(void) {
+    GestureRecognizer r(onGesture, 0);
+    // contact bounce shorter than the debounce time on both edges
+    r.edge(true, 1000);
+    r.edge(false, 1004);
+    r.edge(true, 1009);
+    pollUntil(r, 1010, 1100);
+    r.edge(false, 1100);
+    r.edge(true, 1103);
+    r.edge(false, 1107);
+    pollUntil(r, 1110, 1600);
+
+    TEST_ASSERT_EQUAL(1, gestures.size());
+    TEST_ASSERT_EQUAL(GESTURE_CLICK, gestures[0]);
+}
+
+void test_glitch_is_not_a_press(void) {
+    GestureRecognizer r(onGesture, 0);
+    r.edge(true, 1000);
+    r.edge(false, 1010);
+    pollUntil(r, 1000, 2000);
+    TEST_ASSERT_EQUAL(0, gestures.size());
+    TEST_ASSERT_FALSE(r.busy());
+}
+
+void test_long_hold_then_long_press(void) {
+    GestureRecognizer r(onGesture, 0);
+    r.edge(true, 1000);
+    pollUntil(r, 1000, 6020);
+    TEST_ASSERT_EQUAL(1, gestures.size());
+    TEST_ASSERT_EQUAL(GESTURE_LONG_HOLD, gestures[0]);
+    TEST_ASSERT_TRUE(r.isDown());
+
+    r.edge(false, 7000);
+    pollUntil(r, 6020, 8000);
+    TEST_ASSERT_EQUAL(2, gestures.size());
+    TEST_ASSERT_EQUAL(GESTURE_LONG_PRESS, gestures[1]);
+}
+
+void test_very_long_hold_then_press(void) {
+    GestureRecognizer r(onGesture, 0);
+    r.edge(true, 1000);
+    pollUntil(r, 1000, 11020);
+    r.edge(false, 11020);
+    pollUntil(r, 11020, 12000);
+
+    TEST_ASSERT_EQUAL(3, gestures.size());
+    TEST_ASSERT_EQUAL(GESTURE_LONG_HOLD, gestures[0]);
+    TEST_ASSERT_EQUAL(GESTURE_VERY_LONG_HOLD, gestures[1]);
+    TEST_ASSERT_EQUAL(GESTURE_VERY_LONG_PRESS, gestures[2]);
+}
+
+void test_edge_queue_overflow(void) {
+    ButtonEdgeQueue q;
+    int pushed = 0;
+    while (q.push(pushed, pushed & 1)) pushed++;
+
+    TEST_ASSERT_EQUAL(BUTTON_EDGE_QUEUE_LEN - 1, pushed);
+    TEST_ASSERT_EQUAL(1, q.getOverflows());
+
+    ButtonEdge e;
+    for (int i = 0; i < pushed; i++) {
+        TEST_ASSERT_TRUE(q.pop(e));
+        TEST_ASSERT_EQUAL(i, e.at);
+        TEST_ASSERT_EQUAL(i & 1, e.down);
+    }
+    TEST_ASSERT_TRUE(q.empty());
+    TEST_ASSERT_FALSE(q.pop(e));
+}
+
+// Edge traces in the shape the pin interrupt records them: contact bounce on
+// both edges, a few ms per flip. replay() feeds them through the queue the
+// way ESP8266Boot does, with loop() getting a turn every `period` ms, and
+// logs when each gesture came out.
+
+struct TraceEdge {
+    uint32_t at;
+    bool down;
+};
+
+struct Logged {
+    Gesture gesture;
+    uint32_t at;
+};
+
+static std::vector<Logged> logged;
+static uint32_t loopNow;
+
+static void onLogged(Gesture gesture, void *) {
+    logged.push_back({ gesture, loopNow });
+}
+
+template<size_t N>
+static void replay(GestureRecognizer &r, ButtonEdgeQueue &q, const TraceEdge (&trace)[N],
+                   uint32_t from, uint32_t to, uint32_t period) {
+    size_t next = 0;
+    for (loopNow = from; loopNow - from <= to - from; loopNow += period) {
+        while (next < N && trace[next].at - from <= loopNow - from) {
+            q.push(trace[next].at, trace[next].down);
+            next++;
+        }
+
+        ButtonEdge e;
+        while (q.pop(e)) r.edge(e.down, e.at);
+        if (r.busy()) r.poll(loopNow);
+    }
+}
+
+static const TraceEdge bouncyDoubleClick[] = {
+    { 1000, true }, { 1002, false }, { 1003, true }, { 1007, false }, { 1008, true },
+    { 1120, false }, { 1121, true }, { 1124, false },
+    { 1260, true }, { 1261, false }, { 1265, true },
+    { 1370, false }, { 1372, true }, { 1373, false }, { 1379, true }, { 1380, false },
+};
+
+void test_trace_double_click(void) {
+    GestureRecognizer r(onLogged, 0);
+    ButtonEdgeQueue q;
+    logged.clear();
+    replay(r, q, bouncyDoubleClick, 990, 2500, 10);
+
+    TEST_ASSERT_EQUAL(1, logged.size());
+    TEST_ASSERT_EQUAL(GESTURE_DOUBLE_CLICK, logged[0].gesture);
+    // the last bounce plus the debounce time
+    TEST_ASSERT_EQUAL(1410, logged[0].at);
+    TEST_ASSERT_FALSE(r.busy());
+}
+
+void test_trace_double_click_across_a_stalled_loop(void) {
+    // loop() blocked for 300ms at a time: the edges wait in the queue and
+    // still make the same gesture
+    GestureRecognizer r(onLogged, 0);
+    ButtonEdgeQueue q;
+    logged.clear();
+    replay(r, q, bouncyDoubleClick, 990, 2500, 300);
+
+    TEST_ASSERT_EQUAL(1, logged.size());
+    TEST_ASSERT_EQUAL(GESTURE_DOUBLE_CLICK, logged[0].gesture);
+}
+
+void test_trace_two_clicks_across_a_stalled_loop(void) {
+    // farther apart than the double-click time, handed over at once
+    static const TraceEdge trace[] = {
+        { 1000, true }, { 1003, false }, { 1004, true },
+        { 1100, false }, { 1102, true }, { 1105, false },
+        { 1600, true }, { 1601, false }, { 1604, true },
+        { 1700, false },
+    };
+    GestureRecognizer r(onLogged, 0);
+    ButtonEdgeQueue q;
+    logged.clear();
+    replay(r, q, trace, 990, 3000, 1000);
+
+    TEST_ASSERT_EQUAL(2, logged.size());
+    TEST_ASSERT_EQUAL(GESTURE_CLICK, logged[0].gesture);
+    TEST_ASSERT_EQUAL(GESTURE_CLICK, logged[1].gesture);
+}
+
+void test_trace_click_then_long_press(void) {
+    static const TraceEdge trace[] = {
+        { 1000, true }, { 1001, false }, { 1004, true },
+        { 1090, false }, { 1093, true }, { 1094, false },
+        { 1700, true }, { 1702, false }, { 1706, true },
+        { 7706, false }, { 7707, true }, { 7709, false },
+    };
+    GestureRecognizer r(onLogged, 0);
+    ButtonEdgeQueue q;
+    logged.clear();
+    replay(r, q, trace, 990, 9000, 10);
+
+    TEST_ASSERT_EQUAL(3, logged.size());
+    TEST_ASSERT_EQUAL(GESTURE_CLICK, logged[0].gesture);
+    TEST_ASSERT_EQUAL(1450, logged[0].at);
+    TEST_ASSERT_EQUAL(GESTURE_LONG_HOLD, logged[1].gesture);
+    TEST_ASSERT_EQUAL(6710, logged[1].at);
+    TEST_ASSERT_EQUAL(GESTURE_LONG_PRESS, logged[2].gesture);
+}
+
+void test_trace_release_exactly_at_long_time(void) {
+    // both edges count from their last bounce: held for exactly long_ms
+    static const TraceEdge trace[] = {
+        { 1000, true }, { 1002, false }, { 1005, true },
+        { 6000, false }, { 6001, true }, { 6005, false },
+    };
+    GestureRecognizer r(onLogged, 0, 30, 350, 5000, 10000);
+    ButtonEdgeQueue q;
+    logged.clear();
+    replay(r, q, trace, 990, 7000, 10);
+
+    TEST_ASSERT_EQUAL(2, logged.size());
+    TEST_ASSERT_EQUAL(GESTURE_LONG_HOLD, logged[0].gesture);
+    TEST_ASSERT_EQUAL(GESTURE_LONG_PRESS, logged[1].gesture);
+
+    // one ms shorter is a click, and no hold is reported while the release
+    // is still being debounced
+    static const TraceEdge shorter[] = {
+        { 1000, true }, { 1002, false }, { 1005, true },
+        { 5999, false }, { 6000, true }, { 6004, false },
+    };
+    GestureRecognizer s(onLogged, 0, 30, 350, 5000, 10000);
+    logged.clear();
+    replay(s, q, shorter, 990, 7000, 10);
+
+    TEST_ASSERT_EQUAL(1, logged.size());
+    TEST_ASSERT_EQUAL(GESTURE_CLICK, logged[0].gesture);
+}
+
+void test_trace_queue_overflow_resyncs(void) {
+    // a noisy press flips more often than the queue holds between two turns
+    // of loop(); the edges past the queue are lost, the release after it is
+    // not, and the press still counts
+    TraceEdge trace[BUTTON_EDGE_QUEUE_LEN + 6];
+    size_t n = 0;
+    for (; n < BUTTON_EDGE_QUEUE_LEN + 5; n++) trace[n] = { (uint32_t) (1000 + n), (n & 1) == 0 };
+    trace[n++] = { 1200, false };
+
+    GestureRecognizer r(onLogged, 0);
+    ButtonEdgeQueue q;
+    logged.clear();
+    replay(r, q, trace, 990, 2000, 50);
+
+    TEST_ASSERT_GREATER_THAN(0, q.getOverflows());
+    TEST_ASSERT_EQUAL(1, logged.size());
+    TEST_ASSERT_EQUAL(GESTURE_CLICK, logged[0].gesture);
+    TEST_ASSERT_FALSE(r.busy());
+}
+
+void test_trace_across_millis_wrap(void) {
+    static const TraceEdge trace[] = {
+        { 0xFFFFFF00u, true }, { 0xFFFFFF02u, false }, { 0xFFFFFF05u, true },
+        { 0xFFFFFF70u, false }, { 0xFFFFFF71u, true }, { 0xFFFFFF74u, false },
+        { 0x00000050u, true }, { 0x00000053u, false }, { 0x00000054u, true },
+        { 0x000000A0u, false },
+    };
+    GestureRecognizer r(onLogged, 0);
+    ButtonEdgeQueue q;
+    logged.clear();
+    replay(r, q, trace, 0xFFFFFE00u, 0x00000800u, 10);
+
+    TEST_ASSERT_EQUAL(1, logged.size());
+    TEST_ASSERT_EQUAL(GESTURE_DOUBLE_CLICK, logged[0].gesture);
+
+    // and a hold that starts before the wrap
+    static const TraceEdge hold[] = {
+        { 0xFFFFF000u, true }, { 0x00001000u, false },
+    };
+    GestureRecognizer h(onLogged, 0);
+    logged.clear();
+    replay(h, q, hold, 0xFFFFEF00u, 0x00002000u, 10);
+
+    TEST_ASSERT_EQUAL(2, logged.size());
+    TEST_ASSERT_EQUAL(GESTURE_LONG_HOLD, logged[0].gesture);
+    TEST_ASSERT_UINT32_WITHIN(10, 0xFFFFF000u + 5000, logged[0].at);
+    TEST_ASSERT_EQUAL(GESTURE_LONG_PRESS, logged[1].gesture);
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_click_after_double_click_time);
+    RUN_TEST(test_double_click);
+    RUN_TEST(test_bounces_are_filtered);
+    RUN_TEST(test_glitch_is_not_a_press);
+    RUN_TEST(test_long_hold_then_long_press);
+    RUN_TEST(test_very_long_hold_then_press);
+    RUN_TEST(test_edge_queue_overflow);
+    RUN_TEST(test_trace_double_click);
+    RUN_TEST(test_trace_double_click_across_a_stalled_loop);
+    RUN_TEST(test_trace_two_clicks_across_a_stalled_loop);
+    RUN_TEST(test_trace_click_then_long_press);
+    RUN_TEST(test_trace_release_exactly_at_long_time);
+    RUN_TEST(test_trace_queue_overflow_resyncs);
+    RUN_TEST(test_trace_across_millis_wrap);
+    return UNITY_END();
+}
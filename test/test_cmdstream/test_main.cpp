@@ -0,0 +1,192 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <string>
+#include <vector>
+
+#include "cmdstream.h"
+
+struct Command {
+    std::string topic;
+    std::string msg;
+};
+
+static std::vector<Command> commands;
+
+static void onCommand(const StrView &topic, const StrView &msg, void *) {
+    commands.push_back(Command { std::string(topic.data(), topic.length()), std::string(msg.data(), msg.length()) });
+}
+
+// Feeds `body` in chunks of `chunk` bytes.
+static bool parse(CommandStreamParser &parser, const char *body, size_t chunk = 0) {
+    auto len = strlen(body);
+    if (!chunk) chunk = len ? len : 1;
+
+    for (size_t i = 0; i < len; i += chunk) {
+        parser.feed(reinterpret_cast<const uint8_t *>(body + i), std::min(chunk, len - i));
+    }
+    return parser.finish();
+}
+
+static bool parse(const char *body, size_t chunk = 0) {
+    CommandStreamParser parser(onCommand, 0);
+    return parse(parser, body, chunk);
+}
+
+void setUp(void) {
+    commands.clear();
+}
+
+void tearDown(void) {
+}
+
+void test_single_command(void) {
+    TEST_ASSERT_TRUE(parse("{\"topic\":\"light002\",\"msg\":\"on\"}"));
+    TEST_ASSERT_EQUAL(1, commands.size());
+    TEST_ASSERT_EQUAL_STRING("light002", commands[0].topic.c_str());
+    TEST_ASSERT_EQUAL_STRING("on", commands[0].msg.c_str());
+}
+
+void test_batch_in_any_chunking(void) {
+    const char *body =
+        "{\"commands\": [\n"
+        "  {\"topic\": \"light002\", \"msg\": \"on#80\"},\n"
+        "  {\"msg\": \"off\", \"topic\": \"fan003\", \"extra\": [1, 2.5, true, null]}\n"
+        "]}";
+
+    for (size_t chunk = 1; chunk <= strlen(body); chunk++) {
+        commands.clear();
+        CommandStreamParser parser(onCommand, 0);
+        TEST_ASSERT_TRUE(parse(parser, body, chunk));
+        TEST_ASSERT_EQUAL(2, parser.getCommands());
+        TEST_ASSERT_EQUAL(2, commands.size());
+        TEST_ASSERT_EQUAL_STRING("light002", commands[0].topic.c_str());
+        TEST_ASSERT_EQUAL_STRING("on#80", commands[0].msg.c_str());
+        TEST_ASSERT_EQUAL_STRING("fan003", commands[1].topic.c_str());
+        TEST_ASSERT_EQUAL_STRING("off", commands[1].msg.c_str());
+    }
+}
+
+void test_escapes_in_strings(void) {
+    TEST_ASSERT_TRUE(parse("{\"topic\":\"a\\\"b\",\"msg\":\"x\\\\y\"}"));
+    TEST_ASSERT_EQUAL(1, commands.size());
+    TEST_ASSERT_EQUAL_STRING("a\"b", commands[0].topic.c_str());
+    TEST_ASSERT_EQUAL_STRING("x\\y", commands[0].msg.c_str());
+}
+
+void test_unicode_escape_is_an_error(void) {
+    TEST_ASSERT_FALSE(parse("{\"topic\":\"\\u0041\",\"msg\":\"on\"}"));
+}
+
+void test_incomplete_objects_are_skipped(void) {
+    TEST_ASSERT_TRUE(parse("[{\"topic\":\"a\"},{\"msg\":\"on\"},{\"topic\":1,\"msg\":\"on\"}]"));
+    TEST_ASSERT_EQUAL(0, commands.size());
+}
+
+void test_too_long_topic_is_rejected(void) {
+    std::string body = "[{\"topic\":\"" + std::string(100, 'x') + "\",\"msg\":\"on\"},{\"topic\":\"b\",\"msg\":\"off\"}]";
+
+    CommandStreamParser parser(onCommand, 0);
+    TEST_ASSERT_TRUE(parse(parser, body.c_str()));
+    TEST_ASSERT_EQUAL(1, parser.getRejected());
+    TEST_ASSERT_EQUAL(1, parser.getCommands());
+    TEST_ASSERT_EQUAL_STRING("b", commands[0].topic.c_str());
+}
+
+void test_truncated_body_fails(void) {
+    TEST_ASSERT_FALSE(parse("{\"topic\":\"a\",\"msg\":\"on\""));
+    TEST_ASSERT_FALSE(parse("{\"topic\":\"a"));
+    TEST_ASSERT_FALSE(parse("[{\"topic\":\"a\",\"msg\":\"on\"}"));
+}
+
+void test_mismatched_brackets_fail(void) {
+    TEST_ASSERT_FALSE(parse("{\"topic\":\"a\",\"msg\":\"on\"]"));
+    TEST_ASSERT_FALSE(parse("[}"));
+    TEST_ASSERT_FALSE(parse("}"));
+}
+
+void test_depth_limit(void) {
+    std::string ok(CMD_STREAM_MAX_DEPTH, '[');
+    ok += std::string(CMD_STREAM_MAX_DEPTH, ']');
+    TEST_ASSERT_TRUE(parse(ok.c_str()));
+
+    std::string deep(CMD_STREAM_MAX_DEPTH + 1, '[');
+    deep += std::string(CMD_STREAM_MAX_DEPTH + 1, ']');
+    TEST_ASSERT_FALSE(parse(deep.c_str()));
+}
+
+void test_bare_word_as_key_fails(void) {
+    TEST_ASSERT_FALSE(parse("{topic:\"a\",\"msg\":\"on\"}"));
+}
+
+void test_nested_object_keeps_fields(void) {
+    TEST_ASSERT_TRUE(parse("{\"topic\":\"a\",\"extra\":{\"x\":1},\"msg\":\"on\"}"));
+    TEST_ASSERT_EQUAL(1, commands.size());
+    TEST_ASSERT_EQUAL_STRING("a", commands[0].topic.c_str());
+    TEST_ASSERT_EQUAL_STRING("on", commands[0].msg.c_str());
+}
+
+void test_nested_command_rejects_enclosing_one(void) {
+    CommandStreamParser parser(onCommand, 0);
+    TEST_ASSERT_TRUE(parse(parser, "{\"topic\":\"a\",\"sub\":{\"topic\":\"b\",\"msg\":\"off\"},\"msg\":\"on\"}"));
+    TEST_ASSERT_EQUAL(1, commands.size());
+    TEST_ASSERT_EQUAL_STRING("b", commands[0].topic.c_str());
+    TEST_ASSERT_EQUAL(1, parser.getRejected());
+}
+
+void test_missing_separators_fail(void) {
+    TEST_ASSERT_FALSE(parse("{\"topic\" \"a\",\"msg\":\"on\"}"));
+    TEST_ASSERT_FALSE(parse("{\"topic\":\"a\" \"msg\":\"on\"}"));
+    TEST_ASSERT_FALSE(parse("[{\"topic\":\"a\",\"msg\":\"on\"} {\"topic\":\"b\",\"msg\":\"on\"}]"));
+    TEST_ASSERT_FALSE(parse("[1 2]"));
+    TEST_ASSERT_FALSE(parse("{\"topic\"::\"a\"}"));
+}
+
+void test_misplaced_separators_fail(void) {
+    TEST_ASSERT_FALSE(parse("[1,]"));
+    TEST_ASSERT_FALSE(parse("[,1]"));
+    TEST_ASSERT_FALSE(parse("{,}"));
+    TEST_ASSERT_FALSE(parse("{\"a\":1,}"));
+    TEST_ASSERT_FALSE(parse("{\"a\"}"));
+    TEST_ASSERT_FALSE(parse("{\"a\":}"));
+    TEST_ASSERT_FALSE(parse("[\"a\":1]"));
+}
+
+void test_literals_and_top_level(void) {
+    TEST_ASSERT_TRUE(parse("[true,false,null,-1.5e3]"));
+    TEST_ASSERT_TRUE(parse("  42 "));
+    TEST_ASSERT_TRUE(parse("{}"));
+    TEST_ASSERT_FALSE(parse("[tru]"));
+    TEST_ASSERT_FALSE(parse("[nulls]"));
+    TEST_ASSERT_FALSE(parse("[yes]"));
+    TEST_ASSERT_FALSE(parse(""));
+    TEST_ASSERT_FALSE(parse("{} {}"));
+    TEST_ASSERT_FALSE(parse("[]]"));
+}
+
+void test_validates_without_callback(void) {
+    CommandStreamParser parser(nullptr, 0);
+    TEST_ASSERT_TRUE(parse(parser, "[{\"topic\":\"a\",\"msg\":\"on\"}]"));
+    TEST_ASSERT_EQUAL(1, parser.getCommands());
+    TEST_ASSERT_EQUAL(0, commands.size());
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_single_command);
+    RUN_TEST(test_batch_in_any_chunking);
+    RUN_TEST(test_escapes_in_strings);
+    RUN_TEST(test_unicode_escape_is_an_error);
+    RUN_TEST(test_incomplete_objects_are_skipped);
+    RUN_TEST(test_too_long_topic_is_rejected);
+    RUN_TEST(test_truncated_body_fails);
+    RUN_TEST(test_mismatched_brackets_fail);
+    RUN_TEST(test_depth_limit);
+    RUN_TEST(test_bare_word_as_key_fails);
+    RUN_TEST(test_nested_object_keeps_fields);
+    RUN_TEST(test_nested_command_rejects_enclosing_one);
+    RUN_TEST(test_missing_separators_fail);
+    RUN_TEST(test_misplaced_separators_fail);
+    RUN_TEST(test_literals_and_top_level);
+    RUN_TEST(test_validates_without_callback);
+    return UNITY_END();
+}
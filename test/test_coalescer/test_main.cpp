@@ -0,0 +1,188 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <vector>
+
+#include "coalescer.h"
+
+struct Light {
+    bool on;
+    uint8_t level;
+
+    bool operator==(const Light &other) const {
+        return on == other.on && level == other.level;
+    };
+};
+
+static const Light OFF = { false, 0 };
+static const Light ON = { true, 100 };
+static const Light DIM = { true, 30 };
+
+static std::vector<Light> applied;
+
+static void begin(CommandCoalescer<Light> &c) {
+    c.begin(OFF, [](const Light &state) {
+        applied.push_back(state);
+    });
+}
+
+void setUp(void) {
+    HostClock::reset();
+    HostClock::advanceMs(1000);
+    applied.clear();
+}
+
+void tearDown(void) {
+}
+
+void test_applies_after_window(void) {
+    CommandCoalescer<Light> c("light", 300, 4, 1);
+    begin(c);
+
+    c.submit(ON);
+    c.loop();
+    TEST_ASSERT_EQUAL(0, applied.size());
+
+    HostClock::advanceMs(299);
+    c.loop();
+    TEST_ASSERT_EQUAL(0, applied.size());
+
+    HostClock::advanceMs(1);
+    c.loop();
+    TEST_ASSERT_EQUAL(1, applied.size());
+    TEST_ASSERT_TRUE(applied[0] == ON);
+    TEST_ASSERT_TRUE(c.getState() == ON);
+    TEST_ASSERT_EQUAL(1, c.getCounters().applied);
+}
+
+void test_latest_wins_within_window(void) {
+    CommandCoalescer<Light> c("light", 300, 4, 1);
+    begin(c);
+
+    c.submit(ON);
+    HostClock::advanceMs(100);
+    c.submit(DIM);
+    HostClock::advanceMs(100);
+    c.submit(ON);
+    HostClock::advanceMs(100);
+    c.loop();
+
+    TEST_ASSERT_EQUAL(1, applied.size());
+    TEST_ASSERT_TRUE(applied[0] == ON);
+
+    auto &counters = c.getCounters();
+    TEST_ASSERT_EQUAL(3, counters.received);
+    TEST_ASSERT_EQUAL(2, counters.coalesced);
+    TEST_ASSERT_EQUAL(1, counters.applied);
+}
+
+void test_noop_commands_are_dropped(void) {
+    CommandCoalescer<Light> c("light", 300, 4, 1);
+    begin(c);
+
+    c.submit(OFF);
+    TEST_ASSERT_EQUAL(1, c.getCounters().dropped);
+
+    // back to the current state before the window ends
+    c.submit(ON);
+    c.submit(OFF);
+    HostClock::advanceMs(300);
+    c.loop();
+
+    TEST_ASSERT_EQUAL(0, applied.size());
+    TEST_ASSERT_EQUAL(2, c.getCounters().dropped);
+}
+
+void test_toggle_from_desired_state(void) {
+    CommandCoalescer<bool> c("toggle", 300, 4, 1);
+    std::vector<bool> toggled;
+    c.begin(false, [&toggled](const bool &state) {
+        toggled.push_back(state);
+    });
+
+    TEST_ASSERT_FALSE(c.getDesired());
+    c.submit(!c.getDesired());
+    TEST_ASSERT_TRUE(c.getDesired());
+    TEST_ASSERT_FALSE(c.getState());
+
+    // a second toggle within the window cancels the first
+    HostClock::advanceMs(100);
+    c.submit(!c.getDesired());
+    TEST_ASSERT_FALSE(c.getDesired());
+    HostClock::advanceMs(300);
+    c.loop();
+    TEST_ASSERT_EQUAL(0, toggled.size());
+
+    // a third one after it applies
+    c.submit(!c.getDesired());
+    HostClock::advanceMs(300);
+    c.loop();
+    TEST_ASSERT_EQUAL(1, toggled.size());
+    TEST_ASSERT_TRUE(c.getState());
+    TEST_ASSERT_TRUE(c.getDesired());
+}
+
+void test_expedite_skips_window(void) {
+    CommandCoalescer<Light> c("light", 300, 4, 1);
+    begin(c);
+
+    c.submit(DIM);
+    c.expedite();
+    c.loop();
+
+    TEST_ASSERT_EQUAL(1, applied.size());
+    TEST_ASSERT_TRUE(applied[0] == DIM);
+}
+
+void test_frame_rate_cap_throttles(void) {
+    // 4 frames/s, 2 frames per apply: two applies, then wait for tokens
+    CommandCoalescer<Light> c("light", 0, 4, 2);
+    begin(c);
+
+    c.submit(ON);
+    c.loop();
+    c.submit(DIM);
+    c.loop();
+    TEST_ASSERT_EQUAL(2, applied.size());
+
+    c.submit(OFF);
+    c.loop();
+    TEST_ASSERT_EQUAL(2, applied.size());
+    TEST_ASSERT_EQUAL(1, c.getCounters().throttled);
+
+    // still short of tokens: counted once
+    HostClock::advanceMs(250);
+    c.loop();
+    TEST_ASSERT_EQUAL(2, applied.size());
+    TEST_ASSERT_EQUAL(1, c.getCounters().throttled);
+
+    HostClock::advanceMs(250);
+    c.loop();
+    TEST_ASSERT_EQUAL(3, applied.size());
+    TEST_ASSERT_TRUE(applied[2] == OFF);
+}
+
+void test_tokens_refill_to_cap_only(void) {
+    CommandCoalescer<Light> c("light", 0, 4, 2);
+    begin(c);
+
+    // a long idle time refills no more than one second worth of frames
+    HostClock::advanceMs(60000);
+    const Light states[] = { ON, DIM, ON, DIM };
+    for (auto &s : states) {
+        c.submit(s);
+        c.loop();
+    }
+    TEST_ASSERT_EQUAL(2, applied.size());
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_applies_after_window);
+    RUN_TEST(test_latest_wins_within_window);
+    RUN_TEST(test_noop_commands_are_dropped);
+    RUN_TEST(test_toggle_from_desired_state);
+    RUN_TEST(test_expedite_skips_window);
+    RUN_TEST(test_frame_rate_cap_throttles);
+    RUN_TEST(test_tokens_refill_to_cap_only);
+    return UNITY_END();
+}
@@ -0,0 +1,210 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <malloc.h>
+#include <stdlib.h>
+
+#include "heapprof.h"
+#include "strprint.h"
+
+extern "C" void *__real_malloc(size_t size);
+
+static HeapTagStats before[HEAP_TAG_COUNT];
+
+// keeps the compiler from pairing up and dropping a malloc and its free
+template <typename T>
+static T *keep(T *p) {
+    asm volatile("" : : "r"(p) : "memory");
+    return p;
+}
+
+static const HeapTagStats &since(HeapTag tag, HeapTagStats &delta) {
+    auto &now = HeapProf::get(tag);
+    delta.allocs = now.allocs - before[tag].allocs;
+    delta.frees = now.frees - before[tag].frees;
+    delta.bytes = now.bytes - before[tag].bytes;
+    delta.live = now.live - before[tag].live;
+    delta.high = now.high;
+    return delta;
+}
+
+void setUp(void) {
+    for (int t = 0; t < HEAP_TAG_COUNT; t++) before[t] = HeapProf::get((HeapTag)t);
+}
+
+void tearDown(void) {
+}
+
+void test_counts_allocations_for_the_scope_tag(void) {
+    void *p;
+    {
+        HeapTagScope scope(HEAP_TAG_MQTT);
+        p = keep(malloc(40));
+    }
+    int32_t usable = malloc_usable_size(p);
+    TEST_ASSERT_GREATER_OR_EQUAL(40, usable);
+
+    HeapTagStats d;
+    since(HEAP_TAG_MQTT, d);
+    TEST_ASSERT_EQUAL(1, d.allocs);
+    TEST_ASSERT_EQUAL(40, d.bytes);
+    TEST_ASSERT_EQUAL(usable, d.live);
+    TEST_ASSERT_GREATER_OR_EQUAL(usable, d.high);
+
+    {
+        HeapTagScope scope(HEAP_TAG_MQTT);
+        free(p);
+    }
+    since(HEAP_TAG_MQTT, d);
+    TEST_ASSERT_EQUAL(1, d.frees);
+    TEST_ASSERT_EQUAL(0, d.live);
+}
+
+void test_free_counts_for_the_freeing_scope(void) {
+    void *p;
+    {
+        HeapTagScope scope(HEAP_TAG_HTTP);
+        p = keep(malloc(24));
+    }
+    int32_t usable = malloc_usable_size(p);
+    {
+        HeapTagScope scope(HEAP_TAG_IR);
+        free(p);
+    }
+
+    HeapTagStats d;
+    TEST_ASSERT_EQUAL(0, since(HEAP_TAG_HTTP, d).frees);
+    TEST_ASSERT_EQUAL(usable, d.live);
+    TEST_ASSERT_EQUAL(1, since(HEAP_TAG_IR, d).frees);
+    TEST_ASSERT_EQUAL(-usable, d.live);
+}
+
+void test_nested_scopes_restore_the_tag(void) {
+    void *outer, *inner, *after;
+    {
+        HeapTagScope scope(HEAP_TAG_BOOT);
+        {
+            HeapTagScope nested(HEAP_TAG_IR);
+            inner = keep(malloc(8));
+        }
+        outer = keep(malloc(16));
+    }
+    after = keep(malloc(4));
+
+    HeapTagStats d;
+    TEST_ASSERT_EQUAL(malloc_usable_size(inner), since(HEAP_TAG_IR, d).live);
+    TEST_ASSERT_EQUAL(malloc_usable_size(outer), since(HEAP_TAG_BOOT, d).live);
+    TEST_ASSERT_EQUAL(malloc_usable_size(after), since(HEAP_TAG_OTHER, d).live);
+
+    free(inner);
+    free(outer);
+    free(after);
+}
+
+void test_new_and_delete_are_counted(void) {
+    int *p;
+    {
+        HeapTagScope scope(HEAP_TAG_MQTT);
+        p = keep(new int[10]);
+        delete[] p;
+    }
+
+    HeapTagStats d;
+    since(HEAP_TAG_MQTT, d);
+    TEST_ASSERT_EQUAL(1, d.allocs);
+    TEST_ASSERT_EQUAL(1, d.frees);
+    TEST_ASSERT_EQUAL(0, d.live);
+}
+
+void test_realloc_is_a_free_and_an_allocation(void) {
+    char *p;
+    HeapTagStats d;
+    {
+        HeapTagScope scope(HEAP_TAG_IR);
+        p = (char *)malloc(10);
+        strcpy(p, "gateway");
+        p = (char *)realloc(p, 4000);
+        TEST_ASSERT_EQUAL_STRING("gateway", p);
+
+        since(HEAP_TAG_IR, d);
+        TEST_ASSERT_EQUAL(2, d.allocs);
+        TEST_ASSERT_EQUAL(1, d.frees);
+        TEST_ASSERT_EQUAL(malloc_usable_size(p), d.live);
+
+        free(p);
+    }
+    TEST_ASSERT_EQUAL(0, since(HEAP_TAG_IR, d).live);
+}
+
+void test_calloc_zeroes_and_counts(void) {
+    uint32_t *p;
+    {
+        HeapTagScope scope(HEAP_TAG_BOOT);
+        p = (uint32_t *)calloc(8, sizeof(uint32_t));
+    }
+    for (int i = 0; i < 8; i++) TEST_ASSERT_EQUAL(0, p[i]);
+
+    HeapTagStats d;
+    TEST_ASSERT_EQUAL(32, since(HEAP_TAG_BOOT, d).bytes);
+    TEST_ASSERT_EQUAL(malloc_usable_size(p), d.live);
+    free(p);
+}
+
+void test_foreign_blocks_are_freed(void) {
+    // as if allocated by the SDK, past the wrapper
+    auto p = __real_malloc(64);
+    memset(p, 0xA5, 64);
+    int32_t usable = malloc_usable_size(p);
+    {
+        HeapTagScope scope(HEAP_TAG_MQTT);
+        free(p);
+    }
+
+    HeapTagStats d;
+    TEST_ASSERT_EQUAL(1, since(HEAP_TAG_MQTT, d).frees);
+    TEST_ASSERT_EQUAL(-usable, d.live);
+}
+
+void test_high_water_per_tag(void) {
+    void *a, *b;
+    int32_t base;
+    {
+        HeapTagScope scope(HEAP_TAG_HTTP);
+        base = HeapProf::get(HEAP_TAG_HTTP).live;
+        a = keep(malloc(1000));
+        b = keep(malloc(2000));
+        free(a);
+        free(b);
+    }
+
+    auto &s = HeapProf::get(HEAP_TAG_HTTP);
+    TEST_ASSERT_GREATER_OR_EQUAL(base + 3000, s.high);
+    TEST_ASSERT_EQUAL(base, s.live);
+}
+
+void test_blocks_are_aligned(void) {
+    void *p = keep(malloc(1));
+    TEST_ASSERT_EQUAL(0, (uintptr_t)p % alignof(max_align_t));
+    free(p);
+}
+
+void test_prints_tags(void) {
+    StringPrint out;
+    HeapProf::printTo(out);
+    TEST_ASSERT_TRUE(out.str.startsWith("{\"tags\":{\"other\":{\"allocs\":"));
+    TEST_ASSERT_TRUE(out.str.indexOf("\"boot\":{") > 0);
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_counts_allocations_for_the_scope_tag);
+    RUN_TEST(test_free_counts_for_the_freeing_scope);
+    RUN_TEST(test_nested_scopes_restore_the_tag);
+    RUN_TEST(test_new_and_delete_are_counted);
+    RUN_TEST(test_realloc_is_a_free_and_an_allocation);
+    RUN_TEST(test_calloc_zeroes_and_counts);
+    RUN_TEST(test_foreign_blocks_are_freed);
+    RUN_TEST(test_high_water_per_tag);
+    RUN_TEST(test_blocks_are_aligned);
+    RUN_TEST(test_prints_tags);
+    return UNITY_END();
+}
@@ -0,0 +1,184 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bemfa.h"
+#include "httpd.h"
+#include "irlearn-fake.h"
+
+BemfaMqtt bemfaMqtt("bemfa.example", 9501, "test");
+Httpd httpd(80);
+FakeIrRecvBackend learnBackend;
+IrLearner learner(learnBackend);
+
+static std::unique_ptr<AsyncWebServerRequest> request(WebRequestMethod method, const char *url, const std::string &body = std::string()) {
+    std::unique_ptr<AsyncWebServerRequest> r(new AsyncWebServerRequest(method, url, body));
+    AsyncWebServer::onPort(80)->handle(*r);
+    return r;
+}
+
+static std::unique_ptr<AsyncWebServerRequest> get(const char *url) {
+    return request(HTTP_GET, url);
+}
+
+static std::vector<std::string> dispatched;
+
+void setUp(void) {
+    ESP.free_heap = 40000;
+    dispatched.clear();
+    HostClock::reset();
+    learner.stop();
+}
+
+void tearDown(void) {
+}
+
+void test_status_is_a_copy(void) {
+    auto first = get("/api/status");
+    TEST_ASSERT_EQUAL(200, first->response()->code());
+    auto body = first->response()->body();
+    TEST_ASSERT_TRUE(body.find("\"heap\":{\"free\":40000,") != std::string::npos);
+
+    // the next request rebuilds the buffer while the first may still be sending
+    ESP.free_heap = 12345;
+    auto second = get("/api/status");
+    TEST_ASSERT_TRUE(second->response()->body().find("\"free\":12345,") != std::string::npos);
+    TEST_ASSERT_EQUAL_STRING(body.c_str(), first->response()->body().c_str());
+}
+
+void test_status_has_no_etag(void) {
+    auto r = get("/api/status");
+    TEST_ASSERT_NULL(r->response()->header("ETag"));
+    TEST_ASSERT_EQUAL_STRING("no-store", r->response()->header("Cache-Control")->value().c_str());
+}
+
+void test_status_rebuilt_on_mdns_probe(void) {
+    auto before = get("/api/status")->response()->body();
+    TEST_ASSERT_TRUE(before.find("\"mdns\":{\"isRunning\":false}") != std::string::npos);
+
+    MDNS.begin("gateway");
+    auto after = get("/api/status")->response()->body();
+    TEST_ASSERT_TRUE(after.find("\"mdns\":{\"isRunning\":true}") != std::string::npos);
+}
+
+void test_version_is_revalidated(void) {
+    auto first = get("/version");
+    TEST_ASSERT_EQUAL(200, first->response()->code());
+    auto etag = first->response()->header("ETag");
+    TEST_ASSERT_NOT_NULL(etag);
+
+    AsyncWebServerRequest second(HTTP_GET, "/version");
+    second.addHeader("If-None-Match", etag->value());
+    AsyncWebServer::onPort(80)->handle(second);
+    TEST_ASSERT_EQUAL(304, second.response()->code());
+}
+
+void test_unknown_api_path_is_not_found(void) {
+    TEST_ASSERT_EQUAL(404, get("/api/nothing")->response()->code());
+}
+
+void test_devices_dispatches_batch(void) {
+    auto r = request(HTTP_POST, "/api/devices",
+        "{\"commands\":[{\"topic\":\"light002\",\"extra\":{\"a\":1},\"msg\":\"on\"},{\"topic\":\"none\",\"msg\":\"off\"}]}");
+    TEST_ASSERT_EQUAL(200, r->response()->code());
+    TEST_ASSERT_EQUAL_STRING("{\"accepted\":1,\"unrouted\":1,\"rejected\":0}", r->response()->body().c_str());
+    TEST_ASSERT_EQUAL(1, dispatched.size());
+    TEST_ASSERT_EQUAL_STRING("on", dispatched[0].c_str());
+}
+
+void test_devices_bad_body_moves_nothing(void) {
+    // the first command is complete before the missing comma
+    static const char *const bodies[] = {
+        "[{\"topic\":\"light002\",\"msg\":\"on\"} {\"topic\":\"light002\",\"msg\":\"off\"}]",
+        "[{\"topic\":\"light002\",\"msg\":\"on\"},{\"topic\" \"light002\"}]",
+        "[{\"topic\":\"light002\",\"msg\":\"on\"}",
+        ""
+    };
+    for (auto body : bodies) {
+        auto r = request(HTTP_POST, "/api/devices", body);
+        TEST_ASSERT_EQUAL(400, r->response()->code());
+    }
+    TEST_ASSERT_EQUAL(0, dispatched.size());
+}
+
+void test_devices_body_in_chunks(void) {
+    std::string body = "[{\"topic\":\"light002\",\"msg\":\"on#40\"}]";
+    AsyncWebServerRequest r(HTTP_POST, "/api/devices", body);
+    AsyncWebServer::onPort(80)->handle(r, 5);
+    TEST_ASSERT_EQUAL(200, r.response()->code());
+    TEST_ASSERT_EQUAL(1, dispatched.size());
+}
+
+void test_unknown_api_post_is_not_found(void) {
+    TEST_ASSERT_EQUAL(404, request(HTTP_POST, "/api/anything", "{\"a\":1}")->response()->code());
+}
+
+void test_learn_default_timeout(void) {
+    auto r = request(HTTP_POST, "/api/learn");
+    TEST_ASSERT_EQUAL(202, r->response()->code());
+    TEST_ASSERT_EQUAL(IrLearner::LISTENING, learner.getState());
+
+    HostClock::advanceMs(HTTPD_LEARN_TIMEOUT_MS);
+    learner.loop();
+    TEST_ASSERT_EQUAL(IrLearner::LISTENING, learner.getState());
+    HostClock::advanceMs(1);
+    learner.loop();
+    TEST_ASSERT_EQUAL(IrLearner::TIMEOUT, learner.getState());
+}
+
+void test_learn_timeout_in_bounds(void) {
+    auto r = request(HTTP_POST, "/api/learn?timeout=60000");
+    TEST_ASSERT_EQUAL(202, r->response()->code());
+
+    HostClock::advanceMs(60000);
+    learner.loop();
+    TEST_ASSERT_EQUAL(IrLearner::LISTENING, learner.getState());
+    HostClock::advanceMs(1);
+    learner.loop();
+    TEST_ASSERT_EQUAL(IrLearner::TIMEOUT, learner.getState());
+
+    TEST_ASSERT_EQUAL(202, request(HTTP_POST, "/api/learn?timeout=1000")->response()->code());
+}
+
+void test_learn_bad_timeout_is_rejected(void) {
+    static const char *const urls[] = {
+        "/api/learn?timeout=0",
+        "/api/learn?timeout=999",
+        "/api/learn?timeout=60001",
+        "/api/learn?timeout=-5000",
+        "/api/learn?timeout=5000ms",
+        "/api/learn?timeout=4294968296",
+        "/api/learn?timeout="
+    };
+    for (auto url : urls) {
+        auto r = request(HTTP_POST, url);
+        TEST_ASSERT_EQUAL_INT_MESSAGE(400, r->response()->code(), url);
+        TEST_ASSERT_EQUAL(IrLearner::IDLE, learner.getState());
+    }
+}
+
+int main(int, char **) {
+    bemfaMqtt.onMessage("light002", [](const StrView &, const StrView &msg, AsyncMqttClient &) {
+        dispatched.push_back(std::string(msg.data(), msg.length()));
+    });
+    bemfaMqtt.begin();
+    httpd.setLearner(&learner);
+    httpd.begin();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_status_is_a_copy);
+    RUN_TEST(test_status_has_no_etag);
+    RUN_TEST(test_status_rebuilt_on_mdns_probe);
+    RUN_TEST(test_version_is_revalidated);
+    RUN_TEST(test_unknown_api_path_is_not_found);
+    RUN_TEST(test_devices_dispatches_batch);
+    RUN_TEST(test_devices_bad_body_moves_nothing);
+    RUN_TEST(test_devices_body_in_chunks);
+    RUN_TEST(test_unknown_api_post_is_not_found);
+    RUN_TEST(test_learn_default_timeout);
+    RUN_TEST(test_learn_timeout_in_bounds);
+    RUN_TEST(test_learn_bad_timeout_is_rejected);
+    return UNITY_END();
+}
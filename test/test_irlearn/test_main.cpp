@@ -0,0 +1,240 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <vector>
+
+#include "irlearn.h"
+#include "irlearn-fake.h"
+#include "ir-captures.h"
+#include "irproto.h"
+#include "strprint.h"
+
+static constexpr IrBits<4> necBits = nec(0x04, 0x08);
+static constexpr IrCode necCode = irCode(IR_NEC, necBits);
+
+// Expands `code` like a receiver would capture it: each timing off by up
+// to `jitter` us, and `frames` copies separated by `gap` us.
+static std::vector<uint16_t> capture(const IrCode &code, int jitter, int frames = 1, uint16_t gap = 40000) {
+    IrCodeTimings t;
+    t.load(&code);
+
+    std::vector<uint16_t> out;
+    for (int f = 0; f < frames; f++) {
+        if (f) out.push_back(gap);
+        for (uint16_t i = 0; i < t.length(); i++) {
+            int d = jitter ? (int)((i * 7919 + f * 31) % (2 * jitter + 1)) - jitter : 0;
+            out.push_back(t.at(i) + d);
+        }
+    }
+    return out;
+}
+
+static IrLearnDecoder::Phase decode(IrLearnDecoder &decoder, const std::vector<uint16_t> &timings) {
+    decoder.begin(timings.data(), timings.size());
+    int steps = 0;
+    while (decoder.step()) {
+        TEST_ASSERT_LESS_THAN(1000, ++steps);
+    }
+    return decoder.getPhase();
+}
+
+void setUp(void) {
+    HostClock::reset();
+}
+
+void tearDown(void) {
+}
+
+void test_decodes_nec(void) {
+    IrLearnDecoder decoder;
+    auto timings = capture(necCode, 60);
+    TEST_ASSERT_EQUAL(IrLearnDecoder::DONE, decode(decoder, timings));
+
+    auto &code = decoder.getCode();
+    TEST_ASSERT_EQUAL_STRING("nec", decoder.getProtocol());
+    TEST_ASSERT_EQUAL(38000, code.hz);
+    TEST_ASSERT_EQUAL(32, code.nbits);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(necBits.data, code.bits, 4);
+    TEST_ASSERT_EQUAL(0, decoder.getRepeats());
+    TEST_ASSERT_UINT32_WITHIN(60, 560, code.bit_mark);
+    TEST_ASSERT_UINT32_WITHIN(60, 1690, code.one_space);
+}
+
+void test_counts_repeats(void) {
+    IrLearnDecoder decoder;
+    auto timings = capture(necCode, 40, 3);
+    TEST_ASSERT_EQUAL(IrLearnDecoder::DONE, decode(decoder, timings));
+    TEST_ASSERT_EQUAL(2, decoder.getRepeats());
+    TEST_ASSERT_EQUAL(2 + 32 * 2 + 1, decoder.getFrameLength());
+}
+
+void test_different_second_frame_is_not_a_repeat(void) {
+    static constexpr IrBits<4> otherBits = nec(0x04, 0x09);
+    static constexpr IrCode other = irCode(IR_NEC, otherBits);
+
+    auto timings = capture(necCode, 0);
+    timings.push_back(40000);
+    auto second = capture(other, 0);
+    timings.insert(timings.end(), second.begin(), second.end());
+
+    IrLearnDecoder decoder;
+    TEST_ASSERT_EQUAL(IrLearnDecoder::DONE, decode(decoder, timings));
+    TEST_ASSERT_EQUAL(0, decoder.getRepeats());
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(necBits.data, decoder.getCode().bits, 4);
+}
+
+void test_unknown_timings_have_no_protocol(void) {
+    static const IrProtocol odd = { 40000, 2400, 600, 600, 600, 1200, 600, 0 };
+    static constexpr IrBits<2> bits = irBits<2>(0x1A5, 12);
+    static const IrCode code = irCode(odd, bits);
+
+    IrLearnDecoder decoder;
+    TEST_ASSERT_EQUAL(IrLearnDecoder::DONE, decode(decoder, capture(code, 30)));
+    TEST_ASSERT_NULL(decoder.getProtocol());
+    TEST_ASSERT_EQUAL(38000, decoder.getCode().hz);
+    TEST_ASSERT_EQUAL(12, decoder.getCode().nbits);
+    TEST_ASSERT_EQUAL_HEX8(0xA5, decoder.getCode().bits[0]);
+}
+
+void test_fails_without_two_space_lengths(void) {
+    std::vector<uint16_t> timings = { 9000, 4500 };
+    for (int i = 0; i < 16; i++) {
+        timings.push_back(560);
+        timings.push_back(560);
+    }
+    timings.push_back(560);
+
+    IrLearnDecoder decoder;
+    TEST_ASSERT_EQUAL(IrLearnDecoder::FAILED, decode(decoder, timings));
+}
+
+void test_fails_on_short_capture(void) {
+    IrLearnDecoder decoder;
+    TEST_ASSERT_EQUAL(IrLearnDecoder::FAILED, decode(decoder, { 9000, 4500, 560 }));
+}
+
+void test_steps_are_bounded(void) {
+    IrLearnDecoder decoder;
+    auto timings = capture(necCode, 0, 4);
+    decoder.begin(timings.data(), timings.size());
+
+    // every step handles at most IR_LEARN_SLICE timings
+    int steps = 1;
+    while (decoder.step()) steps++;
+    TEST_ASSERT_GREATER_OR_EQUAL((int)timings.size() / IR_LEARN_SLICE, steps);
+}
+
+void test_learner_decodes_from_loop(void) {
+    FakeIrRecvBackend backend;
+    IrLearner learner(backend);
+
+    learner.start(1000);
+    TEST_ASSERT_TRUE(backend.enabled);
+    learner.loop();
+    TEST_ASSERT_EQUAL(IrLearner::LISTENING, learner.getState());
+
+    backend.capture(capture(necCode, 50));
+    learner.loop();
+    TEST_ASSERT_FALSE(backend.enabled);
+    TEST_ASSERT_EQUAL(IrLearner::DECODING, learner.getState());
+
+    for (int i = 0; i < 100 && learner.getState() == IrLearner::DECODING; i++) learner.loop();
+    TEST_ASSERT_EQUAL(IrLearner::DONE, learner.getState());
+
+    StringPrint out;
+    learner.printTo(out);
+    TEST_ASSERT_TRUE(out.str.startsWith("{\"state\":\"done\",\"repeats\":0,\"protocol\":\"nec\",\"hz\":38000,"));
+    TEST_ASSERT_TRUE(out.str.endsWith(",\"bits\":32,\"code\":\"04FB08F7\"}"));
+}
+
+void test_learner_times_out(void) {
+    FakeIrRecvBackend backend;
+    IrLearner learner(backend);
+
+    learner.start(1000);
+    HostClock::advanceMs(1001);
+    learner.loop();
+    TEST_ASSERT_EQUAL(IrLearner::TIMEOUT, learner.getState());
+    TEST_ASSERT_FALSE(backend.enabled);
+}
+
+// The light's remote, as recorded: the decoder has to find the same
+// kaseikyo40() codes the gateway sends for it.
+
+static std::vector<uint16_t> recorded(const uint16_t *frame, int frames = 1) {
+    std::vector<uint16_t> out;
+    for (int f = 0; f < frames; f++) {
+        if (f) out.push_back(65535); // the receiver's longest space
+        out.insert(out.end(), frame, frame + LIGHT_CAPTURE_LEN);
+    }
+    return out;
+}
+
+void test_decodes_light_captures(void) {
+    static constexpr IrBits<5> onBits = kaseikyo40(0x522C, 0, 0x2D);
+    static constexpr IrBits<5> offBits = kaseikyo40(0x522C, 0, 0x2F);
+
+    IrLearnDecoder on;
+    TEST_ASSERT_EQUAL(IrLearnDecoder::DONE, decode(on, recorded(lightOnCapture)));
+    TEST_ASSERT_EQUAL_STRING("kaseikyo", on.getProtocol());
+    TEST_ASSERT_EQUAL(IR_KASEIKYO.hz, on.getCode().hz);
+    TEST_ASSERT_EQUAL(40, on.getCode().nbits);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(onBits.data, on.getCode().bits, 5);
+
+    IrLearnDecoder off;
+    TEST_ASSERT_EQUAL(IrLearnDecoder::DONE, decode(off, recorded(lightOffCapture)));
+    TEST_ASSERT_EQUAL_STRING("kaseikyo", off.getProtocol());
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(offBits.data, off.getCode().bits, 5);
+
+    // the measured timings are the remote's, not the protocol's
+    TEST_ASSERT_UINT32_WITHIN(4, 464, on.getCode().bit_mark);
+    TEST_ASSERT_UINT32_WITHIN(4, 1278, on.getCode().one_space);
+}
+
+void test_counts_light_capture_repeats(void) {
+    IrLearnDecoder decoder;
+    TEST_ASSERT_EQUAL(IrLearnDecoder::DONE, decode(decoder, recorded(lightOnCapture, 2)));
+    TEST_ASSERT_EQUAL(1, decoder.getRepeats());
+    TEST_ASSERT_EQUAL(LIGHT_CAPTURE_LEN, decoder.getFrameLength());
+
+    // on, then off: the second frame is another command
+    auto timings = recorded(lightOnCapture);
+    timings.push_back(65535);
+    timings.insert(timings.end(), lightOffCapture, lightOffCapture + LIGHT_CAPTURE_LEN);
+    IrLearnDecoder mixed;
+    TEST_ASSERT_EQUAL(IrLearnDecoder::DONE, decode(mixed, timings));
+    TEST_ASSERT_EQUAL(0, mixed.getRepeats());
+    TEST_ASSERT_EQUAL_HEX8(0x2D, mixed.getCode().bits[3]);
+}
+
+void test_learner_prints_light_capture(void) {
+    FakeIrRecvBackend backend;
+    IrLearner learner(backend);
+
+    learner.start(1000);
+    backend.capture(recorded(lightOffCapture, 2));
+    for (int i = 0; i < 100 && learner.getState() != IrLearner::DONE; i++) learner.loop();
+    TEST_ASSERT_EQUAL(IrLearner::DONE, learner.getState());
+
+    // the same hex as the device profiles take
+    StringPrint out;
+    learner.printTo(out);
+    TEST_ASSERT_TRUE(out.str.startsWith("{\"state\":\"done\",\"repeats\":1,\"protocol\":\"kaseikyo\",\"hz\":37000,"));
+    TEST_ASSERT_TRUE(out.str.endsWith(",\"bits\":40,\"code\":\"2C52092F26\"}"));
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_decodes_nec);
+    RUN_TEST(test_counts_repeats);
+    RUN_TEST(test_different_second_frame_is_not_a_repeat);
+    RUN_TEST(test_unknown_timings_have_no_protocol);
+    RUN_TEST(test_fails_without_two_space_lengths);
+    RUN_TEST(test_fails_on_short_capture);
+    RUN_TEST(test_steps_are_bounded);
+    RUN_TEST(test_learner_decodes_from_loop);
+    RUN_TEST(test_learner_times_out);
+    RUN_TEST(test_decodes_light_captures);
+    RUN_TEST(test_counts_light_capture_repeats);
+    RUN_TEST(test_learner_prints_light_capture);
+    return UNITY_END();
+}
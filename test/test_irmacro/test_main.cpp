@@ -0,0 +1,158 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "irproto.h"
+#include "irtx.h"
+#include "irmacro.h"
+#include "irtx-fake.h"
+
+// Two NEC codes, told apart on air by bit 2 of the address.
+static constexpr IrBits<4> upBits = nec(0x04, 0x08);
+static constexpr IrCode upCode = irCode(IR_NEC, upBits);
+static constexpr IrBits<4> downBits = nec(0x01, 0x08);
+static constexpr IrCode downCode = irCode(IR_NEC, downBits);
+
+// timings of one NEC frame: header, 32 bits, stop mark
+#define NEC_TIMINGS (2 + 32 * 2 + 1)
+
+void setUp(void) {
+    HostClock::reset();
+}
+
+void tearDown(void) {
+}
+
+// Plays out the macro the way the main loop does: the player feeds between
+// the timer ticks, until it is done and the transmitter is idle.
+static void run(IrMacroPlayer &player, FakeIrTxBackend &backend) {
+    for (int i = 0; i < 100000; i++) {
+        player.loop();
+        if (!backend.tick() && !player.isPlaying()) break;
+    }
+}
+
+// true if frame `n` of the recorded timings is `upCode`
+static bool isUp(const std::vector<uint32_t> &timings, size_t n) {
+    return timings[n * (NEC_TIMINGS + 1) + 3 + 2 * 2] == 1690;
+}
+
+void test_param_step_repeats_with_gaps(void) {
+    FakeIrTxBackend backend;
+    IrTransmitter tx(backend);
+    IrMacroPlayer player(tx);
+    tx.begin();
+
+    static const IrMacroStep steps[] = {
+        { &upCode, 1, 50 },
+        { &downCode, IR_MACRO_PARAM, 120 }
+    };
+    static const IrMacro macro = { "down", steps, 2 };
+
+    player.play(macro, 3);
+    run(player, backend);
+
+    TEST_ASSERT_FALSE(player.isPlaying());
+    TEST_ASSERT_TRUE(tx.isIdle());
+    TEST_ASSERT_EQUAL(4, tx.getStats().frames);
+
+    // four frames, each but the last followed by its step's gap
+    auto timings = backend.timings();
+    TEST_ASSERT_EQUAL(4 * NEC_TIMINGS + 3, timings.size());
+    TEST_ASSERT_EQUAL(50000, timings[NEC_TIMINGS]);
+    TEST_ASSERT_EQUAL(120000, timings[2 * NEC_TIMINGS + 1]);
+    TEST_ASSERT_EQUAL(120000, timings[3 * NEC_TIMINGS + 2]);
+
+    TEST_ASSERT_TRUE(isUp(timings, 0));
+    for (size_t n = 1; n < 4; n++) TEST_ASSERT_FALSE(isUp(timings, n));
+}
+
+void test_param_zero_skips_step(void) {
+    FakeIrTxBackend backend;
+    IrTransmitter tx(backend);
+    IrMacroPlayer player(tx);
+    tx.begin();
+
+    static const IrMacroStep steps[] = {
+        { &downCode, IR_MACRO_PARAM, 120 },
+        { &upCode, 1, 0 }
+    };
+    static const IrMacro macro = { "skip", steps, 2 };
+
+    player.play(macro, 0);
+    run(player, backend);
+
+    TEST_ASSERT_EQUAL(1, tx.getStats().frames);
+    auto timings = backend.timings();
+    TEST_ASSERT_EQUAL(NEC_TIMINGS, timings.size());
+    TEST_ASSERT_TRUE(isUp(timings, 0));
+}
+
+void test_feeds_at_most_pipeline(void) {
+    FakeIrTxBackend backend;
+    IrTransmitter tx(backend);
+    IrMacroPlayer player(tx);
+    tx.begin();
+
+    static const IrMacroStep steps[] = {
+        { &upCode, IR_MACRO_PARAM, 10 }
+    };
+    static const IrMacro macro = { "many", steps, 1 };
+
+    player.play(macro, 6);
+    size_t max_queued = 0;
+    for (int i = 0; i < 100000 && player.isPlaying(); i++) {
+        player.loop();
+        size_t queued = 0;
+        for (uint8_t tag = 1; tag; tag++) queued += tx.pending(tag); // any generation
+        if (queued > max_queued) max_queued = queued;
+        backend.tick();
+    }
+    backend.run();
+
+    TEST_ASSERT_EQUAL(IR_MACRO_PIPELINE, max_queued);
+    TEST_ASSERT_EQUAL(6, tx.getStats().frames);
+}
+
+void test_play_cancels_previous_generation(void) {
+    FakeIrTxBackend backend;
+    IrTransmitter tx(backend);
+    IrMacroPlayer player(tx);
+    tx.begin();
+
+    static const IrMacroStep upSteps[] = {
+        { &upCode, IR_MACRO_PARAM, 50 }
+    };
+    static const IrMacro up = { "up", upSteps, 1 };
+    static const IrMacroStep downSteps[] = {
+        { &downCode, 1, 0 }
+    };
+    static const IrMacro down = { "down", downSteps, 1 };
+
+    // first frame on air, the pipeline refilled behind it
+    player.play(up, 5);
+    backend.tick();
+    backend.tick();
+    player.loop();
+    TEST_ASSERT_EQUAL(0, tx.getStats().cancelled);
+
+    player.play(down);
+    TEST_ASSERT_EQUAL(IR_MACRO_PIPELINE, tx.getStats().cancelled);
+    run(player, backend);
+
+    // the frame on air is finished and keeps its gap, then the new macro
+    TEST_ASSERT_EQUAL(2, tx.getStats().frames);
+    auto timings = backend.timings();
+    TEST_ASSERT_EQUAL(2 * NEC_TIMINGS + 1, timings.size());
+    TEST_ASSERT_EQUAL(50000, timings[NEC_TIMINGS]);
+    TEST_ASSERT_TRUE(isUp(timings, 0));
+    TEST_ASSERT_FALSE(isUp(timings, 1));
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_param_step_repeats_with_gaps);
+    RUN_TEST(test_param_zero_skips_step);
+    RUN_TEST(test_feeds_at_most_pipeline);
+    RUN_TEST(test_play_cancels_previous_generation);
+    return UNITY_END();
+}
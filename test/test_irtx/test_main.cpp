@@ -0,0 +1,347 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "irproto.h"
+#include "irtx.h"
+#include "irtx-esp8266.h"
+#include "irtx-fake.h"
+#include "ir-captures.h"
+
+static constexpr IrBits<4> necBits = nec(0x04, 0x08);
+static constexpr IrCode necCode = irCode(IR_NEC, necBits);
+
+static const uint16_t raw[] = { 1000, 500, 200, 300, 400 };
+
+void setUp(void) {
+    HostClock::reset();
+    HostPins::reset();
+    HostTimer0::reset();
+}
+
+void tearDown(void) {
+}
+
+void test_raw_frame_timing(void) {
+    FakeIrTxBackend backend;
+    IrTransmitter tx(backend);
+    tx.begin();
+
+    TEST_ASSERT_TRUE(tx.send(IrFrame { raw, 5, 38000, 0 }));
+    TEST_ASSERT_FALSE(tx.isIdle());
+    TEST_ASSERT_TRUE(backend.edges.empty()); // send() only queues
+
+    backend.run();
+    TEST_ASSERT_TRUE(tx.isIdle());
+
+    auto timings = backend.timings();
+    TEST_ASSERT_EQUAL(5, timings.size());
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(raw, timings.data(), 5);
+    TEST_ASSERT_EQUAL(38000, backend.edges[0].hz);
+    TEST_ASSERT_EQUAL(1, tx.getStats().frames);
+}
+
+void test_code_expands_to_protocol_timings(void) {
+    FakeIrTxBackend backend;
+    IrTransmitter tx(backend);
+    tx.begin();
+
+    TEST_ASSERT_TRUE(tx.send(&necCode));
+    backend.run();
+
+    auto timings = backend.timings();
+    TEST_ASSERT_EQUAL(2 + 32 * 2 + 1, timings.size());
+    TEST_ASSERT_EQUAL(9000, timings[0]);
+    TEST_ASSERT_EQUAL(4500, timings[1]);
+
+    // address 0x04, LSB first: bit 2 is the only one set in the first byte
+    for (int bit = 0; bit < 8; bit++) {
+        TEST_ASSERT_EQUAL(560, timings[2 + bit * 2]);
+        TEST_ASSERT_EQUAL(bit == 2 ? 1690 : 560, timings[3 + bit * 2]);
+    }
+    TEST_ASSERT_EQUAL(560, timings.back());
+}
+
+void test_gap_between_frames(void) {
+    FakeIrTxBackend backend;
+    IrTransmitter tx(backend);
+    tx.begin();
+
+    tx.send(IrFrame { raw, 5, 38000, 40 });
+    tx.send(IrFrame { raw, 5, 38000, 0 });
+    backend.run();
+
+    auto timings = backend.timings();
+    TEST_ASSERT_EQUAL(11, timings.size());
+    TEST_ASSERT_EQUAL(40000, timings[5]);
+    TEST_ASSERT_EQUAL(2, tx.getStats().frames);
+}
+
+void test_queue_full_drops(void) {
+    FakeIrTxBackend backend;
+    IrTransmitter tx(backend);
+    tx.begin();
+
+    int sent = 0;
+    while (tx.send(IrFrame { raw, 5, 38000, 0 })) sent++;
+
+    TEST_ASSERT_EQUAL(IR_TX_QUEUE_LEN - 1, sent);
+    TEST_ASSERT_TRUE(tx.isFull());
+    TEST_ASSERT_EQUAL(1, tx.getStats().dropped);
+
+    backend.run();
+    TEST_ASSERT_EQUAL(sent, tx.getStats().frames);
+}
+
+void test_code_too_long_drops(void) {
+    FakeIrTxBackend backend;
+    IrTransmitter tx(backend);
+    tx.begin();
+
+    static uint8_t bits[IR_CODE_MAX_BYTES + 1];
+    IrCode code = necCode;
+    code.nbits = IR_CODE_MAX_BITS + 1;
+    code.bits = bits;
+
+    TEST_ASSERT_FALSE(tx.send(&code));
+    TEST_ASSERT_EQUAL(1, tx.getStats().dropped);
+    TEST_ASSERT_TRUE(tx.isIdle());
+    TEST_ASSERT_FALSE(backend.armed());
+}
+
+void test_cancel_spares_frame_on_air(void) {
+    FakeIrTxBackend backend;
+    IrTransmitter tx(backend);
+    tx.begin();
+
+    tx.send(&necCode, 0, 7);
+    tx.send(&necCode, 0, 7);
+    tx.send(&necCode, 0, 9);
+
+    // start the first frame, then cancel
+    backend.tick();
+    backend.tick();
+    TEST_ASSERT_EQUAL(1, tx.pending(7));
+    TEST_ASSERT_EQUAL(1, tx.cancel(7));
+    TEST_ASSERT_EQUAL(0, tx.pending(7));
+    TEST_ASSERT_EQUAL(1, tx.pending(9));
+
+    backend.run();
+    TEST_ASSERT_EQUAL(2, tx.getStats().frames);
+    TEST_ASSERT_EQUAL(1, tx.getStats().cancelled);
+
+    // the first frame was finished: two full frames on air, back to back
+    TEST_ASSERT_EQUAL(2 * (2 + 32 * 2 + 1) + 1, backend.timings().size());
+}
+
+void test_queue_latency_is_recorded(void) {
+    FakeIrTxBackend backend;
+    IrTransmitter tx(backend);
+    tx.begin();
+
+    tx.send(IrFrame { raw, 5, 38000, 0 });
+    tx.send(IrFrame { raw, 5, 38000, 0 });
+    backend.run();
+
+    auto stats = tx.getStats();
+    TEST_ASSERT_EQUAL(2400, stats.last_tx_us);
+    TEST_ASSERT_GREATER_OR_EQUAL(2400, stats.max_queue_us);
+}
+
+void test_edges_start_on_time(void) {
+    FakeIrTxBackend backend;
+    IrTransmitter tx(backend);
+    tx.begin();
+
+    HostClock::advanceUs(500);
+    tx.send(IrFrame { raw, 5, 38000, 0 });
+    backend.run();
+
+    // one tick to start, then every edge exactly after the previous timing
+    uint32_t at = 501;
+    for (size_t i = 0; i < 5; i++) {
+        TEST_ASSERT_EQUAL(at, backend.edges[i].at);
+        TEST_ASSERT_EQUAL((i & 1) == 0, backend.edges[i].mark);
+        at += raw[i];
+    }
+    TEST_ASSERT_EQUAL(at, backend.edges[5].at);
+    TEST_ASSERT_FALSE(backend.edges[5].mark);
+    TEST_ASSERT_FALSE(backend.armed());
+}
+
+void test_cancel_during_gap(void) {
+    FakeIrTxBackend backend;
+    IrTransmitter tx(backend);
+    tx.begin();
+
+    tx.send(&necCode, 100, 1);
+    tx.send(&necCode, 100, 1);
+    tx.send(IrFrame { raw, 5, 38000, 0 });
+
+    // through the first frame, into its gap
+    while (tx.getStats().frames == 0) backend.tick();
+    auto gap_from = HostClock::us;
+    TEST_ASSERT_EQUAL(gap_from + 100000, backend.due());
+
+    TEST_ASSERT_EQUAL(1, tx.cancel(1));
+    backend.run();
+
+    // the untagged frame still waits out the gap
+    auto timings = backend.timings();
+    TEST_ASSERT_EQUAL(67 + 1 + 5, timings.size());
+    TEST_ASSERT_EQUAL(100000, timings[67]);
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(raw, &timings[68], 5);
+    TEST_ASSERT_EQUAL(2, tx.getStats().frames);
+}
+
+void test_cancel_before_start_sends_nothing(void) {
+    FakeIrTxBackend backend;
+    IrTransmitter tx(backend);
+    tx.begin();
+
+    tx.send(&necCode, 0, 3);
+    tx.send(&necCode, 0, 3);
+    TEST_ASSERT_EQUAL(2, tx.cancel(3));
+
+    backend.run();
+    TEST_ASSERT_TRUE(tx.isIdle());
+    TEST_ASSERT_TRUE(backend.edges.empty());
+    TEST_ASSERT_EQUAL(0, tx.getStats().frames);
+
+    // and the queue still works afterwards
+    TEST_ASSERT_TRUE(tx.send(IrFrame { raw, 5, 38000, 0 }));
+    backend.run();
+    TEST_ASSERT_EQUAL(1, tx.getStats().frames);
+}
+
+struct Burst {
+    uint64_t start;
+    uint64_t end;
+    int pulses;
+    uint64_t high_us;
+};
+
+// Carrier bursts on `pin`, from the GPIO register writes: pulses closer
+// than `max_gap_us` belong to the same mark.
+static std::vector<Burst> bursts(uint8_t pin, uint32_t max_gap_us = 100) {
+    std::vector<Burst> out;
+    bool high = false;
+    uint64_t high_at = 0;
+    for (auto &w : HostPins::writes) {
+        if (w.pin != pin) continue;
+        if (w.value && !high) {
+            if (out.empty() || w.us - out.back().end > max_gap_us) out.push_back(Burst { w.us, w.us, 0, 0 });
+            out.back().pulses++;
+            high = true;
+            high_at = w.us;
+        } else if (!w.value && high) {
+            high = false;
+            out.back().end = w.us;
+            out.back().high_us += w.us - high_at;
+        }
+    }
+    return out;
+}
+
+void test_esp8266_carrier_from_timer(void) {
+    static const uint16_t frame[] = { 3456, 1728, 432, 1296, 432 };
+
+    Esp8266IrTxBackend backend(13);
+    IrTransmitter tx(backend);
+    tx.begin();
+
+    tx.send(IrFrame { frame, 5, 37000, 0 });
+    int interrupts = 0;
+    while (HostTimer0::fire()) interrupts++;
+
+    TEST_ASSERT_TRUE(tx.isIdle());
+    TEST_ASSERT_EQUAL(LOW, digitalRead(13));
+
+    auto marks = bursts(13);
+    TEST_ASSERT_EQUAL(3, marks.size());
+
+    // marks and spaces within a microsecond of the timings
+    uint64_t at = marks[0].start;
+    for (int i = 0; i < 3; i++) {
+        uint32_t len = frame[i * 2];
+        TEST_ASSERT_UINT32_WITHIN(1, at, marks[i].start);
+        TEST_ASSERT_UINT32_WITHIN(27, at + len, marks[i].end); // the last pulse may be cut short
+
+        // 37kHz at about 33% duty
+        TEST_ASSERT_INT_WITHIN(1, len * 37 / 1000, marks[i].pulses);
+        TEST_ASSERT_UINT32_WITHIN(len / 20, len / 3, marks[i].high_us);
+
+        if (i < 2) at += len + frame[i * 2 + 1];
+    }
+
+    // two interrupts per carrier period, one per space
+    TEST_ASSERT_INT_WITHIN(8, (3456 + 432 * 2) * 37 / 1000 * 2 + 3, interrupts);
+}
+
+void test_esp8266_inverted_output(void) {
+    static const uint16_t frame[] = { 500, 500, 500 };
+
+    Esp8266IrTxBackend backend(4, LOW);
+    IrTransmitter tx(backend);
+    tx.begin();
+    TEST_ASSERT_EQUAL(HIGH, digitalRead(4));
+
+    tx.send(IrFrame { frame, 3, 38000, 0 });
+    while (HostTimer0::fire()) {}
+
+    TEST_ASSERT_EQUAL(HIGH, digitalRead(4));
+    TEST_ASSERT_EQUAL(2 * 500 * 38 / 1000, std::count_if(HostPins::writes.begin(), HostPins::writes.end(), [](const HostGpioWrite &w) {
+        return w.value == LOW;
+    }));
+}
+
+// The light's codes are built by kaseikyo40() with the standard Kaseikyo
+// timings, not copied from its remote. Its remote runs about 7% slow on the
+// marks; receivers take 25%, so what counts is that every timing lands on
+// the same side of the zero/one threshold as the capture.
+static void assertMatchesCapture(const IrCode &code, const uint16_t *capture) {
+    FakeIrTxBackend backend;
+    IrTransmitter tx(backend);
+    tx.begin();
+
+    TEST_ASSERT_TRUE(tx.send(&code));
+    backend.run();
+    TEST_ASSERT_EQUAL(IR_KASEIKYO.hz, backend.edges[0].hz);
+
+    auto timings = backend.timings();
+    TEST_ASSERT_EQUAL(LIGHT_CAPTURE_LEN, timings.size());
+    uint16_t threshold = (IR_KASEIKYO.zero_space + IR_KASEIKYO.one_space) / 2;
+    for (size_t i = 0; i < timings.size(); i++) {
+        TEST_ASSERT_UINT32_WITHIN(capture[i] * 8 / 100, capture[i], timings[i]);
+        if (i >= 2 && i % 2) {
+            TEST_ASSERT_EQUAL(capture[i] > threshold, timings[i] > threshold);
+        }
+    }
+}
+
+void test_kaseikyo40_matches_light_captures(void) {
+    static constexpr IrBits<5> onBits = kaseikyo40(0x522C, 0, 0x2D);
+    static constexpr IrCode on = irCode(IR_KASEIKYO, onBits);
+    static constexpr IrBits<5> offBits = kaseikyo40(0x522C, 0, 0x2F);
+    static constexpr IrCode off = irCode(IR_KASEIKYO, offBits);
+
+    assertMatchesCapture(on, lightOnCapture);
+    assertMatchesCapture(off, lightOffCapture);
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_raw_frame_timing);
+    RUN_TEST(test_code_expands_to_protocol_timings);
+    RUN_TEST(test_gap_between_frames);
+    RUN_TEST(test_queue_full_drops);
+    RUN_TEST(test_code_too_long_drops);
+    RUN_TEST(test_cancel_spares_frame_on_air);
+    RUN_TEST(test_queue_latency_is_recorded);
+    RUN_TEST(test_edges_start_on_time);
+    RUN_TEST(test_cancel_during_gap);
+    RUN_TEST(test_cancel_before_start_sends_nothing);
+    RUN_TEST(test_esp8266_carrier_from_timer);
+    RUN_TEST(test_esp8266_inverted_output);
+    RUN_TEST(test_kaseikyo40_matches_light_captures);
+    return UNITY_END();
+}
@@ -0,0 +1,149 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "router.h"
+#include "strview.h"
+#include "strprint.h"
+
+typedef TopicRouter<int> Router;
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+static std::vector<int> listenersOf(const Router &router, const char *topic) {
+    std::vector<int> out;
+    auto route = router.find(topic, strlen(topic));
+    if (!route) return out;
+
+    auto listeners = router.listeners(*route);
+    out.assign(listeners, listeners + route->count);
+    return out;
+}
+
+void test_strview_compare(void) {
+    StrView a("light002", 5);
+    TEST_ASSERT_EQUAL(5, a.length());
+    TEST_ASSERT_TRUE(a == "light");
+    TEST_ASSERT_TRUE(a != "light002");
+    TEST_ASSERT_TRUE(a.startsWith("lig"));
+    TEST_ASSERT_FALSE(a.startsWith("light0"));
+    TEST_ASSERT_TRUE(StrView() == "");
+}
+
+void test_strview_copy_truncates(void) {
+    StrView s("abcdef");
+    char buf[4];
+    TEST_ASSERT_EQUAL(3, s.copyTo(buf, sizeof(buf)));
+    TEST_ASSERT_EQUAL_STRING("abc", buf);
+    TEST_ASSERT_EQUAL(0, s.copyTo(buf, 0));
+    TEST_ASSERT_EQUAL_STRING("abcdef", s.toString().c_str());
+}
+
+void test_strview_prints_range_only(void) {
+    StringPrint out;
+    out.print(StrView("on#80#2700", 5));
+    TEST_ASSERT_EQUAL_STRING("on#80", out.str.c_str());
+}
+
+void test_find_before_freeze_fails(void) {
+    Router router;
+    router.add("a", 1);
+    TEST_ASSERT_NULL(router.find("a", 1));
+}
+
+void test_listeners_grouped_in_order(void) {
+    Router router;
+    router.add("light002", 1);
+    router.add("fan003", 2);
+    router.add("light002", 3);
+    router.add("light002", 4);
+    router.freeze();
+
+    TEST_ASSERT_EQUAL(2, router.size());
+
+    auto light = listenersOf(router, "light002");
+    TEST_ASSERT_EQUAL(3, light.size());
+    TEST_ASSERT_EQUAL(1, light[0]);
+    TEST_ASSERT_EQUAL(3, light[1]);
+    TEST_ASSERT_EQUAL(4, light[2]);
+
+    auto fan = listenersOf(router, "fan003");
+    TEST_ASSERT_EQUAL(1, fan.size());
+    TEST_ASSERT_EQUAL(2, fan[0]);
+}
+
+void test_add_after_freeze_is_ignored(void) {
+    Router router;
+    router.add("a", 1);
+    router.freeze();
+    TEST_ASSERT_FALSE(router.add("b", 2));
+    TEST_ASSERT_NULL(router.find("b", 1));
+    TEST_ASSERT_EQUAL(1, router.size());
+}
+
+void test_find_uses_length_not_terminator(void) {
+    Router router;
+    router.add("light", 1);
+    router.add("light002", 2);
+    router.freeze();
+
+    const char *payload = "light002/set";
+    auto route = router.find(payload, 8);
+    TEST_ASSERT_NOT_NULL(route);
+    TEST_ASSERT_EQUAL(2, router.listeners(*route)[0]);
+
+    route = router.find(payload, 5);
+    TEST_ASSERT_NOT_NULL(route);
+    TEST_ASSERT_EQUAL(1, router.listeners(*route)[0]);
+
+    TEST_ASSERT_NULL(router.find(payload, 6));
+    TEST_ASSERT_NULL(router.find(payload, 12));
+}
+
+void test_topic_view_points_into_pool(void) {
+    Router router;
+    String topic = "ac004";
+    router.add(topic.c_str(), 1);
+    router.freeze();
+    topic = "xxxxx"; // the router keeps its own copy
+
+    auto route = router.find("ac004", 5);
+    TEST_ASSERT_NOT_NULL(route);
+    TEST_ASSERT_TRUE(router.topic(*route) == "ac004");
+}
+
+void test_many_routes_with_collisions(void) {
+    Router router;
+    char topic[16];
+    for (int i = 0; i < 100; i++) {
+        snprintf(topic, sizeof(topic), "dev%03d", i);
+        router.add(topic, i);
+    }
+    router.freeze();
+
+    for (int i = 0; i < 100; i++) {
+        snprintf(topic, sizeof(topic), "dev%03d", i);
+        auto found = listenersOf(router, topic);
+        TEST_ASSERT_EQUAL(1, found.size());
+        TEST_ASSERT_EQUAL(i, found[0]);
+    }
+    TEST_ASSERT_NULL(router.find("dev100", 6));
+    TEST_ASSERT_NULL(router.find("", 0));
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_strview_compare);
+    RUN_TEST(test_strview_copy_truncates);
+    RUN_TEST(test_strview_prints_range_only);
+    RUN_TEST(test_find_before_freeze_fails);
+    RUN_TEST(test_listeners_grouped_in_order);
+    RUN_TEST(test_add_after_freeze_is_ignored);
+    RUN_TEST(test_find_uses_length_not_terminator);
+    RUN_TEST(test_topic_view_points_into_pool);
+    RUN_TEST(test_many_routes_with_collisions);
+    return UNITY_END();
+}
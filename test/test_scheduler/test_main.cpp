@@ -0,0 +1,157 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <vector>
+
+#include "scheduler.h"
+#include "strprint.h"
+
+static std::vector<int> runs;
+
+static void record(void *arg) {
+    runs.push_back((int)(intptr_t)arg);
+}
+
+static std::vector<TaskId> tasks;
+
+static TaskId track(TaskId id) {
+    tasks.push_back(id);
+    return id;
+}
+
+void setUp(void) {
+    HostClock::reset();
+    HostClock::advanceMs(1000);
+    runs.clear();
+}
+
+void tearDown(void) {
+    // the scheduler is static: leave no task behind
+    for (auto id : tasks) Scheduler::cancel(id);
+    tasks.clear();
+}
+
+void test_one_shot_runs_once_when_due(void) {
+    auto id = track(Scheduler::after("t", 100, record, (void *)1));
+    TEST_ASSERT_TRUE(Scheduler::active(id));
+
+    HostClock::advanceMs(99);
+    Scheduler::loop();
+    TEST_ASSERT_EQUAL(0, runs.size());
+
+    HostClock::advanceMs(1);
+    Scheduler::loop();
+    Scheduler::loop();
+    TEST_ASSERT_EQUAL(1, runs.size());
+    TEST_ASSERT_FALSE(Scheduler::active(id));
+}
+
+void test_runs_in_due_order(void) {
+    track(Scheduler::after("c", 30, record, (void *)3));
+    track(Scheduler::after("a", 10, record, (void *)1));
+    track(Scheduler::after("b", 20, record, (void *)2));
+
+    HostClock::advanceMs(50);
+    Scheduler::loop();
+
+    TEST_ASSERT_EQUAL(3, runs.size());
+    TEST_ASSERT_EQUAL(1, runs[0]);
+    TEST_ASSERT_EQUAL(2, runs[1]);
+    TEST_ASSERT_EQUAL(3, runs[2]);
+}
+
+void test_periodic_skips_missed_runs(void) {
+    track(Scheduler::every("p", 100, record, (void *)1));
+
+    for (int i = 0; i < 5; i++) {
+        HostClock::advanceMs(100);
+        Scheduler::loop();
+    }
+    TEST_ASSERT_EQUAL(5, runs.size());
+
+    // a stall of several periods runs it once, not in a burst
+    HostClock::advanceMs(1000);
+    Scheduler::loop();
+    TEST_ASSERT_EQUAL(6, runs.size());
+
+    HostClock::advanceMs(99);
+    Scheduler::loop();
+    TEST_ASSERT_EQUAL(6, runs.size());
+    HostClock::advanceMs(1);
+    Scheduler::loop();
+    TEST_ASSERT_EQUAL(7, runs.size());
+}
+
+void test_cancel(void) {
+    auto id = track(Scheduler::after("t", 10, record, 0));
+    TEST_ASSERT_TRUE(Scheduler::cancel(id));
+    TEST_ASSERT_FALSE(Scheduler::cancel(id));
+
+    HostClock::advanceMs(20);
+    Scheduler::loop();
+    TEST_ASSERT_EQUAL(0, runs.size());
+    TEST_ASSERT_FALSE(Scheduler::cancel(TASK_NONE));
+}
+
+void test_stale_id_does_not_cancel_reused_slot(void) {
+    auto first = Scheduler::after("t", 10, record, (void *)1);
+    HostClock::advanceMs(10);
+    Scheduler::loop();
+
+    auto second = track(Scheduler::after("t", 10, record, (void *)2));
+    TEST_ASSERT_TRUE(first != second);
+    TEST_ASSERT_FALSE(Scheduler::cancel(first));
+    TEST_ASSERT_TRUE(Scheduler::active(second));
+}
+
+static TaskId self_id;
+
+static void cancelSelf(void *) {
+    runs.push_back(0);
+    Scheduler::cancel(self_id);
+}
+
+void test_periodic_may_cancel_itself(void) {
+    self_id = track(Scheduler::every("self", 10, cancelSelf, 0));
+
+    HostClock::advanceMs(10);
+    Scheduler::loop();
+    HostClock::advanceMs(10);
+    Scheduler::loop();
+
+    TEST_ASSERT_EQUAL(1, runs.size());
+    TEST_ASSERT_FALSE(Scheduler::active(self_id));
+}
+
+void test_full_pool(void) {
+    for (int i = 0; i < SCHEDULER_SLOTS; i++) {
+        TEST_ASSERT_TRUE(track(Scheduler::after("t", 1000, record, 0)) != TASK_NONE);
+    }
+    TEST_ASSERT_EQUAL(TASK_NONE, Scheduler::after("t", 1000, record, 0));
+}
+
+static void slow(void *) {
+    HostClock::advanceUs(1500);
+}
+
+void test_stats_in_json(void) {
+    track(Scheduler::every("slow", 100, slow, 0));
+    HostClock::advanceMs(102);
+    Scheduler::loop();
+
+    StringPrint out;
+    Scheduler::printTo(out);
+    TEST_ASSERT_EQUAL_STRING("[{\"name\":\"slow\",\"period\":100,\"runs\":1,\"lateMax\":2000,\"runMax\":1500,\"runSum\":1500}]", out.str.c_str());
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_one_shot_runs_once_when_due);
+    RUN_TEST(test_runs_in_due_order);
+    RUN_TEST(test_periodic_skips_missed_runs);
+    RUN_TEST(test_cancel);
+    RUN_TEST(test_stale_id_does_not_cancel_reused_slot);
+    RUN_TEST(test_periodic_may_cancel_itself);
+    RUN_TEST(test_full_pool);
+    RUN_TEST(test_stats_in_json);
+    return UNITY_END();
+}
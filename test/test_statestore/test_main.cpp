@@ -0,0 +1,134 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <unity.h>
+#include <memory>
+#include <string>
+
+#include "statestore.h"
+
+// A reset is a new StateStore on the same RTC memory and flash; a power
+// loss also clears the RTC memory.
+
+#define LOG_PATH "/state.log"
+
+static std::unique_ptr<StateStore> store;
+
+static void reset(bool powerLoss = false) {
+    if (powerLoss) memset(ESP.rtc_memory, 0, sizeof(ESP.rtc_memory));
+    store.reset(new StateStore());
+    store->begin(LittleFS, LOG_PATH);
+}
+
+static void run(uint32_t ms = 0) {
+    HostClock::advanceMs(ms);
+    Scheduler::loop();
+}
+
+static const char *get(const char *key) {
+    static char value[STATE_VALUE_LEN + 1];
+    if (!store->get(StrView(key), value, sizeof(value))) return "";
+    return value;
+}
+
+static const char *key(int i) {
+    static char buf[16];
+    snprintf(buf, sizeof(buf), "device%03d", i);
+    return buf;
+}
+
+void setUp(void) {
+    HostClock::reset();
+    HostClock::advanceMs(100);
+    memset(ESP.rtc_memory, 0, sizeof(ESP.rtc_memory));
+    LittleFS.clear();
+    reset();
+}
+
+void tearDown(void) {
+    store.reset();
+}
+
+void test_every_entry_survives_a_reset(void) {
+    for (int i = 0; i < STATE_MAX_ENTRIES; i++) store->set(StrView(key(i)), StrView("on#100#16711680#1"));
+    store->set(StrView("one-too-many"), StrView("on"));
+
+    reset();
+    for (int i = 0; i < STATE_MAX_ENTRIES; i++) {
+        TEST_ASSERT_EQUAL_STRING("on#100#16711680#1", get(key(i)));
+    }
+    TEST_ASSERT_EQUAL_STRING("", get("one-too-many"));
+
+    // and the RTC table stays clear of the slots before it
+    for (int i = 0; i < RTC_SLOT_STATE * 4; i++) TEST_ASSERT_EQUAL(0, ESP.rtc_memory[i]);
+}
+
+void test_changes_reach_flash_after_the_delay(void) {
+    store->set(StrView("light"), StrView("on"));
+    run(STATE_FLUSH_DELAY_MS - 1);
+    TEST_ASSERT_EQUAL(0, LittleFS.get(LOG_PATH).size());
+
+    run(1);
+    reset(true);
+    TEST_ASSERT_EQUAL_STRING("on", get("light"));
+}
+
+void test_failed_flush_keeps_the_change(void) {
+    LittleFS.fail_writes = true;
+    store->set(StrView("light"), StrView("off"));
+    run(STATE_FLUSH_DELAY_MS);
+    TEST_ASSERT_FALSE(store->flush());
+
+    // retried once the flash takes writes again
+    LittleFS.fail_writes = false;
+    run(STATE_FLUSH_RETRY_MS);
+    reset(true);
+    TEST_ASSERT_EQUAL_STRING("off", get("light"));
+}
+
+void test_change_kept_dirty_over_a_reset(void) {
+    LittleFS.fail_writes = true;
+    store->set(StrView("light"), StrView("on"));
+    run(STATE_FLUSH_DELAY_MS);
+
+    // the reset finds it dirty in RTC memory and writes it
+    LittleFS.fail_writes = false;
+    reset();
+    run(STATE_FLUSH_DELAY_MS);
+    reset(true);
+    TEST_ASSERT_EQUAL_STRING("on", get("light"));
+}
+
+void test_torn_append_is_compacted(void) {
+    store->set(StrView("light"), StrView("on"));
+    TEST_ASSERT_TRUE(store->flush());
+
+    // half a record lands before the flash fails
+    auto log = LittleFS.get(LOG_PATH);
+    LittleFS.put(LOG_PATH, log + log.substr(0, log.size() / 2));
+    store->set(StrView("light"), StrView("off"));
+    LittleFS.fail_writes = true;
+    TEST_ASSERT_FALSE(store->flush());
+
+    LittleFS.fail_writes = false;
+    TEST_ASSERT_TRUE(store->flush());
+    reset(true);
+    TEST_ASSERT_EQUAL_STRING("off", get("light"));
+}
+
+void test_long_values_are_not_kept(void) {
+    store->set(StrView("light"), StrView("on"));
+    std::string tooLong(STATE_VALUE_LEN + 1, '1');
+    store->set(StrView("light"), StrView(tooLong.c_str()));
+    TEST_ASSERT_EQUAL_STRING("on", get("light"));
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_every_entry_survives_a_reset);
+    RUN_TEST(test_changes_reach_flash_after_the_delay);
+    RUN_TEST(test_failed_flush_keeps_the_change);
+    RUN_TEST(test_change_kept_dirty_over_a_reset);
+    RUN_TEST(test_torn_append_is_compacted);
+    RUN_TEST(test_long_values_are_not_kept);
+    return UNITY_END();
+}